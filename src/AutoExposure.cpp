@@ -0,0 +1,288 @@
+/*
+ * File:   AutoExposure.cpp
+ *
+ * Host side auto exposure and auto gain control.
+ */
+
+#include "AutoExposure.h"
+#include "CamFireWire.h"
+#include <math.h>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace base::samples::frame;
+
+namespace camera
+{
+
+// the exposure is left alone within +/- 5% of the target
+static const double DEFAULT_TOLERANCE = 0.05;
+// more saturated pixels than this pull the exposure down
+static const double MAX_SATURATED = 0.02;
+
+AutoExposure::AutoExposure(CamFireWire &camera)
+    : camera(camera), target(0.45), speed(0.6), tolerance(DEFAULT_TOLERANCE), step(4),
+      settle_frames(2), frames_since_update(0), gain_db_per_unit(0.0358),
+      shutter(1), shutter_min(1), shutter_max(4095), gain(0), gain_min(0), gain_max(0),
+      converged(false)
+{
+    last.mean = 0;
+    last.p99 = 0;
+    last.saturated = 0;
+    last.samples = 0;
+}
+
+bool AutoExposure::init()
+{
+    if (!camera.getAttribRange(int_attrib::ShutterValue, shutter_min, shutter_max, shutter))
+        return false;
+
+    // cameras without gain are controlled by the shutter only
+    if (!camera.getAttribRange(int_attrib::GainValue, gain_min, gain_max, gain))
+        gain = gain_min = gain_max = 0;
+
+    if (shutter_min == 0)
+        shutter_min = 1;
+    frames_since_update = settle_frames;
+    return true;
+}
+
+void AutoExposure::setMeteringRegion(const RegionOfInterest &region)
+{
+    roi = region;
+}
+
+void AutoExposure::setTarget(double level)
+{
+    if (level <= 0 || level >= 1)
+        throw std::runtime_error("AutoExposure: target level must be within (0, 1)!");
+    target = level;
+}
+
+void AutoExposure::setConvergenceSpeed(double value)
+{
+    if (value <= 0 || value > 1)
+        throw std::runtime_error("AutoExposure: convergence speed must be within (0, 1]!");
+    speed = value;
+}
+
+void AutoExposure::setSubsampling(uint32_t value)
+{
+    step = value ? value : 1;
+}
+
+void AutoExposure::setSettleFrames(uint32_t frames)
+{
+    settle_frames = frames;
+}
+
+void AutoExposure::setShutterLimits(uint32_t min, uint32_t max)
+{
+    shutter_min = min ? min : 1;
+    shutter_max = max;
+}
+
+void AutoExposure::setGainLimits(uint32_t min, uint32_t max)
+{
+    gain_min = min;
+    gain_max = max;
+}
+
+void AutoExposure::setGainScale(double db_per_unit)
+{
+    gain_db_per_unit = db_per_unit;
+}
+
+// levels of one row of cells, a cell is a 2x2 Bayer quad or a pixel
+static void cellRow8(const uint8_t *row0, const uint8_t *row1, bool bayer,
+                     uint32_t cells, uint8_t *out)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    if (bayer)
+    {
+        // average the two rows, then neighbouring columns
+        const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+        for (; i + 8 <= cells; i += 8)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + 2 * i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + 2 * i));
+            __m128i v = _mm_avg_epu8(a, b);
+            __m128i pairs = _mm_avg_epu8(v, _mm_srli_epi16(v, 8));
+            pairs = _mm_and_si128(pairs, low_bytes);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(pairs, pairs));
+        }
+    }
+#endif
+    for (; i < cells; i++)
+    {
+        if (bayer)
+            out[i] = (row0[2 * i] + row0[2 * i + 1] + row1[2 * i] + row1[2 * i + 1] + 2) >> 2;
+        else
+            out[i] = row0[i];
+    }
+}
+
+static void cellRow16(const uint16_t *row0, const uint16_t *row1, bool bayer,
+                      uint32_t cells, uint8_t *out)
+{
+    for (uint32_t i = 0; i < cells; i++)
+    {
+        if (bayer)
+            out[i] = (row0[2 * i] + row0[2 * i + 1] + row1[2 * i] + row1[2 * i + 1]) >> 10;
+        else
+            out[i] = row0[i] >> 8;
+    }
+}
+
+bool AutoExposure::measure(const Frame &frame, ExposureMeasurement &result) const
+{
+    const uint32_t depth = frame.getDataDepth();
+    if ((depth != 8 && depth != 16) || frame.getChannelCount() != 1)
+        return false;
+
+    const bool bayer = frame.getFrameMode() >= MODE_BAYER && frame.getFrameMode() < COMPRESSED_MODES;
+    const uint32_t cell = bayer ? 2 : 1;
+
+    uint32_t x0 = roi.x, y0 = roi.y, width = roi.width, height = roi.height;
+    if (width == 0 || height == 0)
+    {
+        x0 = y0 = 0;
+        width = frame.getWidth();
+        height = frame.getHeight();
+    }
+    if (x0 + width > frame.getWidth() || y0 + height > frame.getHeight())
+        return false;
+
+    // Bayer quads must start on the pattern
+    x0 &= ~(cell - 1);
+    y0 &= ~(cell - 1);
+    const uint32_t cells = width / cell;
+    const uint32_t cell_rows = height / cell;
+    if (cells == 0 || cell_rows == 0)
+        return false;
+
+    uint32_t histogram[256] = { 0 };
+    if (levels.size() < cells)
+        levels.resize(cells);
+    const uint8_t *image = frame.getImageConstPtr();
+    const uint32_t row_size = frame.getRowSize();
+    const uint32_t bytes = depth / 8;
+    for (uint32_t r = 0; r < cell_rows; r += step)
+    {
+        const uint8_t *row0 = image + (y0 + r * cell) * row_size + x0 * bytes;
+        const uint8_t *row1 = bayer ? row0 + row_size : row0;
+        if (depth == 8)
+            cellRow8(row0, row1, bayer, cells, &levels[0]);
+        else
+            cellRow16(reinterpret_cast<const uint16_t *>(row0), reinterpret_cast<const uint16_t *>(row1),
+                      bayer, cells, &levels[0]);
+        for (uint32_t i = 0; i < cells; i += step)
+            histogram[levels[i]]++;
+    }
+
+    uint64_t sum = 0;
+    uint32_t samples = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        sum += (uint64_t)histogram[i] * i;
+        samples += histogram[i];
+    }
+
+    uint32_t threshold = (uint32_t)(samples * 0.99);
+    uint32_t seen = 0;
+    int p99 = 255;
+    for (int i = 0; i < 256; i++)
+    {
+        seen += histogram[i];
+        if (seen > threshold)
+        {
+            p99 = i;
+            break;
+        }
+    }
+
+    result.samples = samples;
+    result.mean = (double)sum / samples / 255.0;
+    result.p99 = p99 / 255.0;
+    result.saturated = (double)histogram[255] / samples;
+    return true;
+}
+
+bool AutoExposure::process(const Frame &frame)
+{
+    if (!measure(frame, last))
+        return false;
+
+    double ratio = target / (last.mean > 1.0 / 255 ? last.mean : 1.0 / 255);
+    converged = fabs(log(ratio)) < log(1 + tolerance) && last.saturated <= MAX_SATURATED;
+
+    // highlights win over the mean level
+    if (last.saturated > MAX_SATURATED && ratio > 0.85)
+        ratio = 0.85;
+
+    frames_since_update++;
+    if (converged || frames_since_update <= settle_frames)
+        return false;
+    return apply(pow(ratio, speed));
+}
+
+bool AutoExposure::apply(double exposure_ratio)
+{
+    // exposure in shutter units at the minimum gain
+    double gain_factor = pow(10.0, (gain - gain_min) * gain_db_per_unit / 20);
+    double exposure = shutter * gain_factor * exposure_ratio;
+
+    uint32_t new_shutter, new_gain = gain_min;
+    if (exposure <= shutter_max || gain_max <= gain_min)
+    {
+        double value = exposure < shutter_min ? shutter_min : exposure;
+        new_shutter = value > shutter_max ? shutter_max : (uint32_t)(value + 0.5);
+    }
+    else
+    {
+        // the shutter is at its limit, the rest is done by the gain
+        new_shutter = shutter_max;
+        double gain_units = 20 * log10(exposure / shutter_max) / gain_db_per_unit;
+        new_gain = gain_min + (uint32_t)(gain_units + 0.5);
+        if (new_gain > gain_max)
+            new_gain = gain_max;
+    }
+
+    if (new_shutter == shutter && new_gain == gain)
+        return false;
+
+    if (new_shutter != shutter && !camera.setAttrib(int_attrib::ShutterValue, new_shutter))
+        return false;
+    shutter = new_shutter;
+    if (new_gain != gain && !camera.setAttrib(int_attrib::GainValue, new_gain))
+        return false;
+    gain = new_gain;
+    frames_since_update = 0;
+    return true;
+}
+
+const ExposureMeasurement &AutoExposure::getLastMeasurement() const
+{
+    return last;
+}
+
+uint32_t AutoExposure::getShutter() const
+{
+    return shutter;
+}
+
+uint32_t AutoExposure::getGain() const
+{
+    return gain;
+}
+
+bool AutoExposure::isConverged() const
+{
+    return converged;
+}
+
+}
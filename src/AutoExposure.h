@@ -0,0 +1,119 @@
+/*
+ * File:   AutoExposure.h
+ *
+ * Host side auto exposure and auto gain control.
+ */
+
+#ifndef _AUTOEXPOSURE_H
+#define	_AUTOEXPOSURE_H
+
+#include <vector>
+#include <stdint.h>
+#include "base/samples/Frame.hpp"
+#include "cam_fw_types.h"
+
+namespace camera
+{
+
+class CamFireWire;
+
+/**
+ * Brightness measurement of one frame.
+ */
+struct ExposureMeasurement
+{
+    // mean level of the metering region, 0..1
+    double mean;
+    // level below which 99% of the metered pixels lie, 0..1
+    double p99;
+    // fraction of saturated pixels
+    double saturated;
+    // number of pixels which were sampled
+    uint32_t samples;
+};
+
+/**
+ * Controls shutter and gain of a camera from the frames it delivers.
+ *
+ * process() meters a subsampled region of each frame (RAW, grayscale or
+ * 16 bit), and moves the exposure multiplicatively towards the target
+ * level. The exposure is raised with the shutter first and with the
+ * gain only when the shutter is at its limit, and lowered the other way
+ * round. Since new settings only show up some frames later, the camera
+ * is updated at most every settle_frames frames.
+ */
+class AutoExposure
+{
+public:
+    explicit AutoExposure(CamFireWire &camera);
+
+    /** Reads the current settings and the limits from the camera */
+    bool init();
+
+    /** Metering region in frame pixels, an empty region meters the whole frame */
+    void setMeteringRegion(const RegionOfInterest &roi);
+
+    /** Mean level (0..1) the controller drives the metering region to */
+    void setTarget(double level);
+
+    /**
+     * Fraction (0..1] of the measured error which is corrected per
+     * update, 1 converges fastest but may overshoot
+     */
+    void setConvergenceSpeed(double speed);
+
+    /** Every n-th pixel in both directions is metered (default 4) */
+    void setSubsampling(uint32_t step);
+
+    /** Frames to wait for new settings to take effect (default 2) */
+    void setSettleFrames(uint32_t frames);
+
+    void setShutterLimits(uint32_t min, uint32_t max);
+    void setGainLimits(uint32_t min, uint32_t max);
+
+    /**
+     * Gain change per register unit in dB, used to trade shutter for
+     * gain (default 0.0358 dB, AVT Guppy/Pike)
+     */
+    void setGainScale(double db_per_unit);
+
+    /**
+     * Meters the frame and updates the camera when necessary.
+     * @return true if new settings were written
+     */
+    bool process(const base::samples::frame::Frame &frame);
+
+    /** Meters the frame without changing the camera */
+    bool measure(const base::samples::frame::Frame &frame, ExposureMeasurement &result) const;
+
+    const ExposureMeasurement &getLastMeasurement() const;
+    uint32_t getShutter() const;
+    uint32_t getGain() const;
+    /** True when the last measurement was within the tolerance of the target */
+    bool isConverged() const;
+
+private:
+    bool apply(double exposure_ratio);
+
+    CamFireWire &camera;
+    RegionOfInterest roi;
+    double target;
+    double speed;
+    double tolerance;
+    uint32_t step;
+    uint32_t settle_frames;
+    uint32_t frames_since_update;
+    double gain_db_per_unit;
+
+    uint32_t shutter, shutter_min, shutter_max;
+    uint32_t gain, gain_min, gain_max;
+
+    ExposureMeasurement last;
+    bool converged;
+    // cell levels of one row, grows to the widest metering region
+    mutable std::vector<uint8_t> levels;
+};
+
+}
+
+#endif	/* _AUTOEXPOSURE_H */
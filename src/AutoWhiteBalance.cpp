@@ -0,0 +1,259 @@
+/*
+ * File:   AutoWhiteBalance.cpp
+ *
+ * Host side auto white balance from Bayer statistics.
+ */
+
+#include "AutoWhiteBalance.h"
+#include "CamFireWire.h"
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace base::samples::frame;
+
+namespace camera
+{
+
+// the balance is left alone within +/- 2%
+static const double TOLERANCE = 0.02;
+
+AutoWhiteBalance::AutoWhiteBalance(CamFireWire &camera, GainTarget gain_target)
+    : camera(camera), gain_target(gain_target), step(4), speed(0.7), settle_frames(2),
+      frames_since_update(0), red_value(0), blue_value(0), value_min(0), value_max(0),
+      digital_red(1), digital_blue(1), converged(false)
+{
+}
+
+bool AutoWhiteBalance::init()
+{
+    frames_since_update = settle_frames;
+    digital_red = digital_blue = 1;
+    if (gain_target == DigitalGains)
+        return true;
+    return camera.getAttribRange(int_attrib::WhitebalValueRed, value_min, value_max, red_value) &&
+        camera.getAttribRange(int_attrib::WhitebalValueBlue, value_min, value_max, blue_value);
+}
+
+void AutoWhiteBalance::setSubsampling(uint32_t value)
+{
+    step = value ? value : 1;
+}
+
+void AutoWhiteBalance::setConvergenceSpeed(double value)
+{
+    if (value <= 0 || value > 1)
+        throw std::runtime_error("AutoWhiteBalance: convergence speed must be within (0, 1]!");
+    speed = value;
+}
+
+void AutoWhiteBalance::setSettleFrames(uint32_t frames)
+{
+    settle_frames = frames;
+}
+
+// position of red and blue within the 2x2 pattern, as row * 2 + column
+static bool bayerLayout(frame_mode_t mode, int &red, int &blue)
+{
+    switch (mode)
+    {
+    case MODE_BAYER_RGGB: red = 0; blue = 3; return true;
+    case MODE_BAYER_GRBG: red = 1; blue = 2; return true;
+    case MODE_BAYER_GBRG: red = 2; blue = 1; return true;
+    // plain MODE_BAYER is handled as BGGR like in setFrameSettings()
+    case MODE_BAYER:
+    case MODE_BAYER_BGGR: red = 3; blue = 0; return true;
+    default: return false;
+    }
+}
+
+// sums of the even and the odd pixels of an 8 bit row
+static void sumRow8(const uint8_t *row, uint32_t width, uint64_t &even, uint64_t &odd)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+    __m128i even_sum = zero, odd_sum = zero;
+    for (; i + 16 <= width; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+        even_sum = _mm_add_epi64(even_sum, _mm_sad_epu8(_mm_and_si128(v, low_bytes), zero));
+        odd_sum = _mm_add_epi64(odd_sum, _mm_sad_epu8(_mm_srli_epi16(v, 8), zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), even_sum);
+    even += lanes[0] + lanes[1];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), odd_sum);
+    odd += lanes[0] + lanes[1];
+#endif
+    for (; i + 1 < width; i += 2)
+    {
+        even += row[i];
+        odd += row[i + 1];
+    }
+}
+
+static void sumRow16(const uint16_t *row, uint32_t width, uint64_t &even, uint64_t &odd)
+{
+    for (uint32_t i = 0; i + 1 < width; i += 2)
+    {
+        even += row[i];
+        odd += row[i + 1];
+    }
+}
+
+bool AutoWhiteBalance::measure(const Frame &frame, double &red_gain, double &blue_gain) const
+{
+    int red, blue;
+    const uint32_t depth = frame.getDataDepth();
+    if (!bayerLayout(frame.getFrameMode(), red, blue) || (depth != 8 && depth != 16))
+        return false;
+
+    uint64_t sums[4] = { 0, 0, 0, 0 };
+    const uint8_t *image = frame.getImageConstPtr();
+    const uint32_t row_size = frame.getRowSize();
+    const uint32_t width = frame.getWidth() & ~1u;
+    for (uint32_t y = 0; y + 1 < frame.getHeight(); y += 2 * step)
+    {
+        for (int r = 0; r < 2; r++)
+        {
+            const uint8_t *row = image + (y + r) * row_size;
+            if (depth == 8)
+                sumRow8(row, width, sums[2 * r], sums[2 * r + 1]);
+            else
+                sumRow16(reinterpret_cast<const uint16_t *>(row), width, sums[2 * r], sums[2 * r + 1]);
+        }
+    }
+
+    // the two green positions are the ones which are neither red nor blue
+    double green = (sums[0] + sums[1] + sums[2] + sums[3] - sums[red] - sums[blue]) / 2.0;
+    if (sums[red] == 0 || sums[blue] == 0 || green == 0)
+        return false;
+    red_gain = green / sums[red];
+    blue_gain = green / sums[blue];
+    return true;
+}
+
+bool AutoWhiteBalance::process(const Frame &frame)
+{
+    double red_ratio, blue_ratio;
+    if (!measure(frame, red_ratio, blue_ratio))
+        return false;
+
+    if (gain_target == DigitalGains)
+    {
+        // the frame is measured before correct(), so the error is
+        // relative to the current digital gains
+        red_ratio /= digital_red;
+        blue_ratio /= digital_blue;
+    }
+    converged = fabs(red_ratio - 1) < TOLERANCE && fabs(blue_ratio - 1) < TOLERANCE;
+    if (converged)
+        return false;
+
+    red_ratio = pow(red_ratio, speed);
+    blue_ratio = pow(blue_ratio, speed);
+    if (gain_target == DigitalGains)
+    {
+        digital_red *= red_ratio;
+        digital_blue *= blue_ratio;
+        return true;
+    }
+
+    frames_since_update++;
+    if (frames_since_update <= settle_frames)
+        return false;
+    return updateCamera(red_ratio, blue_ratio);
+}
+
+static uint32_t scaleValue(uint32_t value, double ratio, uint32_t min, uint32_t max)
+{
+    double scaled = value * ratio + 0.5;
+    if (scaled < min)
+        return min;
+    if (scaled > max)
+        return max;
+    return (uint32_t)scaled;
+}
+
+bool AutoWhiteBalance::updateCamera(double red_ratio, double blue_ratio)
+{
+    // the registers scale the channel gains, the loop closes over frames
+    uint32_t new_red = scaleValue(red_value, red_ratio, value_min, value_max);
+    uint32_t new_blue = scaleValue(blue_value, blue_ratio, value_min, value_max);
+    if (new_red == red_value && new_blue == blue_value)
+        return false;
+
+    if (new_red != red_value && !camera.setAttrib(int_attrib::WhitebalValueRed, new_red))
+        return false;
+    red_value = new_red;
+    if (new_blue != blue_value && !camera.setAttrib(int_attrib::WhitebalValueBlue, new_blue))
+        return false;
+    blue_value = new_blue;
+    frames_since_update = 0;
+    return true;
+}
+
+bool AutoWhiteBalance::correct(Frame &frame) const
+{
+    int red, blue;
+    const uint32_t depth = frame.getDataDepth();
+    if (!bayerLayout(frame.getFrameMode(), red, blue) || (depth != 8 && depth != 16))
+        return false;
+
+    // gain per position of the pattern
+    double gains[4] = { 1, 1, 1, 1 };
+    gains[red] = digital_red;
+    gains[blue] = digital_blue;
+
+    uint8_t *image = frame.getImagePtr();
+    const uint32_t row_size = frame.getRowSize();
+    const uint32_t width = frame.getWidth();
+    if (depth == 8)
+    {
+        std::vector<uint8_t> lut(4 * 256);
+        for (int p = 0; p < 4; p++)
+            for (int v = 0; v < 256; v++)
+                lut[p * 256 + v] = std::min(255.0, v * gains[p] + 0.5);
+
+        for (uint32_t y = 0; y < frame.getHeight(); y++)
+        {
+            uint8_t *row = image + y * row_size;
+            const uint8_t *lut_row = &lut[(y & 1) * 2 * 256];
+            for (uint32_t x = 0; x < width; x++)
+                row[x] = lut_row[(x & 1) * 256 + row[x]];
+        }
+    }
+    else
+    {
+        for (uint32_t y = 0; y < frame.getHeight(); y++)
+        {
+            uint16_t *row = reinterpret_cast<uint16_t *>(image + y * row_size);
+            for (uint32_t x = 0; x < width; x++)
+                row[x] = std::min(65535.0, row[x] * gains[(y & 1) * 2 + (x & 1)] + 0.5);
+        }
+    }
+    return true;
+}
+
+double AutoWhiteBalance::getDigitalRedGain() const
+{
+    return digital_red;
+}
+
+double AutoWhiteBalance::getDigitalBlueGain() const
+{
+    return digital_blue;
+}
+
+bool AutoWhiteBalance::isConverged() const
+{
+    return converged;
+}
+
+}
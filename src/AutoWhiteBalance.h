@@ -0,0 +1,82 @@
+/*
+ * File:   AutoWhiteBalance.h
+ *
+ * Host side auto white balance from Bayer statistics.
+ */
+
+#ifndef _AUTOWHITEBALANCE_H
+#define	_AUTOWHITEBALANCE_H
+
+#include <stdint.h>
+#include "base/samples/Frame.hpp"
+
+namespace camera
+{
+
+class CamFireWire;
+
+/**
+ * Gray world white balance on the raw Bayer mosaic.
+ *
+ * process() sums the four positions of the Bayer pattern in one pass over
+ * a subsampled set of row pairs and derives the red and blue gains which
+ * make the averages equal to green. The gains are either written to the
+ * camera (WhitebalValueRed/Blue, closed loop over a few frames) or kept
+ * as digital gains which correct() applies to the mosaic before
+ * debayering. Capture keeps running in both cases.
+ */
+class AutoWhiteBalance
+{
+public:
+    enum GainTarget { CameraGains, DigitalGains };
+
+    explicit AutoWhiteBalance(CamFireWire &camera, GainTarget gain_target = CameraGains);
+
+    /** Reads the current white balance and its limits from the camera */
+    bool init();
+
+    /** Every n-th row pair is summed (default 4) */
+    void setSubsampling(uint32_t step);
+    /** Fraction (0..1] of the measured error which is corrected per update */
+    void setConvergenceSpeed(double speed);
+    /** Frames to wait for new camera settings to take effect (default 2) */
+    void setSettleFrames(uint32_t frames);
+
+    /**
+     * Measures the frame and updates the gains when necessary.
+     * @return true if new gains were set
+     */
+    bool process(const base::samples::frame::Frame &frame);
+
+    /**
+     * Gains which would balance the frame.
+     * @return false if the frame is no 8 or 16 bit Bayer frame
+     */
+    bool measure(const base::samples::frame::Frame &frame, double &red_gain, double &blue_gain) const;
+
+    /** Applies the digital gains to a Bayer frame in place */
+    bool correct(base::samples::frame::Frame &frame) const;
+
+    double getDigitalRedGain() const;
+    double getDigitalBlueGain() const;
+    /** True when the last frame was balanced within the tolerance */
+    bool isConverged() const;
+
+private:
+    bool updateCamera(double red_ratio, double blue_ratio);
+
+    CamFireWire &camera;
+    GainTarget gain_target;
+    uint32_t step;
+    double speed;
+    uint32_t settle_frames;
+    uint32_t frames_since_update;
+
+    uint32_t red_value, blue_value, value_min, value_max;
+    double digital_red, digital_blue;
+    bool converged;
+};
+
+}
+
+#endif	/* _AUTOWHITEBALANCE_H */
@@ -0,0 +1,349 @@
+/*
+ * File:   BusBandwidthPlanner.cpp
+ *
+ * Isochronous bandwidth planning for several cameras on one 1394 bus.
+ */
+
+#include "BusBandwidthPlanner.h"
+#include "CamFireWire.h"
+#include <dc1394/dc1394.h>
+#include <base-logging/Logging.hpp>
+#include <math.h>
+#include <algorithm>
+
+namespace camera
+{
+
+// isochronous cycles per second
+static const double CYCLES_PER_SECOND = 8000.0;
+
+BusBandwidthPlanner::BusBandwidthPlanner()
+{
+}
+
+void BusBandwidthPlanner::addCamera(const BandwidthRequest &request)
+{
+    if (!request.camera || !request.camera->dc_camera)
+        throw std::runtime_error("BusBandwidthPlanner: camera is not open!");
+    if (request.frame_rate <= 0)
+        throw std::runtime_error("BusBandwidthPlanner: frame rate must be positive!");
+    requests.push_back(request);
+}
+
+void BusBandwidthPlanner::clear()
+{
+    requests.clear();
+    limits.clear();
+}
+
+uint32_t BusBandwidthPlanner::bandwidthUnits(uint32_t packet_bytes, dc1394speed_t speed)
+{
+    // quadlets per packet plus iso header and footer, multiplied by the
+    // time one quadlet needs compared to S1600
+    uint32_t quadlets = (packet_bytes + 3) / 4 + 3;
+    if (speed >= DC1394_ISO_SPEED_1600)
+        return quadlets;
+    return quadlets << (DC1394_ISO_SPEED_1600 - speed);
+}
+
+uint32_t BusBandwidthPlanner::maxPacketBytes(dc1394speed_t speed)
+{
+    if (speed > DC1394_ISO_SPEED_800)
+        speed = DC1394_ISO_SPEED_800;
+    return 1024u << (speed - DC1394_ISO_SPEED_100);
+}
+
+uint32_t BusBandwidthPlanner::packetSizeForRate(uint32_t frame_bytes, double frame_rate,
+                                                uint32_t unit_bytes, uint32_t max_bytes)
+{
+    if (unit_bytes == 0)
+        unit_bytes = max_bytes;
+    if (unit_bytes == 0 || frame_bytes == 0)
+        return 0;
+
+    // a frame rate is reached by sending the frame in at most
+    // floor(8000 / rate) packets, one packet per cycle
+    uint32_t packets_per_frame = 1;
+    if (frame_rate > 0 && frame_rate < CYCLES_PER_SECOND)
+        packets_per_frame = (uint32_t)floor(CYCLES_PER_SECOND / frame_rate);
+
+    uint32_t packet_size = (frame_bytes + packets_per_frame - 1) / packets_per_frame;
+
+    // round up to a multiple of unit_bytes
+    packet_size = (packet_size + unit_bytes - 1) / unit_bytes * unit_bytes;
+    if (packet_size > max_bytes)
+        return 0;
+    return packet_size;
+}
+
+uint32_t BusBandwidthPlanner::nearestPacketSizeForRate(uint32_t frame_bytes, double frame_rate,
+                                                       uint32_t unit_bytes, uint32_t max_bytes)
+{
+    uint32_t upper = packetSizeForRate(frame_bytes, frame_rate, unit_bytes, max_bytes);
+    if (upper == 0)
+        return 0;
+    if (unit_bytes == 0)
+        unit_bytes = max_bytes;
+
+    // the next smaller packet size gives the closest rate below
+    if (upper <= unit_bytes)
+        return upper;
+    uint32_t lower = upper - unit_bytes;
+    double upper_error = frameRateForPacketSize(frame_bytes, upper) - frame_rate;
+    double lower_error = frame_rate - frameRateForPacketSize(frame_bytes, lower);
+    return lower_error < upper_error ? lower : upper;
+}
+
+double BusBandwidthPlanner::frameRateForPacketSize(uint32_t frame_bytes, uint32_t packet_bytes)
+{
+    if (packet_bytes == 0 || frame_bytes == 0)
+        return 0;
+    uint32_t packets_per_frame = (frame_bytes + packet_bytes - 1) / packet_bytes;
+    return CYCLES_PER_SECOND / packets_per_frame;
+}
+
+bool BusBandwidthPlanner::queryLimits(const BandwidthRequest &request, CameraLimits &limit)
+{
+    dc1394camera_t *cam = request.camera->dc_camera;
+
+    if (dc1394_video_get_mode(cam, &limit.mode) != DC1394_SUCCESS)
+        return false;
+    if (limit.mode < DC1394_VIDEO_MODE_FORMAT7_MIN || limit.mode > DC1394_VIDEO_MODE_FORMAT7_MAX)
+    {
+        LOG_ERROR_S << "BusBandwidthPlanner: camera " << cam->guid
+            << " is not in a Format7 mode" << std::endl;
+        return false;
+    }
+
+    uint32_t width = request.width;
+    uint32_t height = request.height;
+    if (width == 0 || height == 0)
+    {
+        if (dc1394_format7_get_image_size(cam, limit.mode, &width, &height) != DC1394_SUCCESS)
+            return false;
+    }
+
+    uint32_t bits = request.bits_per_pixel;
+    if (bits == 0)
+    {
+        dc1394color_coding_t coding;
+        if (dc1394_format7_get_color_coding(cam, limit.mode, &coding) != DC1394_SUCCESS)
+            return false;
+        if (dc1394_get_color_coding_bit_size(coding, &bits) != DC1394_SUCCESS)
+            return false;
+    }
+    limit.frame_bytes = (width * height * bits + 7) / 8;
+
+    if (dc1394_format7_get_packet_parameters(cam, limit.mode, &limit.unit_bytes, &limit.max_bytes) != DC1394_SUCCESS)
+        return false;
+
+    // the camera reports max_bytes for its current speed, it scales with
+    // the speed but never beyond the iso payload limit
+    dc1394speed_t current_speed;
+    if (dc1394_video_get_iso_speed(cam, &current_speed) != DC1394_SUCCESS)
+        return false;
+    if (request.max_speed > current_speed)
+        limit.max_bytes <<= (request.max_speed - current_speed);
+    else
+        limit.max_bytes >>= (current_speed - request.max_speed);
+    if (limit.max_bytes > maxPacketBytes(request.max_speed))
+        limit.max_bytes = maxPacketBytes(request.max_speed);
+    if (limit.unit_bytes == 0)
+        limit.unit_bytes = limit.max_bytes;
+    return limit.max_bytes > 0;
+}
+
+BandwidthAssignment BusBandwidthPlanner::assign(const CameraLimits &limit, uint32_t packet_size,
+                                                dc1394speed_t speed)
+{
+    BandwidthAssignment assignment;
+    assignment.packet_size = packet_size;
+    assignment.packets_per_frame = (limit.frame_bytes + packet_size - 1) / packet_size;
+    assignment.speed = speed;
+    assignment.frame_rate = frameRateForPacketSize(limit.frame_bytes, packet_size);
+    assignment.bandwidth_units = bandwidthUnits(packet_size, speed);
+    return assignment;
+}
+
+uint32_t BusBandwidthPlanner::nextPacketSize(const CameraLimits &limit, uint32_t packet_size, uint32_t max_packet)
+{
+    uint32_t packets_per_frame = (limit.frame_bytes + packet_size - 1) / packet_size;
+    if (packets_per_frame <= 1)
+        return 0;
+    uint32_t next = (limit.frame_bytes + packets_per_frame - 2) / (packets_per_frame - 1);
+    next = (next + limit.unit_bytes - 1) / limit.unit_bytes * limit.unit_bytes;
+    return next <= max_packet ? next : 0;
+}
+
+bool BusBandwidthPlanner::plan(std::vector<BandwidthAssignment> &assignments)
+{
+    limits.resize(requests.size());
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        if (!queryLimits(requests[i], limits[i]))
+        {
+            LOG_ERROR_S << "BusBandwidthPlanner: could not read the Format7 settings of camera "
+                << i << std::endl;
+            return false;
+        }
+    }
+
+    // every camera starts with the smallest packet for its minimum rate,
+    // below 1 fps a camera is of no use and the steps would get too many
+    std::vector<BandwidthAssignment> candidate(requests.size());
+    std::vector<uint32_t> max_packets(requests.size());
+    uint32_t units = 0;
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        const BandwidthRequest &request = requests[i];
+        const CameraLimits &limit = limits[i];
+        const uint32_t largest = limit.max_bytes / limit.unit_bytes * limit.unit_bytes;
+        // a camera which cannot reach the requested rate gets at most its maximum
+        max_packets[i] = packetSizeForRate(limit.frame_bytes, request.frame_rate, limit.unit_bytes, limit.max_bytes);
+        if (max_packets[i] == 0)
+            max_packets[i] = largest;
+
+        uint32_t packet_size = packetSizeForRate(limit.frame_bytes, std::max(request.min_frame_rate, 1.0),
+                                                 limit.unit_bytes, limit.max_bytes);
+        if (packet_size == 0 && request.min_frame_rate > 0)
+        {
+            LOG_ERROR_S << "BusBandwidthPlanner: camera " << i << " cannot reach "
+                << request.min_frame_rate << " fps even alone on the bus" << std::endl;
+            return false;
+        }
+        if (packet_size == 0 || packet_size > max_packets[i])
+            packet_size = max_packets[i];
+        if (packet_size == 0)
+            return false;
+        candidate[i] = assign(limit, packet_size, request.max_speed);
+        units += candidate[i].bandwidth_units;
+    }
+    if (units > ISO_BANDWIDTH_UNITS)
+    {
+        LOG_ERROR_S << "BusBandwidthPlanner: the minimum frame rates need " << units << " of "
+            << ISO_BANDWIDTH_UNITS << " bandwidth units" << std::endl;
+        return false;
+    }
+
+    // water-filling of the rest of the cycle, the step with the largest
+    // frame rate gain per bandwidth unit first
+    for (;;)
+    {
+        size_t best = requests.size();
+        double best_gain = 0;
+        BandwidthAssignment best_step;
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            uint32_t packet_size = nextPacketSize(limits[i], candidate[i].packet_size, max_packets[i]);
+            if (packet_size == 0)
+                continue;
+            BandwidthAssignment step = assign(limits[i], packet_size, requests[i].max_speed);
+            uint32_t cost = step.bandwidth_units - candidate[i].bandwidth_units;
+            if (units + cost > ISO_BANDWIDTH_UNITS)
+                continue;
+            // a step within the same quadlets costs nothing
+            double gain = (step.frame_rate - candidate[i].frame_rate) / std::max(cost, 1u);
+            if (best == requests.size() || gain > best_gain)
+            {
+                best = i;
+                best_gain = gain;
+                best_step = step;
+            }
+        }
+        if (best == requests.size())
+            break;
+        units += best_step.bandwidth_units - candidate[best].bandwidth_units;
+        candidate[best] = best_step;
+    }
+    assignments = candidate;
+
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        if (assignments[i].frame_rate < requests[i].min_frame_rate)
+        {
+            LOG_ERROR_S << "BusBandwidthPlanner: camera " << i << " would only reach "
+                << assignments[i].frame_rate << " fps, " << requests[i].min_frame_rate
+                << " fps are required" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BusBandwidthPlanner::apply()
+{
+    // speed and packet size cannot change while the camera transmits
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        dc1394switch_t transmission;
+        if (dc1394_video_get_transmission(requests[i].camera->dc_camera, &transmission) != DC1394_SUCCESS)
+            return false;
+        if (transmission == DC1394_ON)
+        {
+            LOG_ERROR_S << "BusBandwidthPlanner: camera " << i
+                << " is capturing, stop it before applying a plan" << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<BandwidthAssignment> assignments;
+    if (!plan(assignments))
+        return false;
+
+    // remember the current settings for the rollback
+    std::vector<dc1394operation_mode_t> old_modes(requests.size());
+    std::vector<dc1394speed_t> old_speeds(requests.size());
+    std::vector<uint32_t> old_packet_sizes(requests.size());
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        dc1394camera_t *cam = requests[i].camera->dc_camera;
+        if (dc1394_video_get_operation_mode(cam, &old_modes[i]) != DC1394_SUCCESS ||
+            dc1394_video_get_iso_speed(cam, &old_speeds[i]) != DC1394_SUCCESS ||
+            dc1394_format7_get_packet_size(cam, limits[i].mode, &old_packet_sizes[i]) != DC1394_SUCCESS)
+            return false;
+    }
+
+    size_t applied = 0;
+    bool success = true;
+    for (; applied < requests.size() && success; applied++)
+    {
+        dc1394camera_t *cam = requests[applied].camera->dc_camera;
+        const BandwidthAssignment &assignment = assignments[applied];
+
+        // S800 and faster are only available in the 1394B operation mode
+        if (assignment.speed >= DC1394_ISO_SPEED_800 && old_modes[applied] != DC1394_OPERATION_MODE_1394B)
+            success = dc1394_video_set_operation_mode(cam, DC1394_OPERATION_MODE_1394B) == DC1394_SUCCESS;
+
+        // the packet limits change with the speed, check them again
+        uint32_t unit_bytes, max_bytes;
+        success = success && dc1394_video_set_iso_speed(cam, assignment.speed) == DC1394_SUCCESS &&
+            dc1394_format7_get_packet_parameters(cam, limits[applied].mode, &unit_bytes, &max_bytes) == DC1394_SUCCESS &&
+            assignment.packet_size <= max_bytes &&
+            dc1394_format7_set_packet_size(cam, limits[applied].mode, assignment.packet_size) == DC1394_SUCCESS;
+    }
+
+    if (!success)
+    {
+        LOG_ERROR_S << "BusBandwidthPlanner: camera " << applied - 1
+            << " rejected its settings, restoring all cameras" << std::endl;
+        for (size_t i = 0; i < applied; i++)
+        {
+            dc1394camera_t *cam = requests[i].camera->dc_camera;
+            dc1394_video_set_operation_mode(cam, old_modes[i]);
+            dc1394_video_set_iso_speed(cam, old_speeds[i]);
+            dc1394_format7_set_packet_size(cam, limits[i].mode, old_packet_sizes[i]);
+        }
+        return false;
+    }
+
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        requests[i].camera->settings_changed = true;
+        LOG_INFO_S << "BusBandwidthPlanner: camera " << i << ": packet size "
+            << assignments[i].packet_size << ", " << assignments[i].frame_rate << " fps, "
+            << assignments[i].bandwidth_units << " bandwidth units" << std::endl;
+    }
+    return true;
+}
+
+}
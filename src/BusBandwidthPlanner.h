@@ -0,0 +1,145 @@
+/*
+ * File:   BusBandwidthPlanner.h
+ *
+ * Isochronous bandwidth planning for several cameras on one 1394 bus.
+ */
+
+#ifndef _BUSBANDWIDTHPLANNER_H
+#define	_BUSBANDWIDTHPLANNER_H
+
+#include <vector>
+#include <stdint.h>
+#include <dc1394/types.h>
+
+namespace camera
+{
+
+class CamFireWire;
+
+/**
+ * Requested settings of one camera. The camera must already be configured
+ * for a Format7 mode by setFrameSettings(). Image size and bits per pixel
+ * are read from the camera if they are left at 0.
+ */
+struct BandwidthRequest
+{
+    CamFireWire *camera;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bits_per_pixel;
+    // desired frame rate, the plan gives no camera more bandwidth than
+    // the smallest packet which reaches it
+    double frame_rate;
+    // the plan is refused if this rate cannot be reached
+    double min_frame_rate;
+    // fastest iso speed the camera and its link support, which is always
+    // used: a faster speed needs fewer bandwidth units for the same bytes
+    dc1394speed_t max_speed;
+
+    BandwidthRequest()
+        : camera(0), width(0), height(0), bits_per_pixel(0),
+          frame_rate(0), min_frame_rate(0), max_speed(DC1394_ISO_SPEED_400) {}
+};
+
+/**
+ * Planned settings of one camera.
+ */
+struct BandwidthAssignment
+{
+    uint32_t packet_size;
+    uint32_t packets_per_frame;
+    dc1394speed_t speed;
+    double frame_rate;
+    // bus bandwidth allocation units per cycle
+    uint32_t bandwidth_units;
+};
+
+/**
+ * Distributes the isochronous bandwidth of one bus between several
+ * Format7 cameras.
+ *
+ * Every camera first gets the smallest packet which reaches its
+ * min_frame_rate (and at least 1 fps); a plan in which these do not fit
+ * into one 125 us cycle is refused before any camera is touched. The
+ * rest of the cycle is filled step by step: each step shortens the frame
+ * of one camera by one packet, and it is given to the camera which gains
+ * the most frames per second per additional bandwidth unit, until no
+ * camera below its frame_rate fits anymore. This greedily maximises the
+ * aggregate frame rate, so once all minimums are met the cameras with
+ * small frames are served first. apply() either sets the operation mode,
+ * speed and packet size of all cameras or restores the previous ones.
+ */
+class BusBandwidthPlanner
+{
+public:
+    /** Bandwidth allocation units which may be used for isochronous
+     * traffic per cycle (80% of the cycle) */
+    static const uint32_t ISO_BANDWIDTH_UNITS = 4915;
+
+    BusBandwidthPlanner();
+
+    void addCamera(const BandwidthRequest &request);
+    void clear();
+
+    /**
+     * Computes the packet sizes without changing any camera.
+     * @return false if the plan is infeasible
+     */
+    bool plan(std::vector<BandwidthAssignment> &assignments);
+
+    /**
+     * Computes the plan and applies it to all cameras. Cameras planned for
+     * S800 or faster are switched to the 1394B operation mode.
+     * @return false if a camera is transmitting, the plan is infeasible or
+     *         could not be applied, in which case no camera was changed
+     */
+    bool apply();
+
+    /** Bandwidth allocation units a packet needs per cycle, as computed by
+     * dc1394_video_get_bandwidth_usage */
+    static uint32_t bandwidthUnits(uint32_t packet_bytes, dc1394speed_t speed);
+
+    /** Largest isochronous payload for the given speed */
+    static uint32_t maxPacketBytes(dc1394speed_t speed);
+
+    /**
+     * Smallest packet size, a multiple of unit_bytes, which transfers a
+     * frame of frame_bytes at least with frame_rate.
+     * @return 0 if even max_bytes is too small
+     */
+    static uint32_t packetSizeForRate(uint32_t frame_bytes, double frame_rate,
+                                      uint32_t unit_bytes, uint32_t max_bytes);
+
+    /**
+     * Legal packet size whose frame rate is closest to frame_rate, which
+     * may also be slightly below it.
+     * @return 0 if even max_bytes is too small
+     */
+    static uint32_t nearestPacketSizeForRate(uint32_t frame_bytes, double frame_rate,
+                                             uint32_t unit_bytes, uint32_t max_bytes);
+
+    /** Frame rate reached with the given packet size (one packet per cycle) */
+    static double frameRateForPacketSize(uint32_t frame_bytes, uint32_t packet_bytes);
+
+private:
+    struct CameraLimits
+    {
+        uint32_t frame_bytes;
+        uint32_t unit_bytes;
+        uint32_t max_bytes;
+        dc1394video_mode_t mode;
+    };
+
+    bool queryLimits(const BandwidthRequest &request, CameraLimits &limits);
+    static BandwidthAssignment assign(const CameraLimits &limits, uint32_t packet_size, dc1394speed_t speed);
+    /** Smallest packet size which sends the frame in one packet less,
+     * 0 if it is larger than max_packet */
+    static uint32_t nextPacketSize(const CameraLimits &limits, uint32_t packet_size, uint32_t max_packet);
+
+    std::vector<BandwidthRequest> requests;
+    std::vector<CameraLimits> limits;
+};
+
+}
+
+#endif	/* _BUSBANDWIDTHPLANNER_H */
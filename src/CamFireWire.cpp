@@ -8,11 +8,20 @@
 #include <iostream>
 #include "camera_interface/CamInfoUtils.h"
 #include "CamFireWire.h"
+#include "BusBandwidthPlanner.h"
+#include "VideoModeTable.h"
+#include "filter/hdr_merge.h"
 #include <dc1394/dc1394.h>
 #include <dc1394/vendor/avt.h>
 #include <base-logging/Logging.hpp>
 #include <dc1394/control.h>
 #include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include <poll.h>
+#include <string.h>
+#include <errno.h>
 
 
 using namespace base::samples::frame;
@@ -20,14 +29,60 @@ using namespace base::samples::frame;
 namespace camera
 {
 
+// holds handle_mutex for the lifetime of a scope
+class HandleLock
+{
+public:
+    explicit HandleLock(pthread_mutex_t &mutex) : mutex(mutex) { pthread_mutex_lock(&mutex); }
+    ~HandleLock() { pthread_mutex_unlock(&mutex); }
+
+private:
+    pthread_mutex_t &mutex;
+};
+
 CamFireWire::CamFireWire()
 {
+    // recursive, as locked methods call each other
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&handle_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
     // init parameters
     dc_camera = NULL;
+    dc_device = NULL;
+    camera_registry = NULL;
+    shared_device = false;
     hdr_enabled = false;
     multi_shot_count = 0;
     data_depth = 0;
     frame_mode = MODE_UNDEFINED;
+    retrieve_policy = RetrieveOldest;
+    last_skipped_frames = 0;
+    timestamp_correction = false;
+    last_cycle_sample_time = 0;
+    embedded_info = false;
+    frame_counter_valid = false;
+    last_frame_counter = 0;
+    last_cycle_time = 0;
+    absolute_frame_rate = false;
+    capture_buffer_len = 0;
+    sensor_reduction_x = 1;
+    sensor_reduction_y = 1;
+    supported_modes.num = 0;
+    defer_one_push_wait = false;
+    grab_start_time = 0;
+    realtime_mode = false;
+    memory_locked = false;
+    ring_depth_mode = RingDepthFixed;
+    logged_ring_depth = 0;
+    settings_valid = false;
+    settings_changed = false;
+    bus_generation = 0;
+    last_hdr_value = 0;
+    camera_guid = 0;
+    resume_grab_mode = Stop;
 }
 
 bool CamFireWire::cleanup()
@@ -54,13 +109,26 @@ bool CamFireWire::cleanup()
 
 CamFireWire::~CamFireWire()
 {
-    if (dc_camera)
     {
-	dc1394_iso_release_all(dc_camera);
-	dc1394_camera_free(dc_camera);
+        // a trigger thread may still be inside softwareTrigger()
+        HandleLock lock(handle_mutex);
+        if (dc_camera)
+        {
+            dc1394_iso_release_all(dc_camera);
+            dc1394_camera_free(dc_camera);
+            dc_camera = NULL;
+        }
+    }
+    // the registry holds a camera handle of the device
+    if (!shared_device)
+    {
+        delete camera_registry;
+        if (dc_device)
+            dc1394_free(dc_device);
     }
-    if (dc_device)
-	dc1394_free(dc_device);
+    if (memory_locked)
+        unlockProcessMemory();
+    pthread_mutex_destroy(&handle_mutex);
 }
 
 bool CamFireWire::setDevice(dc1394_t *dev)
@@ -68,67 +136,62 @@ bool CamFireWire::setDevice(dc1394_t *dev)
     if(!dev)
 	return false;
     
+    if(dev != dc_device || shared_device)
+    {
+        if (!shared_device)
+            delete camera_registry;
+        camera_registry = new CameraRegistry(dev);
+    }
     dc_device = dev;
+    shared_device = false;
     return true;
 }
 
-// list all cameras on the firewire bus
-int CamFireWire::listCameras(std::vector<CamInfo>&cam_infos)const
+bool CamFireWire::setDevice(dc1394_t *dev, CameraRegistry *registry)
 {
-    dc1394camera_list_t *list;
-    dc1394error_t err;
+    if(!dev || !registry)
+	return false;
 
-    if (!dc_device)
-	return -1;
+    if (!shared_device)
+        delete camera_registry;
+    camera_registry = registry;
+    dc_device = dev;
+    shared_device = true;
+    return true;
+}
+
+CameraRegistry *CamFireWire::getCameraRegistry()
+{
+    return camera_registry;
+}
 
-    // get list of available cameras
-    if(checkHandleError(dc1394_camera_enumerate (dc_device, &list)))
+// list all cameras on the firewire bus
+int CamFireWire::listCameras(std::vector<CamInfo>&cam_infos)const
+{
+    if (!dc_device || !camera_registry)
 	return -1;
 
-    // temporary camera pointer (for getting the cam_infos)
-    dc1394camera_t *tmp_camera;
+    // the registry only enumerates the bus again after a bus reset
+    camera_registry->update();
+    std::vector<CamInfo> cameras = camera_registry->getCameras();
 
     // if no camera is found on the bus
-    if (list->num == 0)
+    if (cameras.empty())
     {
         std::cout << "no cam found!" << std::endl;
 	return -1;
     }
 
-    // get the cam_info for each camera on the bus
-    for (int i = 0 ; i < list->num ; i++)
-    {
-	// get the i-th camera
-        tmp_camera = dc1394_camera_new(dc_device, list->ids[i].guid);
-	if(!tmp_camera)
-	{
-	    std::cout << "failed to open camera for listing!" << std::endl;
-	    dc1394_camera_free_list(list);
-	    return -1;
-	}
-        
-	// get and set the corresponding cam_info
-	CamInfo cam_info;
-        cam_info.unique_id = tmp_camera->guid;
-        cam_info.display_name = tmp_camera->model;
-        cam_info.interface_type = InterfaceFirewire;
-
-	// add the current cam_info to the vector cam_infos and release the temporary camera
-        cam_infos.push_back(cam_info);
-        dc1394_camera_free(tmp_camera);
-    }
-    
-    int numCams = list->num;
-    
-    dc1394_camera_free_list(list);
+    cam_infos.insert(cam_infos.end(), cameras.begin(), cameras.end());
 
     // return the number of cameras found
-    return numCams;
+    return cameras.size();
 }
 
 // open the camera specified by the CamInfo cam
 bool CamFireWire::open(const CamInfo &cam,const AccessMode mode)
 {
+    HandleLock lock(handle_mutex);
     if (!dc_device)
 	return false;
 
@@ -139,6 +202,8 @@ bool CamFireWire::open(const CamInfo &cam,const AccessMode mode)
     
     // set the current grab mode to "Stop"
     act_grab_mode_= Stop;
+    resume_grab_mode = Stop;
+    settings_valid = false;
 
     if(checkHandleError(dc1394_camera_set_broadcast(dc_camera, DC1394_FALSE)))
     {
@@ -150,6 +215,11 @@ bool CamFireWire::open(const CamInfo &cam,const AccessMode mode)
 	}
     }
 
+    // the supported modes do not change, setFrameSettings checks them often
+    if(checkHandleError(dc1394_video_get_supported_modes(dc_camera, &supported_modes)))
+        supported_modes.num = 0;
+
+    camera_guid = dc_camera->guid;
     return true;
 }
 
@@ -165,18 +235,23 @@ bool CamFireWire::isOpen()const
 // stop capturing and get rid of the camera
 bool CamFireWire::close()
 {
+    HandleLock lock(handle_mutex);
     if (dc_camera != NULL)
     {
         dc1394_capture_stop(dc_camera);
         dc1394_camera_free(dc_camera);
         dc_camera = NULL;
     }
+    supported_modes.num = 0;
+    camera_guid = 0;
+    resume_grab_mode = Stop;
     return true;
 }
 
 // start grabbing using the given GrabMode mode and write frame into a buffer of lenght buffer_len
 bool CamFireWire::grab(const GrabMode mode, const int buffer_len)
 {
+    HandleLock lock(handle_mutex);
     if (!dc_camera)
 	return false;
 
@@ -189,6 +264,7 @@ bool CamFireWire::grab(const GrabMode mode, const int buffer_len)
             return true;
     }
 
+    grab_start_time = CaptureStatistics::now();
     dc1394error_t err = DC1394_SUCCESS;
     // start grabbing using the given GrabMode mode
     switch (mode)
@@ -248,11 +324,12 @@ bool CamFireWire::grab(const GrabMode mode, const int buffer_len)
     // check if whitebalance is in one push auto mode
     dc1394feature_mode_t feature_mode;
     dc1394_feature_get_mode(dc_camera, DC1394_FEATURE_WHITE_BALANCE, &feature_mode);
-    if((mode == SingleFrame || mode == Continuously) && feature_mode == DC1394_FEATURE_MODE_ONE_PUSH_AUTO)
+    if((mode == SingleFrame || mode == Continuously) && feature_mode == DC1394_FEATURE_MODE_ONE_PUSH_AUTO
+       && err == DC1394_SUCCESS && !defer_one_push_wait)
     {
-        // wait for two seconds and turn transmission on again
-        sleep(2);
-        err = dc1394_video_set_transmission(dc_camera,DC1394_ON);
+        // wait until the camera has finished and turn transmission on again
+        std::vector<CamFireWire *> cameras(1, this);
+        waitForOnePush(cameras, ONE_PUSH_TIMEOUT);
     }
     
     if(0 != err)
@@ -262,6 +339,24 @@ bool CamFireWire::grab(const GrabMode mode, const int buffer_len)
         return false;
     }
     act_grab_mode_ = mode;
+    resume_grab_mode = mode == SingleFrame ? Stop : mode;
+    if (mode != Stop)
+    {
+        capture_stats.setStartupTime(CaptureStatistics::now() - grab_start_time);
+        capture_buffer_len = buffer_len;
+        // reading all features takes a few ms, a restart with the same
+        // configuration keeps the snapshot
+        if (!settings_valid || settings_changed)
+            snapshotSettings();
+        capture_stats.setRingSize(buffer_len);
+        ring_advisor.reset();
+        logged_ring_depth = buffer_len;
+
+        // the frame timestamp filter must not span capture sessions
+        cycle_time_sync.reset();
+        last_cycle_sample_time = 0;
+        frame_counter_valid = false;
+    }
     if (act_grab_mode_ == SingleFrame)
       act_grab_mode_ = Stop;
     
@@ -275,41 +370,154 @@ bool CamFireWire::retrieveFrame(Frame &frame,const int timeout)
 	return false;
   
     // dequeue a frame using the dc1394-frame tmp_frame
-    dc1394video_frame_t *tmp_frame=NULL;
+    uint64_t dequeue_time;
+    bool resize_ring = false;
+    dc1394video_frame_t *tmp_frame = dequeueFrame(dequeue_time, resize_ring);
+    fillFrame(tmp_frame, frame);
+    if (!tmp_frame)
+        return false;
 
-    int ret = dc1394_capture_dequeue(dc_camera, DC1394_CAPTURE_POLICY_POLL, &tmp_frame);
-    
-    frame.init(image_size_.width, image_size_.height, data_depth, frame_mode);
-    frame.setHDR(hdr_enabled);
+    requeueFrame(tmp_frame, dequeue_time, resize_ring);
+    return true;
+}
+
+void CamFireWire::fillFrame(const dc1394video_frame_t *src, Frame &frame)
+{
+    // init() clears the whole image, which setImage() overwrites anyway
+    if (!realtime_mode || !hasFrameGeometry(frame))
+        frame.init(image_size_.width, image_size_.height, data_depth, frame_mode);
+    if (frame.isHDR() != hdr_enabled)
+        frame.setHDR(hdr_enabled);
 
-    if(ret == DC1394_SUCCESS)
+    if (!src)
     {
-        if(tmp_frame == NULL)
-        {
-            throw std::runtime_error("Recieved frame is empty.");
-        }
-        else
-        {
-            frame.setImage((const char *)tmp_frame->image, tmp_frame->image_bytes);
-            // set the frame's timestamps (secs and usecs)
-            frame.time = base::Time::fromMicroseconds(tmp_frame->timestamp);
-            frame.setStatus(STATUS_VALID);
-        }
+        frame.setStatus(STATUS_INVALID);
+        return;
     }
-    else
+
+    uint64_t copy_start = CaptureStatistics::now();
+    frame.setImage((const char *)src->image, src->image_bytes);
+    capture_stats.recordCopy(src->image_bytes, CaptureStatistics::now() - copy_start);
+
+    // set the frame's timestamps (secs and usecs)
+    frame.time = getFrameTime(src);
+
+    if (embedded_info)
     {
-        frame.setStatus(STATUS_INVALID);
+        parseEmbeddedFrameInfo(src);
+        if (!realtime_mode)
+            attachEmbeddedFrameInfo(src, frame);
+    }
+    frame.setStatus(STATUS_VALID);
+}
+
+bool CamFireWire::retrieveFrameData(uint8_t *buffer, uint32_t buffer_size, uint32_t &image_bytes,
+                                    base::Time &time, const int timeout)
+{
+    if (!dc_camera)
+	return false;
+
+    if (timeout != 0 && !waitForFrame(timeout))
+        return false;
+
+    uint64_t dequeue_time;
+    bool resize_ring = false;
+    dc1394video_frame_t *tmp_frame = dequeueFrame(dequeue_time, resize_ring);
+    if (!tmp_frame)
+        return false;
+
+    bool fits = tmp_frame->image_bytes <= buffer_size;
+    if (fits)
+    {
+        uint64_t copy_start = CaptureStatistics::now();
+        memcpy(buffer, tmp_frame->image, tmp_frame->image_bytes);
+        capture_stats.recordCopy(tmp_frame->image_bytes, CaptureStatistics::now() - copy_start);
+        image_bytes = tmp_frame->image_bytes;
+        time = getFrameTime(tmp_frame);
+    }
+    // a frame which does not fit is lost as well, its counter is counted
+    if (embedded_info)
+        parseEmbeddedFrameInfo(tmp_frame);
+
+    requeueFrame(tmp_frame, dequeue_time, resize_ring);
+    return fits;
+}
+
+dc1394video_frame_t *CamFireWire::dequeueFrame(uint64_t &dequeue_time, bool &resize_ring)
+{
+    HandleLock lock(handle_mutex);
+    dc1394video_frame_t *tmp_frame = NULL;
+
+    int ret = dc1394_capture_dequeue(dc_camera, DC1394_CAPTURE_POLICY_POLL, &tmp_frame);
+    dequeue_time = CaptureStatistics::now();
+
+    if (ret != DC1394_SUCCESS)
+    {
+        capture_stats.recordDequeueError();
         
         // re-queue the frame previously used for dequeueing
         dc1394_capture_enqueue(dc_camera, tmp_frame);
+        return NULL;
+    }
 
-        return false;
+    if (tmp_frame == NULL)
+    {
+        if (realtime_mode)
+            return NULL;
+        throw std::runtime_error("Recieved frame is empty.");
     }
 
-    // re-queue the frame previously used for dequeueing
-    dc1394_capture_enqueue(dc_camera, tmp_frame);
+    capture_stats.recordDequeue(tmp_frame->timestamp, tmp_frame->frames_behind);
+    capture_stats.matchTrigger(tmp_frame->timestamp);
+    resize_ring = ring_depth_mode != RingDepthFixed && updateRingDepth(tmp_frame, dequeue_time);
+    last_skipped_frames = 0;
+    if (retrieve_policy == RetrieveLatest && tmp_frame->frames_behind > 0)
+        tmp_frame = skipToLatestFrame(tmp_frame);
+    return tmp_frame;
+}
 
-    return true;
+// reads the big endian quadlet with the given index from the image
+static uint32_t readQuadlet(const dc1394video_frame_t *frame, int index)
+{
+    const unsigned char *p = frame->image + 4 * index;
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+base::Time CamFireWire::getFrameTime(const dc1394video_frame_t *frame)
+{
+    if (!timestamp_correction)
+        return base::Time::fromMicroseconds(frame->timestamp);
+
+    // the bus cycle of the exposure is only known when the camera embeds it
+    const int quadlet = embedded_info_layout.timestamp_quadlet;
+    if (embedded_info && quadlet >= 0 && quadlet < (int)(frame->image_bytes / 4))
+    {
+        sampleCycleTimer();
+        if (cycle_time_sync.isValid())
+            return base::Time::fromMicroseconds(
+                    cycle_time_sync.stampFrame(readQuadlet(frame, quadlet), frame->timestamp));
+        return base::Time::fromMicroseconds(frame->timestamp);
+    }
+
+    uint32_t transfer_time = frame->packets_per_frame * CycleTimeSync::CYCLE_TIME_US;
+    return base::Time::fromMicroseconds(cycle_time_sync.correctFrameTime(frame->timestamp, transfer_time));
+}
+
+void CamFireWire::requeueFrame(dc1394video_frame_t *frame, uint64_t dequeue_time, bool resize_ring)
+{
+    HandleLock lock(handle_mutex);
+    // the ring is only set up again when it is empty, so no frame is lost
+    bool ring_empty = frame->frames_behind == 0;
+
+    // re-queue the frame previously used for dequeueing
+    dc1394_capture_enqueue(dc_camera, frame);
+    capture_stats.recordLatency(CaptureStatistics::now() - dequeue_time);
+
+    // the advisor keeps recommending the depth, so a resize refused in
+    // real-time mode is done by the first retrieve after it
+    if (resize_ring && ring_empty && ring_depth_mode == RingDepthAdaptive && act_grab_mode_ == Continuously &&
+        !realtime_mode)
+        resizeRing(ring_advisor.getRecommendedDepth());
 }
 
 // sets the frame size, mode, color depth and whether frames should be resized
@@ -340,6 +548,11 @@ bool CamFireWire::setFrameSettings(const frame_size_t size,
     case MODE_BAYER_RGGB:
     case MODE_BAYER_GRBG:
     case MODE_BAYER_GBRG:
+        if (sensor_reduction_x > 1 || sensor_reduction_y > 1)
+        {
+            selected_mode = setupReducedFormat7Mode(size);
+            break;
+        }
         if (isVideoModeSupported(DC1394_VIDEO_MODE_FORMAT7_3) && isVideo7RAWModeSupported(data_depth))
         {
             selected_mode = DC1394_VIDEO_MODE_FORMAT7_3;
@@ -399,100 +612,20 @@ bool CamFireWire::setFrameSettings(const frame_size_t size,
         }
         //if format 7 is not supported use MONO as RAW mode instead
     case MODE_GRAYSCALE:
-        if(size.height <= 480) 
-        {
-            if (data_depth == 8)
-                selected_mode = DC1394_VIDEO_MODE_640x480_MONO8;
-            else if (data_depth == 16)
-                selected_mode = DC1394_VIDEO_MODE_640x480_MONO16;
-        }
-        else if(size.height <= 600)
+        if ((sensor_reduction_x > 1 || sensor_reduction_y > 1) && mode == MODE_GRAYSCALE)
         {
-            if (data_depth == 8)
-                selected_mode = DC1394_VIDEO_MODE_800x600_MONO8;
-            else if (data_depth == 16)
-                selected_mode = DC1394_VIDEO_MODE_800x600_MONO16;
-        }
-        else if(size.height <= 768)
-        {
-            if (data_depth == 8)
-                selected_mode = DC1394_VIDEO_MODE_1024x768_MONO8;
-            else if (data_depth == 16)
-                selected_mode = DC1394_VIDEO_MODE_1024x768_MONO16;
-        }
-         else if(size.height <= 960)
-        {
-            if (data_depth == 8)
-                selected_mode = DC1394_VIDEO_MODE_1280x960_MONO8;
-            else if (data_depth == 16)
-                selected_mode = DC1394_VIDEO_MODE_1280x960_MONO16;
-        }
-        else
-        {
-            if (data_depth == 8)
-                selected_mode = DC1394_VIDEO_MODE_1600x1200_MONO8;
-            else if (data_depth == 16)
-                selected_mode = DC1394_VIDEO_MODE_1600x1200_MONO16;
+            selected_mode = setupReducedFormat7Mode(size);
+            break;
         }
+        selected_mode = selectFixedVideoMode(size, MODE_GRAYSCALE);
         break;
     case MODE_RGB:
-        if(data_depth == 8)
-        {
-            if(size.height <= 480) 
-            {
-                selected_mode = DC1394_VIDEO_MODE_640x480_RGB8;
-            }
-            else if(size.height <= 600)
-            {
-                selected_mode = DC1394_VIDEO_MODE_800x600_RGB8;
-            }
-            else if(size.height <= 768)
-            {
-                selected_mode = DC1394_VIDEO_MODE_1024x768_RGB8;
-            }
-            else if(size.height <= 960)
-            {
-                selected_mode = DC1394_VIDEO_MODE_1280x960_RGB8;
-            }
-            else
-            {
-                selected_mode = DC1394_VIDEO_MODE_1600x1200_RGB8;
-            }
-        }
-        else
-        {
+        if(data_depth != 8)
             throw std::runtime_error("Only 8 bit color depth is supported for mod RGB!");
-        }
+        selected_mode = selectFixedVideoMode(size, MODE_RGB);
         break;
     case MODE_UYVY:
-        if(size.height <= 120) 
-        {
-            selected_mode = DC1394_VIDEO_MODE_160x120_YUV444;
-        }
-        else if(size.height <= 240) 
-        {
-            selected_mode = DC1394_VIDEO_MODE_320x240_YUV422;
-        }
-        else if(size.height <= 480) 
-        {
-            selected_mode = DC1394_VIDEO_MODE_640x480_YUV422;
-        }
-        else if(size.height <= 600) 
-        {
-            selected_mode = DC1394_VIDEO_MODE_800x600_YUV422;
-        }
-        else if(size.height <= 768) 
-        {
-            selected_mode = DC1394_VIDEO_MODE_1024x768_YUV422;
-        }
-        else if(size.height <= 960) 
-        {
-            selected_mode = DC1394_VIDEO_MODE_1280x960_YUV422;
-        }
-        else
-        {
-            selected_mode = DC1394_VIDEO_MODE_1600x1200_YUV422;
-        }
+        selected_mode = selectFixedVideoMode(size, MODE_UYVY);
         break;
     default:
         throw std::runtime_error("Unknown frame mode!");
@@ -508,9 +641,20 @@ bool CamFireWire::setFrameSettings(const frame_size_t size,
     image_size_ = size;
     image_mode_ = mode;
     image_color_depth_ = color_depth;
+    settings_changed = true;
     return true;
 }
 
+// pick the fixed video mode which fits the frame size best
+dc1394video_mode_t CamFireWire::selectFixedVideoMode(const frame_size_t size, const frame_mode_t mode)
+{
+    const VideoModeEntry *entry = VideoModeTable::findBestMode(size.width, size.height,
+                                                              mode, data_depth, supported_modes);
+    if (!entry)
+        throw std::runtime_error("Video mode is not supported!");
+    return entry->mode;
+}
+
 // (should) return true if the camera is ready for the next one-shot capture
 bool CamFireWire::isReadyForOneShot()
 {
@@ -520,29 +664,116 @@ bool CamFireWire::isReadyForOneShot()
     uint32_t one_shot;
     
     // get the camera's one-shot register
-    dc1394_get_control_register(dc_camera,0x0061C,&one_shot);
-    printf("one shot is %x ",one_shot);
-    fflush(stdout);
+    if(dc1394_get_control_register(dc_camera,0x0061C,&one_shot) != DC1394_SUCCESS)
+        return false;
     
     // the first bit is 1 when the cam is not ready and 0 when ready for a one-shot
     return (one_shot & 0x80000000UL) ? false : true;
 }
 
+bool CamFireWire::isOnePushPending()
+{
+    if (!dc_camera)
+	return false;
+
+    // the camera clears the one-push bit when the white balance is done
+    dc1394feature_mode_t feature_mode;
+    if (dc1394_feature_get_mode(dc_camera, DC1394_FEATURE_WHITE_BALANCE, &feature_mode) != DC1394_SUCCESS)
+        return false;
+    return feature_mode == DC1394_FEATURE_MODE_ONE_PUSH_AUTO;
+}
+
+void CamFireWire::setDeferOnePushWait(bool defer)
+{
+    defer_one_push_wait = defer;
+}
+
+int CamFireWire::waitForOnePush(const std::vector<CamFireWire *> &cameras, const int timeout)
+{
+    uint64_t start = CaptureStatistics::now();
+    std::vector<bool> pending(cameras.size(), true);
+    size_t pending_count = cameras.size();
+    int completed = 0;
+
+    // poll all cameras in turn, starting fast as the white balance often
+    // finishes within a few frames
+    useconds_t delay = 2000;
+    while (pending_count > 0)
+    {
+        bool timed_out = CaptureStatistics::now() - start > (uint64_t)timeout * 1000;
+        for (size_t i = 0; i < cameras.size(); i++)
+        {
+            if (!pending[i])
+                continue;
+            CamFireWire *camera = cameras[i];
+            HandleLock lock(camera->handle_mutex);
+            bool done = !camera->isOnePushPending();
+            if (!done && !timed_out)
+                continue;
+
+            if (done)
+                completed++;
+            else
+                LOG_WARN_S << "one-push white balance of camera " << camera->dc_camera->guid
+                    << " did not finish within " << timeout << " ms" << std::endl;
+            dc1394_video_set_transmission(camera->dc_camera, DC1394_ON);
+            camera->capture_stats.setStartupTime(CaptureStatistics::now() - camera->grab_start_time);
+            pending[i] = false;
+            pending_count--;
+        }
+        if (pending_count == 0)
+            break;
+
+        usleep(delay);
+        delay = std::min(delay * 2, (useconds_t)50000);
+    }
+    return completed;
+}
+
+// true if the camera has processed the last software trigger
+bool CamFireWire::isReadyForSoftwareTrigger()
+{
+    HandleLock lock(handle_mutex);
+    if (!dc_camera)
+	return false;
+
+    // the camera clears the software trigger when it accepted it
+    dc1394switch_t pending;
+    if (dc1394_software_trigger_get_power(dc_camera, &pending) != DC1394_SUCCESS)
+        return false;
+    return pending == DC1394_OFF;
+}
+
+bool CamFireWire::softwareTrigger()
+{
+    HandleLock lock(handle_mutex);
+    if (!isReadyForSoftwareTrigger())
+    {
+        capture_stats.recordMissedTrigger();
+        return false;
+    }
+
+    // dc1394 frame timestamps are wall clock times
+    uint64_t trigger_time = base::Time::now().toMicroseconds();
+    if (dc1394_software_trigger_set_power(dc_camera, DC1394_ON) != DC1394_SUCCESS)
+    {
+        capture_stats.recordMissedTrigger();
+        return false;
+    }
+    capture_stats.recordTrigger(trigger_time);
+    return true;
+}
+
 // check if video mode is supported
 bool CamFireWire::isVideoModeSupported(const dc1394video_mode_t mode)
 {
     if (!dc_camera)
     return false;
     
-    dc1394video_modes_t vmst;
-    if(checkHandleError(dc1394_video_get_supported_modes(dc_camera,&vmst)))
-	return false;
-    
-       
     bool mode_supported = false;
-    for(int i = 0; i < vmst.num; i++)
+    for(uint32_t i = 0; i < supported_modes.num; i++)
     {
-        if (vmst.modes[i] == mode)
+        if (supported_modes.modes[i] == mode)
         {
             mode_supported = true;
             break;
@@ -575,6 +806,113 @@ bool CamFireWire::isVideo7RAWModeSupported(int depth)
     return mode_supported;
 }
 
+bool CamFireWire::isFormat7CodingSupported(const dc1394video_mode_t mode, const dc1394color_coding_t coding)
+{
+    dc1394color_codings_t codings;
+    if(checkHandleError(dc1394_format7_get_color_codings(dc_camera, mode, &codings)))
+	return false;
+
+    for(uint32_t i = 0; i < codings.num; i++)
+    {
+        if(codings.codings[i] == coding)
+            return true;
+    }
+    return false;
+}
+
+int CamFireWire::listFormat7Modes(std::vector<Format7ModeInfo> &modes)
+{
+    if (!dc_camera)
+	return -1;
+
+    uint32_t full_width = 0, full_height = 0;
+    int found = 0;
+    for(int i = 0; i < DC1394_VIDEO_MODE_FORMAT7_NUM; i++)
+    {
+        dc1394video_mode_t mode = (dc1394video_mode_t)(DC1394_VIDEO_MODE_FORMAT7_0 + i);
+        if(!isVideoModeSupported(mode))
+            continue;
+
+        Format7ModeInfo info;
+        info.mode_index = i;
+        if(checkHandleError(dc1394_format7_get_max_image_size(dc_camera, mode, &info.max_width, &info.max_height)))
+            continue;
+        if(info.max_width == 0 || info.max_height == 0)
+            continue;
+
+        // Format7_0 is the full sensor resolution
+        if(full_width == 0)
+        {
+            full_width = info.max_width;
+            full_height = info.max_height;
+        }
+        info.horizontal_factor = (full_width + info.max_width / 2) / info.max_width;
+        info.vertical_factor = (full_height + info.max_height / 2) / info.max_height;
+
+        info.supports_mono8 = isFormat7CodingSupported(mode, DC1394_COLOR_CODING_MONO8);
+        info.supports_mono16 = isFormat7CodingSupported(mode, DC1394_COLOR_CODING_MONO16);
+        info.supports_raw8 = isFormat7CodingSupported(mode, DC1394_COLOR_CODING_RAW8);
+        info.supports_raw16 = isFormat7CodingSupported(mode, DC1394_COLOR_CODING_RAW16);
+
+        modes.push_back(info);
+        found++;
+    }
+    return found;
+}
+
+void CamFireWire::setSensorReduction(uint32_t horizontal_factor, uint32_t vertical_factor)
+{
+    if (horizontal_factor == 0 || vertical_factor == 0)
+        throw std::runtime_error("Sensor reduction factors must be positive!");
+    sensor_reduction_x = horizontal_factor;
+    sensor_reduction_y = vertical_factor;
+}
+
+dc1394video_mode_t CamFireWire::setupReducedFormat7Mode(const frame_size_t size)
+{
+    bool bayer = frame_mode != MODE_GRAYSCALE;
+    dc1394color_coding_t coding;
+    if (data_depth == 8)
+        coding = bayer ? DC1394_COLOR_CODING_RAW8 : DC1394_COLOR_CODING_MONO8;
+    else if (data_depth == 16)
+        coding = bayer ? DC1394_COLOR_CODING_RAW16 : DC1394_COLOR_CODING_MONO16;
+    else
+        throw std::runtime_error("Data depth is not supported!");
+
+    std::vector<Format7ModeInfo> modes;
+    listFormat7Modes(modes);
+    bool configured = true;
+    for (size_t i = 0; i < modes.size(); i++)
+    {
+        if (modes[i].horizontal_factor != sensor_reduction_x || modes[i].vertical_factor != sensor_reduction_y)
+            continue;
+
+        dc1394video_mode_t selected_mode = (dc1394video_mode_t)(DC1394_VIDEO_MODE_FORMAT7_0 + modes[i].mode_index);
+        if (!isFormat7CodingSupported(selected_mode, coding))
+            continue;
+        if (size.width > modes[i].max_width || size.height > modes[i].max_height)
+            throw std::runtime_error("Resolution is not supported by the binning/subsampling mode!");
+
+        // the position goes to the origin first, so any size fits; a mode
+        // which rejects the settings leaves the next one with the same
+        // factors to try
+        if (checkHandleError(dc1394_format7_set_image_position(dc_camera, selected_mode, 0, 0)) ||
+            checkHandleError(dc1394_format7_set_image_size(dc_camera, selected_mode, size.width, size.height)) ||
+            checkHandleError(dc1394_format7_set_image_position(dc_camera, selected_mode,
+                                          (modes[i].max_width - (uint32_t)size.width) / 2,
+                                          (modes[i].max_height - (uint32_t)size.height) / 2)) ||
+            checkHandleError(dc1394_format7_set_color_coding(dc_camera, selected_mode, coding)))
+        {
+            configured = false;
+            continue;
+        }
+        return selected_mode;
+    }
+    if (!configured)
+        throw std::runtime_error("Could not configure the binning/subsampling mode!");
+    throw std::runtime_error("Binning/subsampling factors are not supported by the camera!");
+}
+
 // check if integer-valued attributes are available
 bool CamFireWire::isAttribAvail(const int_attrib::CamAttrib attrib)
 {
@@ -690,6 +1028,13 @@ bool CamFireWire::checkHandleError(dc1394error_t error) const
     return false;
 }
 
+bool CamFireWire::checkCaptureError(dc1394error_t error) const
+{
+    if (realtime_mode)
+        return error != DC1394_SUCCESS;
+    return checkHandleError(error);
+}
+
 // check if enum attributes are available
 bool CamFireWire::isAttribAvail(const enum_attrib::CamAttrib attrib)
 {
@@ -842,6 +1187,7 @@ bool CamFireWire::isAttribAvail(const enum_attrib::CamAttrib attrib)
 // set integer-valued attributes
 bool CamFireWire::setAttrib(const int_attrib::CamAttrib attrib,const int value)
 {
+    HandleLock lock(handle_mutex);
     if (!dc_camera)
 	return false;
 
@@ -976,7 +1322,7 @@ bool CamFireWire::setAttrib(const int_attrib::CamAttrib attrib,const int value)
         if(kneepoint1_voltage1 > 0 || kneepoint1_voltage2 > 0)
         {
             // activate hdr
-            uint32_t kneepoint1_time = 1;
+            uint32_t kneepoint1_time = filter::MultiSlopeCurve::KNEEPOINT_TIME;
             kneepoint1 = (kneepoint1 & 0x00FFFFFFUL) | ((kneepoint1_voltage1 & 0xFFUL) << 24);
             kneepoint1 = (kneepoint1 & 0xFF00FFFFUL) | ((kneepoint1_voltage2 & 0xFFUL) << 16);
             kneepoint1 = (kneepoint1 & 0xFFFF0000UL) | (kneepoint1_time & 0xFFFFUL);
@@ -985,7 +1331,7 @@ bool CamFireWire::setAttrib(const int_attrib::CamAttrib attrib,const int value)
             {
                 // use two kneepoints
                 points_nb = 2;
-                uint32_t kneepoint2_time = 1;
+                uint32_t kneepoint2_time = filter::MultiSlopeCurve::KNEEPOINT_TIME;
                 kneepoint2 = (kneepoint2 & 0x00FFFFFFUL) | ((kneepoint2_voltage1 & 0xFFUL) << 24);
                 kneepoint2 = (kneepoint2 & 0xFF00FFFFUL) | ((kneepoint2_voltage2 & 0xFFUL) << 16);
                 kneepoint2 = (kneepoint2 & 0xFFFF0000UL) | (kneepoint2_time & 0xFFFFUL);
@@ -1019,12 +1365,14 @@ bool CamFireWire::setAttrib(const int_attrib::CamAttrib attrib,const int value)
     
     if(checkHandleError(ret))
 	return false;
-            
+
+    updateSettingsSnapshot(attrib, value);
     return true;
 }
 
 int CamFireWire::getAttrib(const int_attrib::CamAttrib attrib)
 {
+    HandleLock lock(handle_mutex);
     if (!dc_camera)
 	return false;
 
@@ -1043,15 +1391,60 @@ int CamFireWire::getAttrib(const int_attrib::CamAttrib attrib)
             return (int)value;
             break;
 
+        // get the current gain from the cam
+        case int_attrib::GainValue:
+            feature = DC1394_FEATURE_GAIN;
+            dc1394_feature_get_value(dc_camera, feature , &value);
+            return (int)value;
+            break;
+
+        // get the current shutter from the cam
+        case int_attrib::ShutterValue:
+            feature = DC1394_FEATURE_SHUTTER;
+            dc1394_feature_get_value(dc_camera, feature , &value);
+            return (int)value;
+            break;
+
         // attribute unknown or not supported (yet)
         default:
             throw std::runtime_error("Unknown attribute!");
     }
 }
 
+bool CamFireWire::getAttribRange(const int_attrib::CamAttrib attrib, uint32_t &min, uint32_t &max, uint32_t &value)
+{
+    HandleLock lock(handle_mutex);
+    if (!dc_camera)
+	return false;
+
+    dc1394feature_t feature;
+    switch (attrib)
+    {
+    case int_attrib::ExposureValue: feature = DC1394_FEATURE_EXPOSURE; break;
+    case int_attrib::GainValue: feature = DC1394_FEATURE_GAIN; break;
+    case int_attrib::ShutterValue: feature = DC1394_FEATURE_SHUTTER; break;
+    case int_attrib::WhitebalValueRed:
+    case int_attrib::WhitebalValueBlue: feature = DC1394_FEATURE_WHITE_BALANCE; break;
+    default:
+        return false;
+    }
+
+    if (dc1394_feature_get_boundaries(dc_camera, feature, &min, &max) != DC1394_SUCCESS)
+        return false;
+    if (feature != DC1394_FEATURE_WHITE_BALANCE)
+        return dc1394_feature_get_value(dc_camera, feature, &value) == DC1394_SUCCESS;
+
+    uint32_t ub, vr;
+    if (dc1394_feature_whitebalance_get_value(dc_camera, &ub, &vr) != DC1394_SUCCESS)
+        return false;
+    value = attrib == int_attrib::WhitebalValueRed ? vr : ub;
+    return true;
+}
+
 // get double attributes
 double CamFireWire::getAttrib(const double_attrib::CamAttrib attrib)
 {
+    HandleLock lock(handle_mutex);
     if (!dc_camera)
     return false;
     
@@ -1062,7 +1455,21 @@ double CamFireWire::getAttrib(const double_attrib::CamAttrib attrib)
     {
         // get current frame rate
         case double_attrib::FrameRate:
-            dc1394_video_get_framerate(dc_camera, &dc_framerate);
+        {
+            dc1394video_mode_t video_mode;
+            dc1394_video_get_mode(dc_camera, &video_mode);
+            // the achieved rate of Format7 and absolute frame rates is read back
+            if(DC1394_VIDEO_MODE_FORMAT7_MIN <= video_mode && video_mode <= DC1394_VIDEO_MODE_FORMAT7_MAX)
+                return getFormat7FrameRate(video_mode);
+            if(absolute_frame_rate)
+            {
+                float abs_rate;
+                if(checkHandleError(dc1394_feature_get_absolute_value(dc_camera, DC1394_FEATURE_FRAME_RATE, &abs_rate)))
+                    return 0;
+                return abs_rate;
+            }
+
+            dc1394_video_get_framerate(dc_camera, &dc_framerate);
             switch(dc_framerate)
             {
                 case DC1394_FRAMERATE_1_875:
@@ -1092,6 +1499,7 @@ double CamFireWire::getAttrib(const double_attrib::CamAttrib attrib)
             }
             return framerate;
             break;
+        }
             
         // attribute unknown or not supported (yet)
         default:
@@ -1136,6 +1544,7 @@ dc1394error_t CamFireWire::setTriggerSource(const dc1394trigger_source_t trigger
 // set enum attributes
 bool CamFireWire::setAttrib(const enum_attrib::CamAttrib attrib)
 {
+    HandleLock lock(handle_mutex);
     if (!dc_camera)
 	return false;
 
@@ -1389,12 +1798,14 @@ bool CamFireWire::setAttrib(const enum_attrib::CamAttrib attrib)
     if(checkHandleError(result))
 	return false;
     
+    settings_changed = true;
     return true;
 };
 
 // set double-valued attributes
 bool CamFireWire::setAttrib(const double_attrib::CamAttrib attrib, const double value)
 {
+    HandleLock lock(handle_mutex);
     if (!dc_camera)
 	return false;
     
@@ -1413,19 +1824,25 @@ bool CamFireWire::setAttrib(const double_attrib::CamAttrib attrib, const double
             if(checkHandleError(dc1394_format7_get_packet_parameters(dc_camera, video_mode, &unit_bytes, &max_bytes)))
                 return false;
 
-            //frame_size [bytes] * frame_rate [Hz] / 8000 Hz (see FAQ v2 for libdc1394)
-            unsigned int packet_size = image_size_.height*image_size_.width * value/8000;
-
-            if (unit_bytes == 0)
-                unit_bytes = max_bytes;
-
-            //round up to multiple of unit_bytes. This is needed for correct setting of packet_size.
-            packet_size = (packet_size + unit_bytes - 1) / unit_bytes * unit_bytes;
+            uint32_t frame_bytes;
+            if(!getFormat7FrameBytes(video_mode, frame_bytes))
+                return false;
 
-            if (packet_size > max_bytes)
+            //frame_size [bytes] * frame_rate [Hz] / 8000 Hz (see FAQ v2 for libdc1394),
+            //the legal packet size whose rate is closest to the requested one
+            unsigned int packet_size = BusBandwidthPlanner::nearestPacketSizeForRate(frame_bytes, value, unit_bytes, max_bytes);
+            if (packet_size == 0)
                 throw std::runtime_error("Framerate too high for this mode 7");
 
             result = dc1394_format7_set_packet_size(dc_camera, video_mode, packet_size);
+            if(checkHandleError(result))
+                return false;
+
+            // verify the rate the camera actually runs at
+            double achieved = getFormat7FrameRate(video_mode);
+            if (fabs(achieved - value) > 0.01 * value)
+                LOG_WARN_S << "requested " << value << " fps, camera runs at " << achieved
+                    << " fps (packet size " << packet_size << ")" << std::endl;
         }
         else
         {
@@ -1449,12 +1866,22 @@ bool CamFireWire::setAttrib(const double_attrib::CamAttrib attrib, const double
             else if (value == 1.875)
                 framerate = DC1394_FRAMERATE_1_875;
             else
-                throw std::runtime_error("Framerate not supported by the dc1394 protocol!");
+            {
+                // not one of the fixed rates, use the absolute frame rate feature
+                if(!setAbsoluteFrameRate(video_mode, value))
+                    throw std::runtime_error("Framerate not supported by the dc1394 protocol!");
+                break;
+            }
         
             if(!isFramerateSupported(framerate))
                 throw std::runtime_error("Framerate is not supported by the actual video mode!");
             // the actual framerate-setting
             result = dc1394_video_set_framerate(dc_camera, framerate);
+            if(!checkHandleError(result) && absolute_frame_rate)
+            {
+                result = dc1394_feature_set_absolute_control(dc_camera, DC1394_FEATURE_FRAME_RATE, DC1394_OFF);
+                absolute_frame_rate = false;
+            }
         }
         break;
     
@@ -1466,9 +1893,87 @@ bool CamFireWire::setAttrib(const double_attrib::CamAttrib attrib, const double
     if(checkHandleError(result))
         return false;
     
+    settings_changed = true;
     return true;
 };
 
+bool CamFireWire::getFormat7FrameBytes(const dc1394video_mode_t mode, uint32_t &frame_bytes)
+{
+    uint32_t width, height, bits;
+    dc1394color_coding_t coding;
+    if(checkHandleError(dc1394_format7_get_image_size(dc_camera, mode, &width, &height)))
+        return false;
+    if(checkHandleError(dc1394_format7_get_color_coding(dc_camera, mode, &coding)))
+        return false;
+    if(checkHandleError(dc1394_get_color_coding_bit_size(coding, &bits)))
+        return false;
+
+    frame_bytes = (width * height * bits + 7) / 8;
+    return true;
+}
+
+double CamFireWire::getFormat7FrameRate(const dc1394video_mode_t mode)
+{
+    // IIDC 1.31 cameras report the frame interval of the current settings
+    float interval = 0;
+    if(dc1394_format7_get_frame_interval(dc_camera, mode, &interval) == DC1394_SUCCESS && interval > 0)
+        return 1.0 / interval;
+
+    // otherwise one packet is sent per 125 us cycle
+    uint32_t packets_per_frame = 0;
+    if(checkHandleError(dc1394_format7_get_packets_per_frame(dc_camera, mode, &packets_per_frame)))
+        return 0;
+    if(packets_per_frame == 0)
+        return 0;
+    return 8000.0 / packets_per_frame;
+}
+
+bool CamFireWire::setAbsoluteFrameRate(const dc1394video_mode_t mode, const double value)
+{
+    dc1394bool_t present = DC1394_FALSE;
+    dc1394bool_t has_absolute = DC1394_FALSE;
+    if(checkHandleError(dc1394_feature_is_present(dc_camera, DC1394_FEATURE_FRAME_RATE, &present)))
+        return false;
+    if(present)
+        checkHandleError(dc1394_feature_has_absolute_control(dc_camera, DC1394_FEATURE_FRAME_RATE, &has_absolute));
+    if(!present || !has_absolute)
+        return false;
+
+    // the absolute rate can only lower the fixed rate, select the
+    // smallest fixed rate above the requested one
+    dc1394framerates_t framerates;
+    if(checkHandleError(dc1394_video_get_supported_framerates(dc_camera, mode, &framerates)))
+        return false;
+    bool found = false;
+    dc1394framerate_t base_rate = DC1394_FRAMERATE_240;
+    for(uint32_t i = 0; i < framerates.num; i++)
+    {
+        // the enum values start at 1.875 fps and double with every step
+        double rate = 1.875 * (1 << (framerates.framerates[i] - DC1394_FRAMERATE_1_875));
+        if(rate >= value && (!found || framerates.framerates[i] < base_rate))
+        {
+            base_rate = framerates.framerates[i];
+            found = true;
+        }
+    }
+    if(!found)
+        return false;
+
+    if(checkHandleError(dc1394_video_set_framerate(dc_camera, base_rate)) ||
+       checkHandleError(dc1394_feature_set_power(dc_camera, DC1394_FEATURE_FRAME_RATE, DC1394_ON)) ||
+       checkHandleError(dc1394_feature_set_mode(dc_camera, DC1394_FEATURE_FRAME_RATE, DC1394_FEATURE_MODE_MANUAL)) ||
+       checkHandleError(dc1394_feature_set_absolute_control(dc_camera, DC1394_FEATURE_FRAME_RATE, DC1394_ON)) ||
+       checkHandleError(dc1394_feature_set_absolute_value(dc_camera, DC1394_FEATURE_FRAME_RATE, value)))
+        return false;
+    absolute_frame_rate = true;
+
+    float achieved = 0;
+    if(!checkHandleError(dc1394_feature_get_absolute_value(dc_camera, DC1394_FEATURE_FRAME_RATE, &achieved)) &&
+       fabs(achieved - value) > 0.01 * value)
+        LOG_WARN_S << "requested " << value << " fps, camera runs at " << achieved << " fps" << std::endl;
+    return true;
+}
+
 bool CamFireWire::isFramerateSupported(const dc1394framerate_t framerate)
 {
     dc1394video_mode_t video_mode;
@@ -1514,8 +2019,478 @@ bool CamFireWire::isFrameAvailable()
     return false;
 }
 
+// wait up to timeout ms until a frame is in the DMA ring
+bool CamFireWire::waitForFrame(const int timeout)
+{
+    if (!dc_camera)
+	return false;
+
+    // poll() takes descriptors beyond FD_SETSIZE and waits forever for
+    // a negative timeout
+    pollfd pfd;
+    pfd.fd = dc1394_capture_get_fileno(dc_camera);
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, timeout) > 0;
+}
+
+bool CamFireWire::captureExposureBracket(const std::vector<int> &shutter_values,
+                                         std::vector<Frame> &frames,
+                                         const int timeout)
+{
+    HandleLock lock(handle_mutex);
+    if (!dc_camera)
+	return false;
+    if (act_grab_mode_ != Stop)
+        throw std::runtime_error("Stop grabbing before capturing an exposure bracket!");
+    if (!dc_camera->one_shot_capable)
+        throw std::runtime_error("Camera is not one-shot capable!");
+    if (shutter_values.empty())
+        return true;
+
+    uint32_t old_shutter = 0;
+    if (checkHandleError(dc1394_feature_get_value(dc_camera, DC1394_FEATURE_SHUTTER, &old_shutter)))
+        return false;
+    // the absolute register follows the raw one, so it tells the
+    // exposure time of each shutter value
+    dc1394bool_t has_absolute = DC1394_FALSE;
+    if (checkHandleError(dc1394_feature_has_absolute_control(dc_camera, DC1394_FEATURE_SHUTTER, &has_absolute)))
+        has_absolute = DC1394_FALSE;
+
+    // one DMA buffer per frame, the sequence never has to wait for the copy
+    int count = shutter_values.size();
+    if (checkHandleError(dc1394_capture_setup(dc_camera, count, DC1394_CAPTURE_FLAGS_DEFAULT)))
+        return false;
+    capture_stats.setRingSize(count);
+
+    // AVT sequence mode registers differ between the models, so the
+    // shutter is written before each one-shot. The previous frame has
+    // arrived at this point, so its exposure is over.
+    frames.resize(count);
+    bool success = true;
+    for (int i = 0; i < count && success; i++)
+    {
+        success = setAttrib(int_attrib::ShutterValue, shutter_values[i]) &&
+            !checkHandleError(dc1394_video_set_one_shot(dc_camera, DC1394_ON)) &&
+            waitForFrame(timeout) &&
+            retrieveFrame(frames[i], timeout);
+        if (!success)
+        {
+            LOG_ERROR_S << "exposure bracket: frame " << i << " of " << count
+                << " could not be captured" << std::endl;
+            break;
+        }
+        frames[i].setAttribute<int>("ShutterValue", shutter_values[i]);
+        float exposure;
+        if (has_absolute &&
+            !checkHandleError(dc1394_feature_get_absolute_value(dc_camera, DC1394_FEATURE_SHUTTER, &exposure)))
+            frames[i].setAttribute<double>("ExposureTime", exposure);
+        frames[i].setAttribute<int>("BracketIndex", i);
+        frames[i].setAttribute<int>("BracketSize", count);
+    }
+
+    dc1394_video_set_one_shot(dc_camera, DC1394_OFF);
+    dc1394_capture_stop(dc_camera);
+    setAttrib(int_attrib::ShutterValue, old_shutter);
+    return success;
+}
+
+dc1394video_frame_t *CamFireWire::skipToLatestFrame(dc1394video_frame_t *frame)
+{
+    // frames_behind tells how many frames are queued after this one, so
+    // there is no need to poll until the ring is empty
+    uint32_t stale_frames = frame->frames_behind;
+    for (uint32_t i = 0; i < stale_frames; i++)
+    {
+        // dequeue the next frame before giving back the current one, so
+        // there is always a valid frame to deliver
+        dc1394video_frame_t *next = NULL;
+        dc1394error_t err = dc1394_capture_dequeue(dc_camera, DC1394_CAPTURE_POLICY_POLL, &next);
+        if (err != DC1394_SUCCESS || next == NULL)
+            break;
+        capture_stats.recordDequeue(next->timestamp, next->frames_behind);
+        capture_stats.matchTrigger(next->timestamp);
+
+        if (checkCaptureError(dc1394_capture_enqueue(dc_camera, frame)))
+        {
+            // the stale frame is lost for the ring, but next is still valid
+            frame = next;
+            break;
+        }
+        frame = next;
+        last_skipped_frames++;
+    }
+    capture_stats.recordSkippedFrames(last_skipped_frames);
+    return frame;
+}
+
+void CamFireWire::setRetrievePolicy(RetrievePolicy policy)
+{
+    retrieve_policy = policy;
+}
+
+RetrievePolicy CamFireWire::getRetrievePolicy() const
+{
+    return retrieve_policy;
+}
+
+int CamFireWire::getLastSkippedFrames() const
+{
+    return last_skipped_frames;
+}
+
+void CamFireWire::setRingDepthMode(RingDepthMode mode)
+{
+    ring_depth_mode = mode;
+    ring_advisor.reset();
+    logged_ring_depth = capture_buffer_len;
+}
+
+RingDepthMode CamFireWire::getRingDepthMode() const
+{
+    return ring_depth_mode;
+}
+
+RingDepthAdvisor &CamFireWire::getRingDepthAdvisor()
+{
+    return ring_advisor;
+}
+
+bool CamFireWire::updateRingDepth(const dc1394video_frame_t *frame, uint64_t retrieve_time)
+{
+    bool resize = ring_advisor.record(frame->timestamp, frame->frames_behind, capture_buffer_len, retrieve_time);
+    uint32_t depth = ring_advisor.getRecommendedDepth();
+    if (depth == logged_ring_depth)
+        return resize;
+    logged_ring_depth = depth;
+
+    if (!realtime_mode)
+    {
+        // locked DMA memory against the latency a full ring adds
+        double period_ms = ring_advisor.getFramePeriod() / 1000;
+        LOG_INFO_S << "recommended DMA ring depth " << depth << " (now " << capture_buffer_len
+            << "): peak occupancy " << ring_advisor.getPeakOccupancy() << ", consumer lag "
+            << ring_advisor.getPeakLag() << " frames, " << depth * frame->total_bytes / 1024
+            << " kB locked, up to " << depth * period_ms << " ms latency";
+    }
+    return resize;
+}
+
+bool CamFireWire::resizeRing(uint32_t depth)
+{
+    HandleLock lock(handle_mutex);
+    if (!dc_camera)
+	return false;
+
+    if (checkCaptureError(dc1394_video_set_transmission(dc_camera, DC1394_OFF)) ||
+        checkCaptureError(dc1394_capture_stop(dc_camera)))
+        return false;
+    if (checkCaptureError(dc1394_capture_setup(dc_camera, depth, DC1394_CAPTURE_FLAGS_DEFAULT)) ||
+        checkCaptureError(dc1394_video_set_transmission(dc_camera, DC1394_ON)))
+    {
+        act_grab_mode_ = Stop;
+        return false;
+    }
+    capture_buffer_len = depth;
+    capture_stats.setRingSize(depth);
+    return true;
+}
+
+// stack which is touched when entering the real-time mode
+static const size_t PREFAULT_STACK_SIZE = 64 * 1024;
+
+static void prefaultStack()
+{
+    // memset() must not see a non-volatile buffer, it could be dropped
+    volatile char stack[PREFAULT_STACK_SIZE];
+    for (size_t i = 0; i < PREFAULT_STACK_SIZE; i++)
+        stack[i] = 0;
+}
+
+bool CamFireWire::setRealtimeMode(bool enable, const ThreadSettings &settings)
+{
+    if (!enable)
+    {
+        realtime_mode = false;
+        // other cameras or the application may still need the lock
+        if (memory_locked)
+            unlockProcessMemory();
+        memory_locked = false;
+        return true;
+    }
+
+    if (!memory_locked && !lockProcessMemory())
+        return false;
+    memory_locked = true;
+    prefaultStack();
+    applyThreadSettings(pthread_self(), settings);
+
+    // the frame used by the conversions is sized once here
+    prepareRealtimeFrame(unconverted_frame);
+    realtime_mode = true;
+    return true;
+}
+
+bool CamFireWire::isRealtimeMode() const
+{
+    return realtime_mode;
+}
+
+bool CamFireWire::hasFrameGeometry(const Frame &frame) const
+{
+    return frame.getWidth() == image_size_.width && frame.getHeight() == image_size_.height &&
+        frame.getDataDepth() == (uint32_t)data_depth && frame.getFrameMode() == frame_mode;
+}
+
+bool CamFireWire::prepareRealtimeFrame(Frame &frame)
+{
+    if (image_size_.width == 0 || image_size_.height == 0 || data_depth == 0)
+        return false;
+
+    // init() writes the whole buffer, which faults in all its pages
+    frame.init(image_size_.width, image_size_.height, data_depth, frame_mode);
+    frame.setHDR(hdr_enabled);
+    return mlock(frame.getImagePtr(), frame.getNumberOfBytes()) == 0;
+}
+
+void CamFireWire::setTimestampCorrection(bool enable)
+{
+    timestamp_correction = enable;
+}
+
+TimestampJitter CamFireWire::getTimestampJitter() const
+{
+    return cycle_time_sync.getJitter();
+}
+
+void CamFireWire::sampleCycleTimer()
+{
+    HandleLock lock(handle_mutex);
+    // one register read per second keeps the per-frame cost bounded and
+    // is frequent enough to unwrap the 128 s cycle timer period
+    const uint64_t sample_interval = 1000000;
+    uint64_t now = CaptureStatistics::now();
+    if (last_cycle_sample_time != 0 && now - last_cycle_sample_time < sample_interval)
+        return;
+    last_cycle_sample_time = now;
+
+    uint32_t cycle_timer;
+    uint64_t local_time;
+    if (checkCaptureError(dc1394_read_cycle_timer(dc_camera, &cycle_timer, &local_time)))
+        return;
+    cycle_time_sync.addSample(cycle_timer, local_time);
+}
+
+bool CamFireWire::setEmbeddedFrameInfo(bool enable, const EmbeddedInfoLayout &layout)
+{
+    if (!dc_camera)
+	return false;
+
+    if (enable && layout.enable_register != 0)
+    {
+        dc1394error_t err;
+        if (layout.advanced_register)
+            err = dc1394_set_adv_control_register(dc_camera, layout.enable_register, layout.enable_value);
+        else
+            err = dc1394_set_control_register(dc_camera, layout.enable_register, layout.enable_value);
+        if (checkHandleError(err))
+            return false;
+    }
+
+    embedded_info = enable;
+    embedded_info_layout = layout;
+    frame_counter_valid = false;
+    capture_stats.setExactDropCounting(enable && layout.counter_quadlet >= 0);
+    return true;
+}
+
+void CamFireWire::parseEmbeddedFrameInfo(const dc1394video_frame_t *frame)
+{
+    const EmbeddedInfoLayout &layout = embedded_info_layout;
+    int quadlets = frame->image_bytes / 4;
+
+    if (layout.counter_quadlet >= 0 && layout.counter_quadlet < quadlets)
+    {
+        uint32_t counter = readQuadlet(frame, layout.counter_quadlet);
+
+        // unsigned arithmetic handles the wrap around of the counter,
+        // frames skipped by RetrieveLatest were received and are no loss
+        if (frame_counter_valid)
+        {
+            uint32_t gap = counter - last_frame_counter - 1 - last_skipped_frames;
+            if (gap > 0 && gap < 0x80000000UL)
+                capture_stats.recordDroppedFrames(gap);
+        }
+        last_frame_counter = counter;
+        frame_counter_valid = true;
+    }
+
+    if (layout.timestamp_quadlet >= 0 && layout.timestamp_quadlet < quadlets)
+        last_cycle_time = readQuadlet(frame, layout.timestamp_quadlet);
+}
+
+void CamFireWire::attachEmbeddedFrameInfo(const dc1394video_frame_t *frame, Frame &out)
+{
+    const EmbeddedInfoLayout &layout = embedded_info_layout;
+    int quadlets = frame->image_bytes / 4;
+    if (layout.counter_quadlet >= 0 && layout.counter_quadlet < quadlets)
+        out.setAttribute<uint32_t>("FrameCounter", last_frame_counter);
+    if (layout.timestamp_quadlet >= 0 && layout.timestamp_quadlet < quadlets)
+        out.setAttribute<uint32_t>("CycleTime", last_cycle_time);
+}
+
+uint32_t CamFireWire::getLastFrameCounter() const
+{
+    return last_frame_counter;
+}
+
+uint32_t CamFireWire::getLastCycleTime() const
+{
+    return last_cycle_time;
+}
+
+bool CamFireWire::setRegionOfInterest(const RegionOfInterest &roi)
+{
+    HandleLock lock(handle_mutex);
+    if (!dc_camera)
+	return false;
+
+    dc1394video_mode_t video_mode;
+    if(checkHandleError(dc1394_video_get_mode(dc_camera, &video_mode)))
+        return false;
+    if(video_mode < DC1394_VIDEO_MODE_FORMAT7_MIN || video_mode > DC1394_VIDEO_MODE_FORMAT7_MAX)
+        throw std::runtime_error("A region of interest requires a Format7 mode!");
+    if(act_grab_mode_ == MultiFrame)
+        throw std::runtime_error("Stop grabbing before changing the region of interest in multi-shot mode!");
+
+    uint32_t max_width, max_height, unit_width, unit_height, unit_x, unit_y;
+    if(checkHandleError(dc1394_format7_get_max_image_size(dc_camera, video_mode, &max_width, &max_height)) ||
+       checkHandleError(dc1394_format7_get_unit_size(dc_camera, video_mode, &unit_width, &unit_height)) ||
+       checkHandleError(dc1394_format7_get_unit_position(dc_camera, video_mode, &unit_x, &unit_y)))
+        return false;
+    if(unit_x == 0) unit_x = unit_width;
+    if(unit_y == 0) unit_y = unit_height;
+
+    if(roi.width == 0 || roi.height == 0 ||
+       roi.x + roi.width > max_width || roi.y + roi.height > max_height ||
+       roi.width % unit_width || roi.height % unit_height ||
+       roi.x % unit_x || roi.y % unit_y)
+        throw std::runtime_error("Region of interest is not supported!");
+
+    uint32_t width, height;
+    if(checkHandleError(dc1394_format7_get_image_size(dc_camera, video_mode, &width, &height)))
+        return false;
+
+    // moving the window does not change the packet layout
+    if(width == roi.width && height == roi.height)
+    {
+        if(checkHandleError(dc1394_format7_set_image_position(dc_camera, video_mode, roi.x, roi.y)))
+            return false;
+        // a snapshot which is not taken yet reads the position itself
+        if(settings_valid)
+        {
+            settings.roi.x = roi.x;
+            settings.roi.y = roi.y;
+        }
+        else
+            settings_changed = true;
+        return true;
+    }
+
+    uint32_t packet_size;
+    if(checkHandleError(dc1394_format7_get_packet_size(dc_camera, video_mode, &packet_size)))
+        return false;
+
+    bool capturing = act_grab_mode_ == Continuously;
+    if(capturing)
+    {
+        if(checkHandleError(dc1394_video_set_transmission(dc_camera, DC1394_OFF)) ||
+           checkHandleError(dc1394_capture_stop(dc_camera)))
+            return false;
+    }
+
+    // move the window to the origin first, so every new size fits
+    if(checkHandleError(dc1394_format7_set_image_position(dc_camera, video_mode, 0, 0)) ||
+       checkHandleError(dc1394_format7_set_image_size(dc_camera, video_mode, roi.width, roi.height)) ||
+       checkHandleError(dc1394_format7_set_image_position(dc_camera, video_mode, roi.x, roi.y)))
+        return false;
+
+    // keep the bandwidth, the packet limits depend on the window size
+    uint32_t unit_bytes, max_bytes;
+    if(checkHandleError(dc1394_format7_get_packet_parameters(dc_camera, video_mode, &unit_bytes, &max_bytes)))
+        return false;
+    if(unit_bytes == 0)
+        unit_bytes = max_bytes;
+    if(packet_size > max_bytes)
+        packet_size = max_bytes;
+    packet_size = packet_size / unit_bytes * unit_bytes;
+    if(packet_size < unit_bytes)
+        packet_size = unit_bytes;
+    if(checkHandleError(dc1394_format7_set_packet_size(dc_camera, video_mode, packet_size)))
+        return false;
+
+    image_size_ = frame_size_t(roi.width, roi.height);
+
+    if(capturing)
+    {
+        if(checkHandleError(dc1394_capture_setup(dc_camera, capture_buffer_len, DC1394_CAPTURE_FLAGS_DEFAULT)) ||
+           checkHandleError(dc1394_video_set_transmission(dc_camera, DC1394_ON)))
+        {
+            act_grab_mode_ = Stop;
+            return false;
+        }
+        capture_stats.setRingSize(capture_buffer_len);
+    }
+    settings_changed = true;
+
+    LOG_INFO_S << "region of interest " << roi.width << "x" << roi.height << "+" << roi.x << "+" << roi.y
+        << ", " << getFormat7FrameRate(video_mode) << " fps (max " << getMaxFrameRate() << " fps)" << std::endl;
+    return true;
+}
+
+RegionOfInterest CamFireWire::getRegionOfInterest()
+{
+    RegionOfInterest roi;
+    if (!dc_camera)
+	return roi;
+
+    dc1394video_mode_t video_mode;
+    if(checkHandleError(dc1394_video_get_mode(dc_camera, &video_mode)))
+        return roi;
+    if(video_mode < DC1394_VIDEO_MODE_FORMAT7_MIN || video_mode > DC1394_VIDEO_MODE_FORMAT7_MAX)
+    {
+        roi.width = image_size_.width;
+        roi.height = image_size_.height;
+        return roi;
+    }
+    dc1394_format7_get_image_position(dc_camera, video_mode, &roi.x, &roi.y);
+    dc1394_format7_get_image_size(dc_camera, video_mode, &roi.width, &roi.height);
+    return roi;
+}
+
+double CamFireWire::getMaxFrameRate()
+{
+    if (!dc_camera)
+	return 0;
+
+    dc1394video_mode_t video_mode;
+    if(checkHandleError(dc1394_video_get_mode(dc_camera, &video_mode)))
+        return 0;
+    if(video_mode < DC1394_VIDEO_MODE_FORMAT7_MIN || video_mode > DC1394_VIDEO_MODE_FORMAT7_MAX)
+        return getAttrib(double_attrib::FrameRate);
+
+    uint32_t frame_bytes, unit_bytes, max_bytes;
+    if(!getFormat7FrameBytes(video_mode, frame_bytes) ||
+       checkHandleError(dc1394_format7_get_packet_parameters(dc_camera, video_mode, &unit_bytes, &max_bytes)))
+        return 0;
+    if(unit_bytes == 0)
+        unit_bytes = max_bytes;
+    return BusBandwidthPlanner::frameRateForPacketSize(frame_bytes, max_bytes / unit_bytes * unit_bytes);
+}
+
 bool CamFireWire::clearBuffer()
 {
+    HandleLock lock(handle_mutex);
     if (!dc_camera)
 	return false;
 
@@ -1549,4 +2524,225 @@ int CamFireWire::getFileDescriptor() const
     return dc1394_capture_get_fileno(dc_camera);
 }
 
+CaptureStats CamFireWire::getCaptureStats() const
+{
+    return capture_stats.getStats();
+}
+
+void CamFireWire::resetCaptureStats()
+{
+    capture_stats.reset();
+}
+
+void CamFireWire::updateSettingsSnapshot(const int_attrib::CamAttrib attrib, const int value)
+{
+    if (!settings_valid)
+        return;
+
+    // keep the snapshot up to date without reading all features again,
+    // controllers change shutter and gain every few frames
+    dc1394feature_t feature;
+    switch (attrib)
+    {
+    case int_attrib::ExposureValue: feature = DC1394_FEATURE_EXPOSURE; break;
+    case int_attrib::GainValue: feature = DC1394_FEATURE_GAIN; break;
+    case int_attrib::SaturationValue: feature = DC1394_FEATURE_SATURATION; break;
+    case int_attrib::SharpnessValue: feature = DC1394_FEATURE_SHARPNESS; break;
+    case int_attrib::ShutterValue: feature = DC1394_FEATURE_SHUTTER; break;
+    case int_attrib::WhitebalValueRed:
+        settings.features.feature[DC1394_FEATURE_WHITE_BALANCE - DC1394_FEATURE_MIN].RV_value = value;
+        return;
+    case int_attrib::WhitebalValueBlue:
+        settings.features.feature[DC1394_FEATURE_WHITE_BALANCE - DC1394_FEATURE_MIN].BU_value = value;
+        return;
+    case int_attrib::HDRValue:
+        last_hdr_value = value;
+        return;
+    case int_attrib::IsoSpeed:
+        settings_changed = true;
+        return;
+    default:
+        return;
+    }
+    settings.features.feature[feature - DC1394_FEATURE_MIN].value = value;
+}
+
+bool CamFireWire::snapshotSettings()
+{
+    if (!dc_camera)
+	return false;
+
+    settings_valid = false;
+    SettingsSnapshot &s = settings;
+    if (checkHandleError(dc1394_video_get_mode(dc_camera, &s.mode)) ||
+        checkHandleError(dc1394_video_get_iso_speed(dc_camera, &s.iso_speed)) ||
+        checkHandleError(dc1394_video_get_operation_mode(dc_camera, &s.operation_mode)) ||
+        checkHandleError(dc1394_feature_get_all(dc_camera, &s.features)))
+        return false;
+
+    if (s.mode >= DC1394_VIDEO_MODE_FORMAT7_MIN && s.mode <= DC1394_VIDEO_MODE_FORMAT7_MAX)
+    {
+        if (checkHandleError(dc1394_format7_get_image_position(dc_camera, s.mode, &s.roi.x, &s.roi.y)) ||
+            checkHandleError(dc1394_format7_get_image_size(dc_camera, s.mode, &s.roi.width, &s.roi.height)) ||
+            checkHandleError(dc1394_format7_get_color_coding(dc_camera, s.mode, &s.coding)) ||
+            checkHandleError(dc1394_format7_get_packet_size(dc_camera, s.mode, &s.packet_size)))
+            return false;
+    }
+    else if (checkHandleError(dc1394_video_get_framerate(dc_camera, &s.framerate)))
+        return false;
+
+    s.trigger_power = DC1394_OFF;
+    s.software_trigger_power = DC1394_OFF;
+    dc1394_external_trigger_get_power(dc_camera, &s.trigger_power);
+
+    uint32_t node;
+    if (checkHandleError(dc1394_camera_get_node(dc_camera, &node, &bus_generation)))
+        return false;
+    settings_valid = true;
+    settings_changed = false;
+    return true;
+}
+
+void CamFireWire::restoreFeature(const dc1394feature_info_t &feature)
+{
+    if (!feature.available || feature.id == DC1394_FEATURE_TEMPERATURE)
+        return;
+
+    if (feature.id == DC1394_FEATURE_TRIGGER)
+    {
+        dc1394_external_trigger_set_mode(dc_camera, feature.trigger_mode);
+        dc1394_external_trigger_set_source(dc_camera, feature.trigger_source);
+        if (feature.polarity_capable)
+            dc1394_external_trigger_set_polarity(dc_camera, feature.trigger_polarity);
+        dc1394_external_trigger_set_power(dc_camera, settings.trigger_power);
+        return;
+    }
+
+    if (feature.on_off_capable)
+        dc1394_feature_set_power(dc_camera, feature.id, feature.is_on);
+
+    // a pending one-push is restored as the value it was started from
+    dc1394feature_mode_t mode = feature.current_mode;
+    if (mode == DC1394_FEATURE_MODE_ONE_PUSH_AUTO)
+        mode = DC1394_FEATURE_MODE_MANUAL;
+    dc1394_feature_set_mode(dc_camera, feature.id, mode);
+    if (mode != DC1394_FEATURE_MODE_MANUAL)
+        return;
+
+    if (feature.absolute_capable && feature.abs_control == DC1394_ON)
+    {
+        dc1394_feature_set_absolute_control(dc_camera, feature.id, DC1394_ON);
+        dc1394_feature_set_absolute_value(dc_camera, feature.id, feature.abs_value);
+    }
+    else if (feature.id == DC1394_FEATURE_WHITE_BALANCE)
+        dc1394_feature_whitebalance_set_value(dc_camera, feature.BU_value, feature.RV_value);
+    else
+        dc1394_feature_set_value(dc_camera, feature.id, feature.value);
+}
+
+bool CamFireWire::restoreSettings()
+{
+    if (!dc_camera || !settings_valid)
+	return false;
+
+    const SettingsSnapshot &s = settings;
+    if (checkHandleError(dc1394_video_set_operation_mode(dc_camera, s.operation_mode)) ||
+        checkHandleError(dc1394_video_set_iso_speed(dc_camera, s.iso_speed)) ||
+        checkHandleError(dc1394_video_set_mode(dc_camera, s.mode)))
+        return false;
+
+    if (s.mode >= DC1394_VIDEO_MODE_FORMAT7_MIN && s.mode <= DC1394_VIDEO_MODE_FORMAT7_MAX)
+    {
+        // the position is cleared first so every size is accepted
+        if (checkHandleError(dc1394_format7_set_color_coding(dc_camera, s.mode, s.coding)) ||
+            checkHandleError(dc1394_format7_set_image_position(dc_camera, s.mode, 0, 0)) ||
+            checkHandleError(dc1394_format7_set_image_size(dc_camera, s.mode, s.roi.width, s.roi.height)) ||
+            checkHandleError(dc1394_format7_set_image_position(dc_camera, s.mode, s.roi.x, s.roi.y)) ||
+            checkHandleError(dc1394_format7_set_packet_size(dc_camera, s.mode, s.packet_size)))
+            return false;
+    }
+    else if (checkHandleError(dc1394_video_set_framerate(dc_camera, s.framerate)))
+        return false;
+
+    for (int i = 0; i < DC1394_FEATURE_NUM; i++)
+        restoreFeature(s.features.feature[i]);
+
+    if (hdr_enabled)
+        setAttrib(int_attrib::HDRValue, last_hdr_value);
+    if (embedded_info)
+        setEmbeddedFrameInfo(true, embedded_info_layout);
+    return true;
+}
+
+bool CamFireWire::hasBusReset()
+{
+    if (!dc_camera || !settings_valid)
+	return false;
+
+    uint32_t node, generation;
+    if (checkHandleError(dc1394_camera_get_node(dc_camera, &node, &generation)))
+        return true;
+    return generation != bus_generation;
+}
+
+bool CamFireWire::restartCapture()
+{
+    HandleLock lock(handle_mutex);
+    if (!dc_camera)
+	return false;
+
+    // a failed attempt leaves the capture stopped, the mode of the last
+    // grab() is resumed by the next one
+    GrabMode mode = resume_grab_mode;
+    dc1394_video_set_transmission(dc_camera, DC1394_OFF);
+    dc1394_capture_stop(dc_camera);
+    act_grab_mode_ = Stop;
+
+    if (!restoreSettings())
+        return false;
+    if (mode == Stop)
+        return true;
+
+    // grab() must not wait for a one-push here, the snapshot restores
+    // the white balance values directly
+    bool defer = defer_one_push_wait;
+    defer_one_push_wait = true;
+    bool success = grab(mode, capture_buffer_len);
+    defer_one_push_wait = defer;
+
+    // grab() keeps the unchanged snapshot, only the generation is new
+    uint32_t node;
+    if (success && checkHandleError(dc1394_camera_get_node(dc_camera, &node, &bus_generation)))
+        return false;
+    return success;
+}
+
+bool CamFireWire::reopen()
+{
+    HandleLock lock(handle_mutex);
+    if (!dc_device || camera_guid == 0)
+	return false;
+
+    // the handle of an unplugged camera is gone after the first attempt,
+    // later attempts only look for the camera again
+    if (dc_camera)
+    {
+        dc1394_capture_stop(dc_camera);
+        dc1394_iso_release_all(dc_camera);
+        dc1394_camera_free(dc_camera);
+        dc_camera = NULL;
+    }
+    act_grab_mode_ = Stop;
+
+    // the camera keeps its guid across bus resets and re-plugging
+    dc_camera = dc1394_camera_new(dc_device, camera_guid);
+    if (!dc_camera)
+        return false;
+    dc1394_camera_set_broadcast(dc_camera, DC1394_FALSE);
+    if (checkHandleError(dc1394_video_get_supported_modes(dc_camera, &supported_modes)))
+        supported_modes.num = 0;
+
+    return restartCapture();
+}
+
 } // end namespace camera
@@ -12,9 +12,16 @@
 #include "base/samples/Frame.hpp"
 #include "./filter/frame2rggb.h"
 #include "./cam_fw_types.h"
+#include "./CaptureStatistics.h"
+#include "./CycleTimeSync.h"
+#include "./CameraRegistry.h"
+#include "./ThreadUtils.h"
+#include "./RingDepthAdvisor.h"
 #include <dc1394/types.h>
 #include <dc1394/log.h>
 #include <dc1394/video.h>
+#include <dc1394/control.h>
+#include <pthread.h>
 
 struct __dc1394_camera;
 typedef __dc1394_camera dc1394camera_t;
@@ -25,6 +32,10 @@ namespace camera
 {
 class CamFireWire : public CamInterface
 {
+    friend class RecoverySupervisor;
+    friend class ShmFrameWriter;
+    friend class BusBandwidthPlanner;
+
 public:
     CamFireWire();
     virtual ~CamFireWire();
@@ -36,6 +47,19 @@ public:
     //grab() may change the filedescriptor, and mode==Stop closes it
     bool grab(const GrabMode mode, const int buffer_len);
     bool retrieveFrame(base::samples::frame::Frame &frame,const int timeout);
+
+    /** Retrieves the image of the next frame into a buffer of the caller
+     * (e.g. shared memory), which saves the copy into a Frame
+     *
+     * The geometry is the one of retrieveFrame(). Embedded frame
+     * information is parsed for the statistics and getLastFrameCounter(),
+     * but there is no frame to attach it to; whether the frame is HDR
+     * is up to the caller (see ShmSlotHeader::flags).
+     * @param timeout ms to wait for a frame, 0 polls, negative waits forever
+     * @return false if no frame was available or it does not fit
+     */
+    bool retrieveFrameData(uint8_t *buffer, uint32_t buffer_size, uint32_t &image_bytes,
+                           base::Time &time, const int timeout);
     bool setFrameSettings(const base::samples::frame::frame_size_t size,
                           const base::samples::frame::frame_mode_t mode,
                           const  uint8_t color_depth,
@@ -47,6 +71,15 @@ public:
     bool isAttribAvail(const enum_attrib::CamAttrib attrib);
     int getAttrib(const int_attrib::CamAttrib attrib);
     double getAttrib(const double_attrib::CamAttrib attrib);
+
+    /** Reads the limits and the current value of a feature in one locked
+     * call, for controllers which must not touch the handle themselves
+     *
+     * Supports ExposureValue, GainValue, ShutterValue, WhitebalValueRed
+     * and WhitebalValueBlue (both white balance values share the limits).
+     * @return false if the camera is not open or the feature is missing
+     */
+    bool getAttribRange(const int_attrib::CamAttrib attrib, uint32_t &min, uint32_t &max, uint32_t &value);
     bool setAttrib(const int_attrib::CamAttrib attrib,const int value);
     bool setAttrib(const enum_attrib::CamAttrib attrib);
     bool setAttrib(const double_attrib::CamAttrib attrib, const double value);
@@ -55,6 +88,17 @@ public:
     bool cleanup();
     bool setDevice(dc1394_t *dev);
 
+    /** Uses a libdc1394 context and camera registry of the caller, which
+     * several cameras can share. Neither is freed by the camera, both
+     * have to outlive it.
+     */
+    bool setDevice(dc1394_t *dev, CameraRegistry *registry);
+
+    /** Registry of the cameras on the bus of the device, which delivers
+     * hot-plug events and which listCameras() reads from
+     */
+    CameraRegistry *getCameraRegistry();
+
     /** Returns the file descriptor that can be used to wait for frames using
      * select()
      *
@@ -62,6 +106,169 @@ public:
      * and only until grab() is called again(for whatever mode)
      */
     int getFileDescriptor() const;
+
+    /** Returns a snapshot of the capture statistics (frames, drops,
+     * latencies, ring occupancy)
+     *
+     * It can be called from any thread while capturing.
+     */
+    CaptureStats getCaptureStats() const;
+    void resetCaptureStats();
+
+    /** Selects whether retrieveFrame() delivers the oldest queued frame
+     * (default) or skips all stale frames and delivers the newest one
+     */
+    void setRetrievePolicy(RetrievePolicy policy);
+    RetrievePolicy getRetrievePolicy() const;
+
+    /** Returns the number of stale frames which were skipped by the last
+     * call of retrieveFrame() (always 0 for RetrieveOldest)
+     */
+    int getLastSkippedFrames() const;
+
+    /** Selects whether the DMA ring depth passed to grab() is adapted to
+     * the lag of the consumer
+     *
+     * RingDepthRecommend logs changes of the recommended depth,
+     * RingDepthAdaptive also sets up the ring again with the new depth
+     * when retrieveFrame() has emptied it, which takes a few milliseconds
+     * without transmission. The real-time mode defers this until it is
+     * left, as the new ring would fault and stall the capture thread.
+     * See RingDepthAdvisor for the parameters.
+     */
+    void setRingDepthMode(RingDepthMode mode);
+    RingDepthMode getRingDepthMode() const;
+    RingDepthAdvisor &getRingDepthAdvisor();
+
+    /** Enables the real-time mode for the calling (capture) thread
+     *
+     * Locks all current and future pages of the process (mlockall), so
+     * the DMA ring and the frame buffers never fault, pre-faults the
+     * stack of the thread and applies the given pinning and SCHED_FIFO
+     * priority to it. In real-time mode retrieveFrame() reuses frames
+     * which already have the right geometry instead of initializing them
+     * again, does not log and does not throw, so it neither allocates nor
+     * blocks besides the frame wait. It does not attach the embedded frame
+     * information as attributes either, see getLastFrameCounter(). Output
+     * frames should be sized with prepareRealtimeFrame() before capturing.
+     * The memory lock is shared with the other users of
+     * lockProcessMemory() and released when the mode is disabled.
+     * @return false if the memory could not be locked (RLIMIT_MEMLOCK)
+     */
+    bool setRealtimeMode(bool enable, const ThreadSettings &settings = ThreadSettings());
+    bool isRealtimeMode() const;
+
+    /** Initializes the frame with the current geometry, touches and
+     * locks its buffer, so the first retrieveFrame() into it does not
+     * fault
+     */
+    bool prepareRealtimeFrame(base::samples::frame::Frame &frame);
+
+    /** Enables the correction of frame timestamps
+     *
+     * With an embedded cycle time stamp (setEmbeddedFrameInfo()) frames
+     * are stamped with it, converted to host time by periodically sampling
+     * the bus cycle timer. libdc1394 does not report the bus cycle of
+     * other frames, their receive timestamps are filtered against the
+     * frame period and moved back by the transfer time instead.
+     */
+    void setTimestampCorrection(bool enable);
+    TimestampJitter getTimestampJitter() const;
+
+    /** Enables the frame information which the camera embeds into the
+     * first quadlets of the image
+     *
+     * retrieveFrame() then attaches the frame counter ("FrameCounter")
+     * and the cycle time stamp ("CycleTime") to the frame as attributes
+     * and counts lost frames exactly from the counter. If timestamp
+     * correction is enabled as well, the frame time is taken from the
+     * embedded cycle time stamp. The embedded quadlets replace pixels.
+     */
+    bool setEmbeddedFrameInfo(bool enable, const EmbeddedInfoLayout &layout = EmbeddedInfoLayout());
+
+    /** Embedded frame counter and cycle time stamp of the last frame,
+     * which the real-time mode does not attach to the frame
+     */
+    uint32_t getLastFrameCounter() const;
+    uint32_t getLastCycleTime() const;
+
+    /** Moves and resizes the Format7 image window, also while capturing
+     *
+     * A pure move is done without interrupting the capture. A new size
+     * keeps the packet size, so a smaller window raises the frame rate.
+     * As dc1394 fixes the packet layout of the DMA ring at capture setup,
+     * transmission and capture are restarted in this case.
+     */
+    bool setRegionOfInterest(const RegionOfInterest &roi);
+    RegionOfInterest getRegionOfInterest();
+
+    /** Returns the highest frame rate which is possible with the current
+     * Format7 window and color coding
+     */
+    double getMaxFrameRate();
+
+    /** Lists the Format7 modes of the camera with their maximum size and
+     * their binning/subsampling factors relative to Format7_0
+     *
+     * @return the number of modes found
+     */
+    int listFormat7Modes(std::vector<Format7ModeInfo> &modes);
+
+    /** Selects binning/subsampling for the following setFrameSettings()
+     * calls
+     *
+     * Bayer and grayscale frames then use the Format7 mode which reduces
+     * the sensor by the given factors, and the frame size is checked
+     * against the maximum size of that mode. 1x1 restores the normal
+     * mode selection.
+     */
+    void setSensorReduction(uint32_t horizontal_factor, uint32_t vertical_factor);
+
+    /** Fires one software trigger if the camera has processed the last one
+     *
+     * The trigger source must be set to software (FrameStartTriggerModeToSoftware).
+     * The time between trigger and frame reception is recorded in the
+     * capture statistics. It may be called from another thread than
+     * retrieveFrame(), see SoftwareTrigger for a scheduler.
+     * @return false if the camera was not ready or the trigger failed
+     */
+    bool softwareTrigger();
+    bool isReadyForSoftwareTrigger();
+
+    /** Skips the wait for the one-push white balance in grab()
+     *
+     * With several cameras, grab() is called for all of them first and
+     * waitForOnePush() then waits for all cameras at once.
+     */
+    void setDeferOnePushWait(bool defer);
+
+    /** Waits until the one-push white balance of all cameras is done and
+     * turns their transmission on again
+     *
+     * The cameras are polled in turn with growing intervals. The time
+     * since grab() is recorded as startup time in the capture statistics.
+     * @param timeout maximum wait in ms, transmission is turned on anyway
+     * @return number of cameras which finished within the timeout
+     */
+    static int waitForOnePush(const std::vector<CamFireWire *> &cameras, const int timeout);
+
+    /** True while the camera performs a one-push white balance */
+    bool isOnePushPending();
+
+    /** Captures one frame per shutter value (exposure bracketing)
+     *
+     * The frames are taken by one-shot commands with the shutter register
+     * updated between them, and are copied straight from the DMA buffers
+     * into frames, which keeps their buffers when called again with the
+     * same settings. Each frame carries the attributes "ShutterValue",
+     * "BracketIndex" and "BracketSize", and "ExposureTime" (double, in s)
+     * if the shutter has an absolute control. Grabbing must be stopped and
+     * the shutter in manual mode; the previous shutter value is restored.
+     * @param timeout time to wait for each frame in ms
+     */
+    bool captureExposureBracket(const std::vector<int> &shutter_values,
+                                std::vector<base::samples::frame::Frame> &frames,
+                                const int timeout);
     
 public:
     dc1394camera_t *dc_camera;
@@ -70,6 +277,39 @@ private:
     bool isVideoModeSupported(const dc1394video_mode_t mode);
     bool isFramerateSupported(const dc1394framerate_t framerate);
     bool isVideo7RAWModeSupported(int depth);
+    bool isFormat7CodingSupported(const dc1394video_mode_t mode, const dc1394color_coding_t coding);
+
+    /**
+     * Configures the Format7 mode matching the sensor reduction for the
+     * given size and the current frame_mode/data_depth.
+     * @return the configured mode
+     * */
+    dc1394video_mode_t setupReducedFormat7Mode(const base::samples::frame::frame_size_t size);
+
+    /**
+     * Best fitting fixed video mode among the supported ones.
+     * Throws if the camera has no mode for the frame mode and data_depth.
+     * */
+    dc1394video_mode_t selectFixedVideoMode(const base::samples::frame::frame_size_t size,
+                                            const base::samples::frame::frame_mode_t mode);
+
+    /**
+     * Computes the size of one frame from the image size and color coding
+     * of the given Format7 mode.
+     * */
+    bool getFormat7FrameBytes(const dc1394video_mode_t mode, uint32_t &frame_bytes);
+
+    /**
+     * Reads back the frame rate of the current Format7 settings.
+     * */
+    double getFormat7FrameRate(const dc1394video_mode_t mode);
+
+    /**
+     * Sets a frame rate which is not one of the fixed dc1394 rates using
+     * the absolute value of the FRAME_RATE feature.
+     * @return false if the camera has no absolute frame rate control
+     * */
+    bool setAbsoluteFrameRate(const dc1394video_mode_t mode, const double value);
     dc1394error_t setTriggerSource(const dc1394trigger_source_t trigger_source);
     
     /**
@@ -85,14 +325,142 @@ private:
      * @return false if NO error was reported
      * */
     bool checkHandleError(dc1394error_t error) const;
+    /** checkHandleError() for the capture path, silent in real-time mode */
+    bool checkCaptureError(dc1394error_t error) const;
+    /** Feeds the advisor, returns true if the ring should be resized */
+    bool updateRingDepth(const dc1394video_frame_t *frame, uint64_t retrieve_time);
+    /** Sets up the capture ring again with the given depth */
+    bool resizeRing(uint32_t depth);
+    /** True if retrieveFrame() can reuse the frame without init() */
+    bool hasFrameGeometry(const base::samples::frame::Frame &frame) const;
+
+    /** Waits up to timeout ms (forever if negative) until a frame is in
+     * the DMA ring
+     */
+    bool waitForFrame(const int timeout);
+
+    /** Reads mode, Format7 window, packet size, iso speed, features and
+     * trigger settings from the camera, which restoreSettings() writes
+     * back after a recovery. grab() only reads them again after the
+     * configuration changed.
+     */
+    bool snapshotSettings();
+    bool restoreSettings();
+    void restoreFeature(const dc1394feature_info_t &feature);
+    void updateSettingsSnapshot(const int_attrib::CamAttrib attrib, const int value);
+    /** True if the bus was reset since the last snapshot */
+    bool hasBusReset();
+    /** Restarts capturing on the current camera handle */
+    bool restartCapture();
+    /** Frees the camera, opens it again by its guid and restarts
+     * capturing. Also works after a failed attempt left no handle.
+     */
+    bool reopen();
+    /**
+     * Uses frames_behind to hand all stale frames in the ring back to
+     * dc1394 in one pass, without copying them.
+     * @return the newest frame, which still has to be enqueued
+     * */
+    dc1394video_frame_t *skipToLatestFrame(dc1394video_frame_t *frame);
+    /** Dequeues the next frame and records it in the statistics, NULL if
+     * no frame is available
+     */
+    dc1394video_frame_t *dequeueFrame(uint64_t &dequeue_time, bool &resize_ring);
+    /** Copies the dequeued frame into the output frame with its time and
+     * embedded information, marks it invalid if src is NULL
+     */
+    void fillFrame(const dc1394video_frame_t *src, base::samples::frame::Frame &frame);
+    /** Capture time of the frame, corrected if enabled */
+    base::Time getFrameTime(const dc1394video_frame_t *frame);
+    /** Gives the frame back to the ring, resizes the ring if advised */
+    void requeueFrame(dc1394video_frame_t *frame, uint64_t dequeue_time, bool resize_ring);
+
+    /**
+     * Adds a cycle timer sample to cycle_time_sync if the last one is
+     * older than one second. Only needed for embedded cycle times.
+     * */
+    void sampleCycleTimer();
+
+    /**
+     * Reads the embedded frame information from the image of frame and
+     * feeds lost frames into the statistics.
+     * */
+    void parseEmbeddedFrameInfo(const dc1394video_frame_t *frame);
+    /** Attaches the embedded information of the last frame to out */
+    void attachEmbeddedFrameInfo(const dc1394video_frame_t *frame,
+                                 base::samples::frame::Frame &out);
     
     dc1394_t *dc_device;
+    // cached camera list of dc_device, created by setDevice()
+    CameraRegistry *camera_registry;
+    // dc_device and camera_registry were passed by setDevice(dev, registry)
+    bool shared_device;
     base::samples::frame::Frame unconverted_frame;
     base::samples::frame::frame_mode_t frame_mode;
     int data_depth;
     bool hdr_enabled;
     int frame_size_in_byte_;
     int multi_shot_count;
+    CaptureStatistics capture_stats;
+    RetrievePolicy retrieve_policy;
+    int last_skipped_frames;
+    CycleTimeSync cycle_time_sync;
+    bool timestamp_correction;
+    uint64_t last_cycle_sample_time;
+    bool embedded_info;
+    EmbeddedInfoLayout embedded_info_layout;
+    bool frame_counter_valid;
+    uint32_t last_frame_counter;
+    uint32_t last_cycle_time;
+    bool absolute_frame_rate;
+    int capture_buffer_len;
+    uint32_t sensor_reduction_x;
+    uint32_t sensor_reduction_y;
+    // cached at open()
+    dc1394video_modes_t supported_modes;
+    bool defer_one_push_wait;
+    uint64_t grab_start_time;
+    bool realtime_mode;
+    // this camera holds a reference of lockProcessMemory()
+    bool memory_locked;
+    RingDepthMode ring_depth_mode;
+    RingDepthAdvisor ring_advisor;
+    // last recommended depth which was logged
+    uint32_t logged_ring_depth;
+    // upper bound of the one-push wait in grab() in ms
+    static const int ONE_PUSH_TIMEOUT = 2000;
+
+    // camera state for the recovery, see snapshotSettings()
+    struct SettingsSnapshot
+    {
+        dc1394video_mode_t mode;
+        dc1394framerate_t framerate;
+        dc1394speed_t iso_speed;
+        dc1394operation_mode_t operation_mode;
+        RegionOfInterest roi;
+        dc1394color_coding_t coding;
+        uint32_t packet_size;
+        dc1394featureset_t features;
+        dc1394switch_t trigger_power;
+        dc1394switch_t software_trigger_power;
+    };
+    SettingsSnapshot settings;
+    bool settings_valid;
+    // an enum or double attribute changed the features since the snapshot
+    bool settings_changed;
+    uint32_t bus_generation;
+    int last_hdr_value;
+    // guid of the opened camera, which reopen() looks for while the
+    // handle is gone, 0 after close()
+    uint64_t camera_guid;
+    // mode of the last grab(), which a recovery resumes
+    GrabMode resume_grab_mode;
+
+    // dc1394 handles are not thread safe, this serializes the register
+    // and capture calls of the capture thread with those of other
+    // threads like SoftwareTrigger. Everything which frees dc_camera or
+    // sets up the capture ring again holds it as well.
+    pthread_mutex_t handle_mutex;
 
 
 };
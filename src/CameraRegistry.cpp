@@ -0,0 +1,278 @@
+/*
+ * File:   CameraRegistry.cpp
+ *
+ * Cached enumeration of the cameras on a 1394 bus.
+ */
+
+#include "CameraRegistry.h"
+#include "CaptureStatistics.h"
+#include <dc1394/dc1394.h>
+#include <base-logging/Logging.hpp>
+#include <algorithm>
+
+namespace camera
+{
+
+CameraRegistry::CameraRegistry(dc1394_t *device)
+    : device(device), valid(false), poll_interval_us(200000), last_poll(0),
+      rescan_interval_us(5000000), last_enumeration(0)
+{
+    pthread_mutex_init(&mutex, NULL);
+}
+
+CameraRegistry::~CameraRegistry()
+{
+    freeProbes();
+    pthread_mutex_destroy(&mutex);
+}
+
+void CameraRegistry::addListener(CameraRegistryListener *listener)
+{
+    pthread_mutex_lock(&mutex);
+    listeners.push_back(listener);
+    pthread_mutex_unlock(&mutex);
+}
+
+void CameraRegistry::removeListener(CameraRegistryListener *listener)
+{
+    pthread_mutex_lock(&mutex);
+    listeners.erase(std::remove(listeners.begin(), listeners.end(), listener), listeners.end());
+    pthread_mutex_unlock(&mutex);
+}
+
+void CameraRegistry::setPollInterval(uint32_t interval_ms)
+{
+    poll_interval_us = interval_ms * 1000;
+}
+
+void CameraRegistry::setRescanInterval(uint32_t interval_ms)
+{
+    rescan_interval_us = interval_ms * 1000;
+}
+
+bool CameraRegistry::readGeneration(const BusProbe &probe, uint32_t &value)
+{
+    uint32_t node;
+    return dc1394_camera_get_node(probe.camera, &node, &value) == DC1394_SUCCESS;
+}
+
+bool CameraRegistry::generationChanged() const
+{
+    // a failing probe means its camera is gone
+    for (size_t i = 0; i < probes.size(); i++)
+    {
+        uint32_t current;
+        if (!readGeneration(probes[i], current) || current != probes[i].generation)
+            return true;
+    }
+    return false;
+}
+
+bool CameraRegistry::update()
+{
+    std::vector<CamInfo> added, removed;
+    pthread_mutex_lock(&mutex);
+
+    const uint64_t now = CaptureStatistics::now();
+    if (last_poll == 0 || now - last_poll >= poll_interval_us)
+    {
+        last_poll = now;
+        // without any probe every poll enumerates
+        bool rescan = probes.empty() ||
+            (rescan_interval_us != 0 && now - last_enumeration >= rescan_interval_us);
+        if (!valid || rescan || generationChanged())
+            enumerate(added, removed);
+    }
+
+    pthread_mutex_unlock(&mutex);
+    notify(added, removed);
+    return !added.empty() || !removed.empty();
+}
+
+bool CameraRegistry::refresh()
+{
+    std::vector<CamInfo> added, removed;
+    pthread_mutex_lock(&mutex);
+    bool success = enumerate(added, removed);
+    pthread_mutex_unlock(&mutex);
+    notify(added, removed);
+    return success;
+}
+
+bool CameraRegistry::enumerate(std::vector<CamInfo> &added, std::vector<CamInfo> &removed)
+{
+    last_poll = CaptureStatistics::now();
+    last_enumeration = last_poll;
+    if (!device)
+        return false;
+
+    dc1394camera_list_t *list;
+    if (dc1394_camera_enumerate(device, &list) != DC1394_SUCCESS)
+    {
+        LOG_WARN_S << "CameraRegistry: enumeration failed";
+        valid = false;
+        return false;
+    }
+
+    std::vector<CamInfo> current;
+    for (uint32_t i = 0; i < list->num; i++)
+    {
+        const uint64_t guid = list->ids[i].guid;
+        // multi unit devices show up once per unit
+        bool duplicate = false;
+        for (size_t k = 0; k < current.size() && !duplicate; k++)
+            duplicate = current[k].unique_id == guid;
+        if (duplicate)
+            continue;
+
+        bool known = false;
+        for (size_t k = 0; k < cameras.size(); k++)
+        {
+            if (cameras[k].unique_id == guid)
+            {
+                current.push_back(cameras[k]);
+                known = true;
+                break;
+            }
+        }
+        if (known)
+            continue;
+
+        // only new cameras are opened, to read their model
+        dc1394camera_t *camera = dc1394_camera_new(device, guid);
+        if (!camera)
+        {
+            LOG_WARN_S << "CameraRegistry: failed to open camera " << guid;
+            continue;
+        }
+        CamInfo info;
+        info.unique_id = camera->guid;
+        info.display_name = camera->model;
+        info.interface_type = InterfaceFirewire;
+        current.push_back(info);
+        added.push_back(info);
+        uint32_t port;
+        if (dc1394_camera_get_linux_port(camera, &port) == DC1394_SUCCESS)
+            camera_ports[guid] = port;
+        else
+            LOG_WARN_S << "CameraRegistry: the bus of camera " << guid << " is unknown, it is found by rescans only";
+        dc1394_camera_free(camera);
+    }
+    dc1394_camera_free_list(list);
+
+    for (size_t k = 0; k < cameras.size(); k++)
+    {
+        bool present = false;
+        for (size_t i = 0; i < current.size() && !present; i++)
+            present = current[i].unique_id == cameras[k].unique_id;
+        if (!present)
+        {
+            removed.push_back(cameras[k]);
+            camera_ports.erase(cameras[k].unique_id);
+        }
+    }
+    cameras.swap(current);
+
+    updateProbes();
+    valid = true;
+    return true;
+}
+
+void CameraRegistry::updateProbes()
+{
+    // probes of cameras which are gone are dropped
+    std::vector<BusProbe> kept;
+    for (size_t i = 0; i < probes.size(); i++)
+    {
+        bool present = false;
+        for (size_t k = 0; k < cameras.size() && !present; k++)
+            present = cameras[k].unique_id == probes[i].camera->guid;
+        if (present)
+            kept.push_back(probes[i]);
+        else
+            dc1394_camera_free(probes[i].camera);
+    }
+    probes.swap(kept);
+
+    // every bus with a known camera gets a probe
+    for (size_t k = 0; k < cameras.size(); k++)
+    {
+        std::map<uint64_t, uint32_t>::const_iterator port = camera_ports.find(cameras[k].unique_id);
+        if (port == camera_ports.end())
+            continue;
+        bool watched = false;
+        for (size_t i = 0; i < probes.size() && !watched; i++)
+            watched = probes[i].port == port->second;
+        if (watched)
+            continue;
+
+        BusProbe probe;
+        probe.port = port->second;
+        probe.camera = dc1394_camera_new(device, cameras[k].unique_id);
+        if (probe.camera)
+            probes.push_back(probe);
+    }
+
+    // a probe which fails right away makes the next update() enumerate
+    for (size_t i = 0; i < probes.size(); i++)
+    {
+        if (!readGeneration(probes[i], probes[i].generation))
+            probes[i].generation = 0;
+    }
+}
+
+void CameraRegistry::freeProbes()
+{
+    for (size_t i = 0; i < probes.size(); i++)
+        dc1394_camera_free(probes[i].camera);
+    probes.clear();
+}
+
+void CameraRegistry::notify(const std::vector<CamInfo> &added, const std::vector<CamInfo> &removed)
+{
+    if (added.empty() && removed.empty())
+        return;
+
+    pthread_mutex_lock(&mutex);
+    std::vector<CameraRegistryListener *> targets(listeners);
+    pthread_mutex_unlock(&mutex);
+
+    for (size_t i = 0; i < removed.size(); i++)
+    {
+        LOG_INFO_S << "CameraRegistry: camera " << removed[i].unique_id << " removed";
+        for (size_t k = 0; k < targets.size(); k++)
+            targets[k]->cameraRemoved(removed[i]);
+    }
+    for (size_t i = 0; i < added.size(); i++)
+    {
+        LOG_INFO_S << "CameraRegistry: camera " << added[i].unique_id << " (" << added[i].display_name << ") added";
+        for (size_t k = 0; k < targets.size(); k++)
+            targets[k]->cameraAdded(added[i]);
+    }
+}
+
+std::vector<CamInfo> CameraRegistry::getCameras() const
+{
+    pthread_mutex_lock(&mutex);
+    std::vector<CamInfo> result(cameras);
+    pthread_mutex_unlock(&mutex);
+    return result;
+}
+
+bool CameraRegistry::getGeneration(uint32_t port, uint32_t &value) const
+{
+    bool found = false;
+    pthread_mutex_lock(&mutex);
+    for (size_t i = 0; i < probes.size() && !found; i++)
+    {
+        if (probes[i].port == port)
+        {
+            value = probes[i].generation;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+    return found;
+}
+
+}
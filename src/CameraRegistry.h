@@ -0,0 +1,126 @@
+/*
+ * File:   CameraRegistry.h
+ *
+ * Cached enumeration of the cameras on a 1394 bus.
+ */
+
+#ifndef _CAMERAREGISTRY_H
+#define	_CAMERAREGISTRY_H
+
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <pthread.h>
+#include "camera_interface/CamInterface.h"
+
+struct __dc1394_camera;
+typedef __dc1394_camera dc1394camera_t;
+struct __dc1394_t;
+typedef __dc1394_t dc1394_t;
+
+namespace camera
+{
+
+/**
+ * Receives the changes of the camera set. The callbacks are called from
+ * the thread which calls CameraRegistry::update() or refresh(), after
+ * the registry is updated.
+ */
+class CameraRegistryListener
+{
+public:
+    virtual ~CameraRegistryListener() {}
+    virtual void cameraAdded(const CamInfo &cam) = 0;
+    virtual void cameraRemoved(const CamInfo &cam) = 0;
+};
+
+/**
+ * Keeps the list of cameras on the buses without rescanning them.
+ *
+ * A full enumeration is only done when a bus generation changed, which
+ * the kernel increments on every bus reset, so also when a camera is
+ * plugged in or removed. The registry keeps one camera handle open per
+ * bus (host adapter, dc1394_camera_get_linux_port) with known cameras and
+ * reads the generation from it (dc1394_camera_get_node), which is a local
+ * call and does not cause bus traffic. Cameras which are already known
+ * are not opened again, only new GUIDs are opened once to read their
+ * model.
+ *
+ * A bus without any known camera has no handle to watch, so a camera
+ * plugged into it is found by the enumeration which update() also does
+ * at the slow rescan interval. Without any camera at all, update()
+ * enumerates at the poll interval.
+ */
+class CameraRegistry
+{
+public:
+    explicit CameraRegistry(dc1394_t *device);
+    ~CameraRegistry();
+
+    void addListener(CameraRegistryListener *listener);
+    void removeListener(CameraRegistryListener *listener);
+
+    /** Minimum time in ms between two generation checks (default 200) */
+    void setPollInterval(uint32_t interval_ms);
+
+    /** Time in ms after which update() enumerates even if no watched
+     * generation changed, to find cameras on buses without known
+     * cameras (default 5000, 0 disables it)
+     */
+    void setRescanInterval(uint32_t interval_ms);
+
+    /**
+     * Enumerates the bus again if the generation changed.
+     * @return true if cameras were added or removed
+     */
+    bool update();
+
+    /**
+     * Enumerates the bus unconditionally.
+     * @return false if the enumeration failed
+     */
+    bool refresh();
+
+    /** The cameras found by the last enumeration */
+    std::vector<CamInfo> getCameras() const;
+
+    /**
+     * Generation of the bus on the given port at the last enumeration.
+     * @return false if no known camera is on this bus
+     */
+    bool getGeneration(uint32_t port, uint32_t &generation) const;
+
+private:
+    // open handle of one known camera per bus, used to read the generation
+    struct BusProbe
+    {
+        uint32_t port;
+        dc1394camera_t *camera;
+        uint32_t generation;
+    };
+
+    static bool readGeneration(const BusProbe &probe, uint32_t &generation);
+    bool generationChanged() const;
+    void updateProbes();
+    void freeProbes();
+    bool enumerate(std::vector<CamInfo> &added, std::vector<CamInfo> &removed);
+    void notify(const std::vector<CamInfo> &added, const std::vector<CamInfo> &removed);
+
+    dc1394_t *device;
+    std::vector<BusProbe> probes;
+    bool valid;
+    uint32_t poll_interval_us;
+    uint64_t last_poll;
+    uint32_t rescan_interval_us;
+    uint64_t last_enumeration;
+
+    std::vector<CamInfo> cameras;
+    // bus of each known camera, read when it is opened for its model
+    std::map<uint64_t, uint32_t> camera_ports;
+    std::vector<CameraRegistryListener *> listeners;
+    mutable pthread_mutex_t mutex;
+};
+
+}
+
+#endif	/* _CAMERAREGISTRY_H */
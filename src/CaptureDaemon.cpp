@@ -0,0 +1,458 @@
+/*
+ * File:   CaptureDaemon.cpp
+ *
+ * Headless capture of several cameras with live statistics.
+ *
+ * usage: camera_firewire_capture <config file>
+ *        camera_firewire_capture --list
+ *
+ * The config file has global settings followed by one [camera] section
+ * per camera, see configuration/capture_daemon.conf.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dc1394/dc1394.h>
+#include "CamFireWire.h"
+#include "CaptureManager.h"
+#include "FramePublisher.h"
+#include "FrameRecorder.h"
+
+using namespace camera;
+using namespace base::samples::frame;
+
+struct CameraConfig
+{
+    std::string name;
+    // guid in hex, empty takes the camera with the given index
+    std::string guid;
+    int index;
+    int width;
+    int height;
+    frame_mode_t mode;
+    int depth;
+    double fps;
+    int iso_speed;
+    int ring;
+    RetrievePolicy retrieve_policy;
+
+    CameraConfig()
+        : index(0), width(640), height(480), mode(MODE_BAYER_RGGB), depth(8), fps(30),
+          iso_speed(400), ring(8), retrieve_policy(RetrieveOldest) {}
+};
+
+struct DaemonConfig
+{
+    // 0 runs until SIGINT/SIGTERM
+    double duration;
+    double stats_interval;
+    // "null" or "record"
+    std::string sink;
+    std::string output_dir;
+    // "none" or "bayer" (lossless, filter::BayerCodec)
+    std::string compress;
+    // encoder threads per recording, 0 uses all cores
+    int compress_threads;
+    // first core for the capture threads, -1 leaves them unpinned
+    int first_cpu;
+    int priority;
+    std::vector<CameraConfig> cameras;
+
+    DaemonConfig()
+        : duration(0), stats_interval(1), sink("null"), output_dir("."), compress("none"), compress_threads(0),
+          first_cpu(-1), priority(0) {}
+};
+
+static volatile bool stop_requested = false;
+
+static void handleSignal(int)
+{
+    stop_requested = true;
+}
+
+static std::string trim(const std::string &s)
+{
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+        return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+static bool parseFrameMode(const std::string &value, frame_mode_t &mode)
+{
+    static const struct { const char *name; frame_mode_t mode; } modes[] = {
+        { "bayer_rggb", MODE_BAYER_RGGB }, { "bayer_grbg", MODE_BAYER_GRBG },
+        { "bayer_gbrg", MODE_BAYER_GBRG }, { "bayer_bggr", MODE_BAYER_BGGR },
+        { "grayscale", MODE_GRAYSCALE }, { "rgb", MODE_RGB }, { "uyvy", MODE_UYVY } };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        if (value == modes[i].name)
+        {
+            mode = modes[i].mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseConfig(const char *path, DaemonConfig &config)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "cannot open " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    CameraConfig *camera = NULL;
+    while (std::getline(file, line))
+    {
+        line_number++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+        if (line == "[camera]")
+        {
+            config.cameras.push_back(CameraConfig());
+            camera = &config.cameras.back();
+            camera->index = config.cameras.size() - 1;
+            std::ostringstream name;
+            name << "cam" << camera->index;
+            camera->name = name.str();
+            continue;
+        }
+
+        size_t equal = line.find('=');
+        if (equal == std::string::npos)
+        {
+            std::cerr << path << ":" << line_number << ": expected key = value" << std::endl;
+            return false;
+        }
+        std::string key = trim(line.substr(0, equal));
+        std::string value = trim(line.substr(equal + 1));
+        bool valid = true;
+
+        if (!camera)
+        {
+            if (key == "duration") config.duration = atof(value.c_str());
+            else if (key == "stats_interval") config.stats_interval = atof(value.c_str());
+            else if (key == "sink") { config.sink = value; valid = value == "null" || value == "record"; }
+            else if (key == "output_dir") config.output_dir = value;
+            else if (key == "compress") { config.compress = value; valid = value == "none" || value == "bayer"; }
+            else if (key == "compress_threads") config.compress_threads = atoi(value.c_str());
+            else if (key == "cpu") config.first_cpu = atoi(value.c_str());
+            else if (key == "priority") config.priority = atoi(value.c_str());
+            else valid = false;
+        }
+        else
+        {
+            if (key == "name") camera->name = value;
+            else if (key == "guid") camera->guid = value;
+            else if (key == "index") camera->index = atoi(value.c_str());
+            else if (key == "width") camera->width = atoi(value.c_str());
+            else if (key == "height") camera->height = atoi(value.c_str());
+            else if (key == "mode") valid = parseFrameMode(value, camera->mode);
+            else if (key == "depth") { camera->depth = atoi(value.c_str()); valid = camera->depth == 8 || camera->depth == 16; }
+            else if (key == "fps") camera->fps = atof(value.c_str());
+            else if (key == "iso_speed") camera->iso_speed = atoi(value.c_str());
+            else if (key == "ring") camera->ring = atoi(value.c_str());
+            else if (key == "retrieve") { camera->retrieve_policy = value == "latest" ? RetrieveLatest : RetrieveOldest;
+                                          valid = value == "latest" || value == "oldest"; }
+            else valid = false;
+        }
+        if (!valid)
+        {
+            std::cerr << path << ":" << line_number << ": invalid setting " << key << " = " << value << std::endl;
+            return false;
+        }
+    }
+
+    if (config.cameras.empty())
+    {
+        std::cerr << path << ": no [camera] section" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Counts the frames only, for measuring the throughput of the driver.
+ */
+class NullSink : public FrameSink
+{
+public:
+    virtual ~NullSink() {}
+    virtual void frameReceived(CaptureSource &, const Frame &) {}
+    virtual uint64_t getDropped() const { return 0; }
+    virtual uint64_t getBytesWritten() const { return 0; }
+};
+
+/**
+ * Records the frames from a separate thread, so a slow disk drops
+ * frames of the recording but does not stall the capture thread.
+ */
+class RecordSink : public NullSink
+{
+public:
+    RecordSink(CamFireWire &camera, const std::string &path, RecordHeader::Codec codec, unsigned codec_threads)
+        : publisher(camera, 32), thread_started(false), stopping(false), bytes_written(0)
+    {
+        subscription = publisher.subscribe(SubscribeBlock, 24, 2);
+        recorder.setCodec(codec, codec_threads);
+        if (recorder.open(path) && pthread_create(&thread, NULL, &RecordSink::threadFunc, this) == 0)
+            thread_started = true;
+    }
+
+    virtual ~RecordSink()
+    {
+        stopping = true;
+        if (thread_started)
+            pthread_join(thread, NULL);
+    }
+
+    bool isOpen() const { return thread_started; }
+
+    // the frame of the capture thread is reused for the next one, so the
+    // image is copied into a pool buffer of the publisher here. The copy
+    // is a memcpy without allocation once the pool is filled, encoding
+    // and disk writes stay on the recording thread.
+    virtual void frameReceived(CaptureSource &, const Frame &frame)
+    {
+        publisher.publish(frame);
+    }
+
+    virtual uint64_t getDropped() const
+    {
+        return subscription->getDropped() + publisher.getPoolExhausted();
+    }
+
+    virtual uint64_t getBytesWritten() const
+    {
+        return __sync_fetch_and_add(const_cast<uint64_t *>(&bytes_written), 0);
+    }
+
+private:
+    static void *threadFunc(void *arg)
+    {
+        static_cast<RecordSink *>(arg)->run();
+        return NULL;
+    }
+
+    void run()
+    {
+        // the queue is drained before the recording is closed
+        FrameRef frame;
+        while (!stopping || subscription->getQueued() > 0)
+        {
+            if (!subscription->pop(frame, 100))
+                continue;
+            recorder.write(*frame);
+            frame.release();
+            __sync_lock_test_and_set(&bytes_written, recorder.getBytesWritten());
+        }
+        recorder.close();
+    }
+
+    FramePublisher publisher;
+    FrameSubscription *subscription;
+    FrameRecorder recorder;
+    pthread_t thread;
+    bool thread_started;
+    volatile bool stopping;
+    uint64_t bytes_written;
+};
+
+struct CameraState
+{
+    CameraConfig config;
+    CamFireWire *camera;
+    NullSink *sink;
+    uint64_t last_frames;
+    uint64_t last_bytes;
+};
+
+static int listCameras()
+{
+    CamFireWire camera;
+    camera.setDevice(dc1394_new());
+    std::vector<CamInfo> cam_infos;
+    if (camera.listCameras(cam_infos) <= 0)
+        return 1;
+    for (size_t i = 0; i < cam_infos.size(); i++)
+        std::cout << i << ": " << std::hex << cam_infos[i].unique_id << std::dec << " "
+            << cam_infos[i].display_name << std::endl;
+    return 0;
+}
+
+static bool setupCamera(CameraState &state, dc1394_t *device, CameraRegistry &registry,
+                        const std::vector<CamInfo> &cam_infos)
+{
+    const CameraConfig &config = state.config;
+
+    // all cameras share the context and the enumeration of main()
+    state.camera = new CamFireWire;
+    CamFireWire &camera = *state.camera;
+    camera.setDevice(device, &registry);
+
+    const CamInfo *info = NULL;
+    if (!config.guid.empty())
+    {
+        uint64_t guid = strtoull(config.guid.c_str(), NULL, 16);
+        for (size_t i = 0; i < cam_infos.size() && !info; i++)
+            if (cam_infos[i].unique_id == guid)
+                info = &cam_infos[i];
+    }
+    else if (config.index >= 0 && config.index < (int)cam_infos.size())
+        info = &cam_infos[config.index];
+    if (!info)
+    {
+        std::cerr << config.name << ": camera not found" << std::endl;
+        return false;
+    }
+
+    int channels = Frame::getChannelCount(config.mode);
+    if (!camera.open(*info, Master) ||
+        !camera.setAttrib(int_attrib::IsoSpeed, config.iso_speed) ||
+        !camera.setFrameSettings(frame_size_t(config.width, config.height), config.mode,
+                                 config.depth / 8 * channels, false) ||
+        !camera.setAttrib(double_attrib::FrameRate, config.fps))
+    {
+        std::cerr << config.name << ": setup failed" << std::endl;
+        return false;
+    }
+    camera.setRetrievePolicy(config.retrieve_policy);
+    return camera.grab(Continuously, config.ring);
+}
+
+static void printStats(std::vector<CameraState> &states, double interval)
+{
+    for (size_t i = 0; i < states.size(); i++)
+    {
+        CameraState &state = states[i];
+        CaptureStats stats = state.camera->getCaptureStats();
+        uint64_t bytes = state.sink->getBytesWritten();
+        std::cout << std::fixed << std::setprecision(1)
+            << state.config.name << ": " << (stats.frames_dequeued - state.last_frames) / interval << " fps"
+            << ", dropped " << stats.frames_dropped << " (overruns " << stats.ring_overruns << ")"
+            << ", latency p50/p99/max " << stats.latency_p50_us << "/" << stats.latency_p99_us
+            << "/" << stats.latency_max_us << " us"
+            << ", ring " << stats.ring_occupancy_max << "/" << stats.ring_size;
+        if (bytes || state.sink->getDropped())
+            std::cout << ", recorded " << (bytes - state.last_bytes) / interval / (1 << 20) << " MB/s"
+                << " (dropped " << state.sink->getDropped() << ")";
+        std::cout << std::endl;
+        state.last_frames = stats.frames_dequeued;
+        state.last_bytes = bytes;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <config file>|--list" << std::endl;
+        return 1;
+    }
+    if (strcmp(argv[1], "--list") == 0)
+        return listCameras();
+
+    DaemonConfig config;
+    if (!parseConfig(argv[1], config))
+        return 1;
+
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+    if (config.sink == "record")
+        mkdir(config.output_dir.c_str(), 0777);
+
+    // one context and one enumeration of the bus for all cameras
+    dc1394_t *device = dc1394_new();
+    if (!device)
+    {
+        std::cerr << "cannot create a libdc1394 context" << std::endl;
+        return 1;
+    }
+    CameraRegistry *registry = new CameraRegistry(device);
+    registry->refresh();
+    std::vector<CamInfo> cam_infos = registry->getCameras();
+    if (cam_infos.empty())
+        std::cerr << "no cameras found" << std::endl;
+
+    std::vector<CameraState> states(config.cameras.size());
+    CaptureManager manager;
+    bool success = !cam_infos.empty();
+    for (size_t i = 0; i < states.size() && success; i++)
+    {
+        CameraState &state = states[i];
+        state.config = config.cameras[i];
+        state.camera = NULL;
+        state.sink = NULL;
+        state.last_frames = 0;
+        state.last_bytes = 0;
+        success = setupCamera(state, device, *registry, cam_infos);
+        if (!success)
+            break;
+
+        if (config.sink == "record")
+        {
+            RecordSink *sink = new RecordSink(*state.camera, config.output_dir + "/" + state.config.name + ".rec",
+                    config.compress == "bayer" ? RecordHeader::CodecBayerRice : RecordHeader::CodecRaw,
+                    config.compress_threads);
+            state.sink = sink;
+            success = sink->isOpen();
+        }
+        else
+            state.sink = new NullSink;
+        success = success && manager.addCamera(*state.camera, state.sink);
+    }
+
+    if (success)
+    {
+        if (config.first_cpu >= 0 || config.priority > 0)
+            manager.setThreadSettingsPerBus(config.first_cpu >= 0 ? config.first_cpu : 0, config.priority);
+        std::vector<uint32_t> buses = manager.getBuses();
+        std::cout << states.size() << " cameras on " << buses.size() << " buses" << std::endl;
+        success = manager.start();
+    }
+
+    uint64_t start = CaptureStatistics::now();
+    uint64_t last = start;
+    while (success && !stop_requested)
+    {
+        usleep(10000);
+        uint64_t now = CaptureStatistics::now();
+        if (config.duration > 0 && now - start >= config.duration * 1e6)
+            break;
+        if (now - last >= config.stats_interval * 1e6)
+        {
+            printStats(states, (now - last) / 1e6);
+            last = now;
+        }
+    }
+    manager.stop();
+
+    for (size_t i = 0; i < states.size(); i++)
+    {
+        // the sink flushes the recording before the camera goes away
+        delete states[i].sink;
+        if (!states[i].camera)
+            continue;
+        states[i].camera->grab(Stop, 0);
+        states[i].camera->close();
+        delete states[i].camera;
+    }
+    // the registry holds a camera handle of the context
+    delete registry;
+    dc1394_free(device);
+    return success ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+/*
+ * File:   CaptureManager.cpp
+ *
+ * Capture threads per 1394 host adapter.
+ */
+
+#include "CaptureManager.h"
+#include "CamFireWire.h"
+#include <dc1394/dc1394.h>
+#include <base-logging/Logging.hpp>
+#include <poll.h>
+#include <errno.h>
+#include <stdexcept>
+
+using namespace base::samples::frame;
+
+namespace camera
+{
+
+// stop() is noticed within this time when no frames arrive
+static const int POLL_TIMEOUT_MS = 100;
+
+FireWireCaptureSource::FireWireCaptureSource(CamFireWire &camera)
+    : camera(camera)
+{
+}
+
+int FireWireCaptureSource::getFileDescriptor() const
+{
+    return camera.getFileDescriptor();
+}
+
+bool FireWireCaptureSource::retrieve(Frame &frame)
+{
+    return camera.retrieveFrame(frame, 0);
+}
+
+CamFireWire &FireWireCaptureSource::getCamera()
+{
+    return camera;
+}
+
+CaptureManager::CaptureManager()
+    : stop_requested(false), running(false)
+{
+}
+
+CaptureManager::~CaptureManager()
+{
+    stop();
+    for (std::map<uint32_t, Bus *>::iterator it = buses.begin(); it != buses.end(); ++it)
+        delete it->second;
+    for (size_t i = 0; i < owned_sources.size(); i++)
+        delete owned_sources[i];
+}
+
+CaptureManager::Bus &CaptureManager::getBus(uint32_t id)
+{
+    Bus *&bus = buses[id];
+    if (!bus)
+    {
+        bus = new Bus;
+        bus->manager = this;
+        bus->id = id;
+        bus->thread_started = false;
+        bus->frames = 0;
+        bus->errors = 0;
+    }
+    return *bus;
+}
+
+bool CaptureManager::addCamera(CamFireWire &camera, FrameSink *sink)
+{
+    if (!camera.dc_camera)
+        return false;
+
+    uint32_t port;
+    if (dc1394_camera_get_linux_port(camera.dc_camera, &port) != DC1394_SUCCESS)
+    {
+        LOG_ERROR_S << "CaptureManager: cannot determine the adapter of camera " << camera.dc_camera->guid;
+        return false;
+    }
+
+    FireWireCaptureSource *source = new FireWireCaptureSource(camera);
+    owned_sources.push_back(source);
+    addSource(port, source, sink);
+    LOG_INFO_S << "CaptureManager: camera " << camera.dc_camera->guid << " on bus " << port;
+    return true;
+}
+
+void CaptureManager::addSource(uint32_t bus, CaptureSource *source, FrameSink *sink)
+{
+    if (running)
+        throw std::runtime_error("CaptureManager: stop the manager before adding sources!");
+
+    Entry entry;
+    entry.source = source;
+    entry.sink = sink;
+    getBus(bus).entries.push_back(entry);
+}
+
+void CaptureManager::setThreadSettings(uint32_t bus, const ThreadSettings &settings)
+{
+    getBus(bus).settings = settings;
+}
+
+void CaptureManager::setThreadSettingsPerBus(int first_cpu, int priority)
+{
+    const int cpus = getCpuCount();
+    int index = 0;
+    for (std::map<uint32_t, Bus *>::iterator it = buses.begin(); it != buses.end(); ++it, ++index)
+        it->second->settings = ThreadSettings((first_cpu + index) % cpus, priority);
+}
+
+bool CaptureManager::start()
+{
+    if (running)
+        return true;
+
+    stop_requested = false;
+    running = true;
+    for (std::map<uint32_t, Bus *>::iterator it = buses.begin(); it != buses.end(); ++it)
+    {
+        Bus &bus = *it->second;
+        bus.frames = 0;
+        bus.errors = 0;
+        if (bus.entries.empty())
+            continue;
+        // pinned and scheduled before it touches the ring
+        if (!createThread(bus.thread, &CaptureManager::threadFunc, &bus, bus.settings))
+        {
+            LOG_ERROR_S << "CaptureManager: cannot start the thread of bus " << bus.id;
+            stop();
+            return false;
+        }
+        bus.thread_started = true;
+    }
+    return true;
+}
+
+void CaptureManager::stop()
+{
+    stop_requested = true;
+    for (std::map<uint32_t, Bus *>::iterator it = buses.begin(); it != buses.end(); ++it)
+    {
+        if (!it->second->thread_started)
+            continue;
+        pthread_join(it->second->thread, NULL);
+        it->second->thread_started = false;
+    }
+    running = false;
+}
+
+bool CaptureManager::isRunning() const
+{
+    return running;
+}
+
+std::vector<uint32_t> CaptureManager::getBuses() const
+{
+    std::vector<uint32_t> result;
+    for (std::map<uint32_t, Bus *>::const_iterator it = buses.begin(); it != buses.end(); ++it)
+        result.push_back(it->first);
+    return result;
+}
+
+uint64_t CaptureManager::getFrameCount(uint32_t bus) const
+{
+    std::map<uint32_t, Bus *>::const_iterator it = buses.find(bus);
+    if (it == buses.end())
+        return 0;
+    return __sync_fetch_and_add(&it->second->frames, 0);
+}
+
+uint64_t CaptureManager::getErrorCount(uint32_t bus) const
+{
+    std::map<uint32_t, Bus *>::const_iterator it = buses.find(bus);
+    if (it == buses.end())
+        return 0;
+    return __sync_fetch_and_add(&it->second->errors, 0);
+}
+
+void *CaptureManager::threadFunc(void *arg)
+{
+    Bus *bus = static_cast<Bus *>(arg);
+    bus->manager->run(*bus);
+    return NULL;
+}
+
+void CaptureManager::run(Bus &bus)
+{
+    // poll() has no FD_SETSIZE limit, processes with many open files hand
+    // out capture descriptors above 1024
+    std::vector<pollfd> fds;
+    std::vector<size_t> fd_entries;
+    fds.reserve(bus.entries.size());
+    fd_entries.reserve(bus.entries.size());
+
+    while (!stop_requested)
+    {
+        fds.clear();
+        fd_entries.clear();
+        for (size_t i = 0; i < bus.entries.size(); i++)
+        {
+            int fd = bus.entries[i].source->getFileDescriptor();
+            if (fd < 0)
+                continue;
+            pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            fds.push_back(pfd);
+            fd_entries.push_back(i);
+        }
+
+        int ready = poll(fds.empty() ? NULL : &fds[0], fds.size(), POLL_TIMEOUT_MS);
+        if (ready < 0 && errno != EINTR)
+        {
+            LOG_ERROR_S << "CaptureManager: poll failed on bus " << bus.id;
+            break;
+        }
+        if (ready <= 0)
+            continue;
+
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            if (!(fds[i].revents & (POLLIN | POLLERR | POLLHUP)))
+                continue;
+            Entry &entry = bus.entries[fd_entries[i]];
+
+            // an exception must not terminate the thread and with it the
+            // process, it is an error of this source
+            bool retrieved;
+            try
+            {
+                retrieved = entry.source->retrieve(entry.frame);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR_S << "CaptureManager: retrieve failed on bus " << bus.id << ": " << e.what();
+                retrieved = false;
+            }
+
+            if (retrieved)
+            {
+                __sync_fetch_and_add(&bus.frames, 1);
+                if (entry.sink)
+                    entry.sink->frameReceived(*entry.source, entry.frame);
+            }
+            else
+            {
+                __sync_fetch_and_add(&bus.errors, 1);
+                if (entry.sink)
+                    entry.sink->captureError(*entry.source);
+            }
+        }
+    }
+}
+
+}
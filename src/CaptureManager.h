@@ -0,0 +1,147 @@
+/*
+ * File:   CaptureManager.h
+ *
+ * Capture threads per 1394 host adapter.
+ */
+
+#ifndef _CAPTUREMANAGER_H
+#define	_CAPTUREMANAGER_H
+
+#include <map>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include "base/samples/Frame.hpp"
+#include "ThreadUtils.h"
+
+namespace camera
+{
+
+class CamFireWire;
+
+/**
+ * Source of frames for a capture thread, implemented for CamFireWire by
+ * CaptureManager::addCamera(). Other implementations allow to run the
+ * threads without cameras, e.g. for benchmarks.
+ */
+class CaptureSource
+{
+public:
+    virtual ~CaptureSource() {}
+    /** Descriptor which becomes readable when a frame is available */
+    virtual int getFileDescriptor() const = 0;
+    /** Retrieves the available frame without blocking */
+    virtual bool retrieve(base::samples::frame::Frame &frame) = 0;
+};
+
+/**
+ * Frames of a capturing CamFireWire.
+ */
+class FireWireCaptureSource : public CaptureSource
+{
+public:
+    explicit FireWireCaptureSource(CamFireWire &camera);
+    virtual int getFileDescriptor() const;
+    virtual bool retrieve(base::samples::frame::Frame &frame);
+    CamFireWire &getCamera();
+
+private:
+    CamFireWire &camera;
+};
+
+/**
+ * Receives the frames of one source. Called from the capture thread of
+ * its bus, the frame is reused for the next frame of the source.
+ */
+class FrameSink
+{
+public:
+    virtual ~FrameSink() {}
+    virtual void frameReceived(CaptureSource &source, const base::samples::frame::Frame &frame) = 0;
+    virtual void captureError(CaptureSource &source) {}
+};
+
+/**
+ * Runs one capture thread per 1394 host adapter.
+ *
+ * Each adapter has its own isochronous bandwidth, so cameras on
+ * different adapters are independent and are served by independent
+ * threads: each thread waits with poll() on the capture descriptors of
+ * the cameras on its bus and hands the frames to their sinks. The bus of
+ * a camera is the linux port of its adapter (dc1394_camera_get_linux_port).
+ * The threads can be pinned to cores and run with SCHED_FIFO, ideally on
+ * the core which handles the interrupts of the adapter.
+ *
+ * The cameras must be grabbing (Continuously) before start() and must
+ * not be used from other threads while the manager is running.
+ */
+class CaptureManager
+{
+public:
+    CaptureManager();
+    ~CaptureManager();
+
+    /**
+     * Adds an open camera, grouped by the adapter it is connected to.
+     * @return false if the adapter of the camera cannot be determined
+     */
+    bool addCamera(CamFireWire &camera, FrameSink *sink);
+
+    /** Adds a source to the given bus, the manager does not own source */
+    void addSource(uint32_t bus, CaptureSource *source, FrameSink *sink);
+
+    /** Scheduling of the thread of a bus, applied at start() */
+    void setThreadSettings(uint32_t bus, const ThreadSettings &settings);
+
+    /**
+     * Pins the thread of the n-th bus (in ascending order) to core
+     * first_cpu + n, with the given SCHED_FIFO priority.
+     */
+    void setThreadSettingsPerBus(int first_cpu, int priority);
+
+    /** Starts one thread per bus */
+    bool start();
+    /** Stops and joins all threads */
+    void stop();
+    bool isRunning() const;
+
+    std::vector<uint32_t> getBuses() const;
+    /** Frames delivered on the bus since start() */
+    uint64_t getFrameCount(uint32_t bus) const;
+    /** Failed retrieves on the bus since start() */
+    uint64_t getErrorCount(uint32_t bus) const;
+
+private:
+    struct Entry
+    {
+        CaptureSource *source;
+        FrameSink *sink;
+        base::samples::frame::Frame frame;
+    };
+
+    struct Bus
+    {
+        CaptureManager *manager;
+        uint32_t id;
+        ThreadSettings settings;
+        std::vector<Entry> entries;
+        pthread_t thread;
+        bool thread_started;
+        uint64_t frames;
+        uint64_t errors;
+    };
+
+    static void *threadFunc(void *arg);
+    void run(Bus &bus);
+    Bus &getBus(uint32_t id);
+
+    std::map<uint32_t, Bus *> buses;
+    // sources created by addCamera()
+    std::vector<CaptureSource *> owned_sources;
+    volatile bool stop_requested;
+    bool running;
+};
+
+}
+
+#endif	/* _CAPTUREMANAGER_H */
@@ -0,0 +1,371 @@
+/*
+ * File:   CaptureStatistics.cpp
+ *
+ * Lock-free capture telemetry for CamFireWire.
+ */
+
+#include "CaptureStatistics.h"
+#include <string.h>
+#include <time.h>
+
+namespace camera
+{
+
+// all counters are written by the capture thread only, but read from
+// arbitrary threads. The gcc atomic builtins keep both sides lock-free.
+template<typename T>
+static inline T atomicLoad(const T &value)
+{
+    return __sync_fetch_and_add(const_cast<T *>(&value), 0);
+}
+
+template<typename T>
+static inline void atomicAdd(T &value, T increment)
+{
+    __sync_fetch_and_add(&value, increment);
+}
+
+template<typename T>
+static inline void atomicStore(T &value, T new_value)
+{
+    T old_value = value;
+    while (true)
+    {
+        T prev = __sync_val_compare_and_swap(&value, old_value, new_value);
+        if (prev == old_value)
+            return;
+        old_value = prev;
+    }
+}
+
+template<typename T>
+static inline void atomicMax(T &value, T candidate)
+{
+    T old_value = value;
+    while (candidate > old_value)
+    {
+        T prev = __sync_val_compare_and_swap(&value, old_value, candidate);
+        if (prev == old_value)
+            return;
+        old_value = prev;
+    }
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::reset()
+{
+    memset(buckets, 0, sizeof(buckets));
+    atomicStore(count, (uint64_t)0);
+    atomicStore(sum, (uint64_t)0);
+    atomicStore(max, (uint32_t)0);
+}
+
+int LatencyHistogram::bucketIndex(uint32_t value)
+{
+    if (value < 2 * SUB_BUCKETS)
+        return value;
+
+    // keep the PRECISION_BITS+1 most significant bits of the value
+    int msb = 31 - __builtin_clz(value);
+    int shift = msb - PRECISION_BITS;
+    return (shift << PRECISION_BITS) + (value >> shift);
+}
+
+uint32_t LatencyHistogram::bucketValue(int index)
+{
+    if (index < 2 * SUB_BUCKETS)
+        return index;
+
+    int shift = (index >> PRECISION_BITS) - 1;
+    uint32_t sub = (index & (SUB_BUCKETS - 1)) + SUB_BUCKETS;
+
+    // middle of the bucket
+    return (sub << shift) + ((1u << shift) >> 1);
+}
+
+void LatencyHistogram::record(uint32_t value_us)
+{
+    atomicAdd(buckets[bucketIndex(value_us)], (uint32_t)1);
+    atomicAdd(sum, (uint64_t)value_us);
+    atomicAdd(count, (uint64_t)1);
+    atomicMax(max, value_us);
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+    return atomicLoad(count);
+}
+
+uint32_t LatencyHistogram::getMax() const
+{
+    return atomicLoad(max);
+}
+
+double LatencyHistogram::getMean() const
+{
+    uint64_t n = atomicLoad(count);
+    if (n == 0)
+        return 0;
+    return (double)atomicLoad(sum) / n;
+}
+
+uint32_t LatencyHistogram::getPercentile(double fraction) const
+{
+    // the buckets are summed up instead of using count, so a concurrent
+    // record() cannot make the threshold unreachable
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++)
+        total += atomicLoad(buckets[i]);
+    if (total == 0)
+        return 0;
+
+    uint64_t threshold = (uint64_t)(fraction * total + 0.5);
+    if (threshold == 0)
+        threshold = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++)
+    {
+        seen += atomicLoad(buckets[i]);
+        if (seen >= threshold)
+            return bucketValue(i);
+    }
+    return atomicLoad(max);
+}
+
+CaptureStatistics::CaptureStatistics()
+{
+    ring_size = 0;
+    trigger_head = 0;
+    trigger_tail = 0;
+    startup_time_us = 0;
+    recoveries = 0;
+    recovery_failures = 0;
+    last_recovery_time_us = 0;
+    max_recovery_time_us = 0;
+    exact_drop_counting = false;
+    reset();
+}
+
+uint64_t CaptureStatistics::now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void CaptureStatistics::reset()
+{
+    atomicStore(frames_dequeued, (uint64_t)0);
+    atomicStore(frames_dropped, (uint64_t)0);
+    atomicStore(ring_overruns, (uint64_t)0);
+    atomicStore(dequeue_errors, (uint64_t)0);
+    atomicStore(frames_skipped, (uint64_t)0);
+    atomicStore(bytes_copied, (uint64_t)0);
+    atomicStore(ring_occupancy, (uint32_t)0);
+    atomicStore(ring_occupancy_max, (uint32_t)0);
+    atomicStore(frame_interval_us, (uint32_t)0);
+    last_timestamp = 0;
+    frame_interval = 0;
+    interval_samples = 0;
+    latency.reset();
+    copy_time.reset();
+    atomicStore(trigger_head, (uint32_t)0);
+    atomicStore(trigger_tail, (uint32_t)0);
+    atomicStore(triggers_sent, (uint64_t)0);
+    atomicStore(triggers_missed, (uint64_t)0);
+    atomicStore(triggers_lost, (uint64_t)0);
+    atomicStore(last_trigger_time, (uint64_t)0);
+    atomicStore(trigger_period_us, (uint32_t)0);
+    atomicStore(min_trigger_latency_us, (uint32_t)0);
+    trigger_latency.reset();
+}
+
+void CaptureStatistics::setRingSize(uint32_t size)
+{
+    atomicStore(ring_size, size);
+
+    // a new capture session starts, do not compare timestamps across it
+    last_timestamp = 0;
+}
+
+void CaptureStatistics::recordDequeue(uint64_t timestamp_us, uint32_t frames_behind)
+{
+    atomicAdd(frames_dequeued, (uint64_t)1);
+
+    uint32_t occupancy = frames_behind + 1;
+    atomicStore(ring_occupancy, occupancy);
+    atomicMax(ring_occupancy_max, occupancy);
+    if (ring_size > 0 && occupancy >= ring_size)
+        atomicAdd(ring_overruns, (uint64_t)1);
+
+    if (last_timestamp != 0 && timestamp_us > last_timestamp)
+    {
+        double interval = timestamp_us - last_timestamp;
+
+        // frames that are more than 1.5 intervals apart indicate losses.
+        // The estimate needs a few samples before it can be trusted.
+        const int warmup_samples = 8;
+        if (interval_samples >= warmup_samples && interval > 1.5 * frame_interval)
+        {
+            uint32_t lost = (uint32_t)(interval / frame_interval + 0.5) - 1;
+            if (!exact_drop_counting)
+                atomicAdd(frames_dropped, (uint64_t)lost);
+        }
+        else
+        {
+            // slow exponential filter, gaps are kept out of the estimate
+            if (interval_samples == 0)
+                frame_interval = interval;
+            else
+                frame_interval += (interval - frame_interval) * 0.1;
+            interval_samples++;
+            atomicStore(frame_interval_us, (uint32_t)(frame_interval + 0.5));
+        }
+    }
+    last_timestamp = timestamp_us;
+}
+
+void CaptureStatistics::recordDequeueError()
+{
+    atomicAdd(dequeue_errors, (uint64_t)1);
+}
+
+void CaptureStatistics::recordSkippedFrames(uint32_t count)
+{
+    atomicAdd(frames_skipped, (uint64_t)count);
+}
+
+void CaptureStatistics::recordCopy(uint32_t bytes, uint32_t copy_time_us)
+{
+    atomicAdd(bytes_copied, (uint64_t)bytes);
+    copy_time.record(copy_time_us);
+}
+
+void CaptureStatistics::recordLatency(uint32_t latency_us)
+{
+    latency.record(latency_us);
+}
+
+void CaptureStatistics::recordTrigger(uint64_t trigger_time_us)
+{
+    atomicAdd(triggers_sent, (uint64_t)1);
+
+    uint64_t last = atomicLoad(last_trigger_time);
+    if (last != 0 && trigger_time_us > last)
+        atomicStore(trigger_period_us, (uint32_t)(trigger_time_us - last));
+    atomicStore(last_trigger_time, trigger_time_us);
+
+    uint32_t head = atomicLoad(trigger_head);
+    if (head - atomicLoad(trigger_tail) >= MAX_PENDING_TRIGGERS)
+        return; // no frames are retrieved, the trigger cannot be matched
+    pending_triggers[head % MAX_PENDING_TRIGGERS] = trigger_time_us;
+    atomicStore(trigger_head, head + 1);
+}
+
+void CaptureStatistics::recordMissedTrigger()
+{
+    atomicAdd(triggers_missed, (uint64_t)1);
+}
+
+void CaptureStatistics::matchTrigger(uint64_t frame_timestamp_us)
+{
+    uint32_t tail = atomicLoad(trigger_tail);
+    const uint32_t head = atomicLoad(trigger_head);
+    const uint32_t period = atomicLoad(trigger_period_us);
+    const uint32_t min_latency = atomicLoad(min_trigger_latency_us);
+    for (; tail != head; tail++)
+    {
+        uint64_t trigger_time = pending_triggers[tail % MAX_PENDING_TRIGGERS];
+        if (trigger_time > frame_timestamp_us)
+            break; // frame of an earlier trigger or free running
+
+        uint64_t latency = frame_timestamp_us - trigger_time;
+        // only expired when a later trigger can take the frame, so a
+        // longer exposure does not expire every trigger
+        bool later_trigger = tail + 1 != head &&
+            pending_triggers[(tail + 1) % MAX_PENDING_TRIGGERS] <= frame_timestamp_us;
+        if (later_trigger && min_latency != 0 && period != 0 && latency > min_latency + period / 2)
+        {
+            // this trigger's frame would have arrived earlier, it was lost
+            atomicAdd(triggers_lost, (uint64_t)1);
+            continue;
+        }
+
+        trigger_latency.record(latency);
+        if (min_latency == 0 || latency < min_latency)
+            atomicStore(min_trigger_latency_us, (uint32_t)(latency ? latency : 1));
+        tail++;
+        break;
+    }
+    atomicStore(trigger_tail, tail);
+}
+
+void CaptureStatistics::setStartupTime(uint32_t startup_time)
+{
+    atomicStore(startup_time_us, startup_time);
+}
+
+void CaptureStatistics::recordRecovery(bool success, uint32_t recovery_time_us)
+{
+    if (success)
+        atomicAdd(recoveries, (uint64_t)1);
+    else
+        atomicAdd(recovery_failures, (uint64_t)1);
+    atomicStore(last_recovery_time_us, recovery_time_us);
+    atomicMax(max_recovery_time_us, recovery_time_us);
+}
+
+void CaptureStatistics::recordDroppedFrames(uint32_t count)
+{
+    atomicAdd(frames_dropped, (uint64_t)count);
+}
+
+void CaptureStatistics::setExactDropCounting(bool enable)
+{
+    exact_drop_counting = enable;
+}
+
+CaptureStats CaptureStatistics::getStats() const
+{
+    CaptureStats stats;
+    stats.frames_dequeued = atomicLoad(frames_dequeued);
+    stats.frames_dropped = atomicLoad(frames_dropped);
+    stats.ring_overruns = atomicLoad(ring_overruns);
+    stats.dequeue_errors = atomicLoad(dequeue_errors);
+    stats.frames_skipped = atomicLoad(frames_skipped);
+    stats.bytes_copied = atomicLoad(bytes_copied);
+    stats.ring_occupancy = atomicLoad(ring_occupancy);
+    stats.ring_occupancy_max = atomicLoad(ring_occupancy_max);
+    stats.ring_size = atomicLoad(ring_size);
+
+    stats.latency_mean_us = latency.getMean();
+    stats.latency_p50_us = latency.getPercentile(0.5);
+    stats.latency_p99_us = latency.getPercentile(0.99);
+    stats.latency_max_us = latency.getMax();
+
+    stats.copy_time_mean_us = copy_time.getMean();
+    stats.copy_time_max_us = copy_time.getMax();
+
+    uint32_t interval = atomicLoad(frame_interval_us);
+    stats.frame_rate = interval ? 1e6 / interval : 0;
+
+    stats.triggers_sent = atomicLoad(triggers_sent);
+    stats.triggers_missed = atomicLoad(triggers_missed);
+    stats.triggers_lost = atomicLoad(triggers_lost);
+    stats.trigger_latency_mean_us = trigger_latency.getMean();
+    stats.trigger_latency_p99_us = trigger_latency.getPercentile(0.99);
+    stats.trigger_latency_max_us = trigger_latency.getMax();
+    stats.startup_time_us = atomicLoad(startup_time_us);
+    stats.recoveries = atomicLoad(recoveries);
+    stats.recovery_failures = atomicLoad(recovery_failures);
+    stats.last_recovery_time_us = atomicLoad(last_recovery_time_us);
+    stats.max_recovery_time_us = atomicLoad(max_recovery_time_us);
+    return stats;
+}
+
+}
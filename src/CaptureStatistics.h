@@ -0,0 +1,220 @@
+/*
+ * File:   CaptureStatistics.h
+ *
+ * Lock-free capture telemetry for CamFireWire.
+ */
+
+#ifndef _CAPTURESTATISTICS_H
+#define	_CAPTURESTATISTICS_H
+
+#include <stdint.h>
+
+namespace camera
+{
+
+/**
+ * Histogram with logarithmic buckets (HDR histogram) for latencies in
+ * microseconds. Values below 64 are stored exactly, larger values with a
+ * relative error below 3%. Buckets are updated with atomic increments,
+ * so the histogram can be read while it is recorded.
+ */
+class LatencyHistogram
+{
+public:
+    enum { PRECISION_BITS = 5,
+           SUB_BUCKETS = 1 << PRECISION_BITS,
+           BUCKET_COUNT = 2 * SUB_BUCKETS + (31 - PRECISION_BITS) * SUB_BUCKETS };
+
+    LatencyHistogram();
+
+    void record(uint32_t value_us);
+    void reset();
+
+    uint64_t getCount() const;
+    uint32_t getMax() const;
+    double getMean() const;
+
+    /**
+     * Returns the value below which the given fraction (0..1) of all
+     * recorded values lies.
+     */
+    uint32_t getPercentile(double fraction) const;
+
+    static int bucketIndex(uint32_t value);
+    static uint32_t bucketValue(int index);
+
+private:
+    uint32_t buckets[BUCKET_COUNT];
+    uint64_t count;
+    uint64_t sum;
+    uint32_t max;
+};
+
+/**
+ * Snapshot of the capture statistics of one camera.
+ */
+struct CaptureStats
+{
+    uint64_t frames_dequeued;
+    // frames which were lost, estimated from gaps between frame timestamps
+    uint64_t frames_dropped;
+    // dequeues which found the DMA ring completely filled
+    uint64_t ring_overruns;
+    uint64_t dequeue_errors;
+    // stale frames which were skipped by RetrieveLatest
+    uint64_t frames_skipped;
+    uint64_t bytes_copied;
+
+    // DMA ring occupancy (frames_behind + 1) at the last dequeue
+    uint32_t ring_occupancy;
+    uint32_t ring_occupancy_max;
+    uint32_t ring_size;
+
+    // time between a successful dequeue and the return of retrieveFrame
+    double latency_mean_us;
+    uint32_t latency_p50_us;
+    uint32_t latency_p99_us;
+    uint32_t latency_max_us;
+
+    // time spent copying/converting the image out of the DMA buffer
+    double copy_time_mean_us;
+    uint32_t copy_time_max_us;
+
+    // frame rate derived from the camera timestamps
+    double frame_rate;
+
+    // software triggers which were sent and which were skipped because
+    // the camera was not ready
+    uint64_t triggers_sent;
+    uint64_t triggers_missed;
+    // triggers which were sent but whose frame never arrived
+    uint64_t triggers_lost;
+    // time between a software trigger and the reception of its frame
+    double trigger_latency_mean_us;
+    uint32_t trigger_latency_p99_us;
+    uint32_t trigger_latency_max_us;
+
+    // duration of the last grab() including the one-push white balance
+    uint32_t startup_time_us;
+
+    // recoveries after capture errors or bus resets and their downtime
+    uint64_t recoveries;
+    uint64_t recovery_failures;
+    uint32_t last_recovery_time_us;
+    uint32_t max_recovery_time_us;
+};
+
+/**
+ * Per-camera capture telemetry. Recording is done by the capture thread
+ * in retrieveFrame, reading (getStats) is possible from any thread at any
+ * time without stopping the capture.
+ */
+class CaptureStatistics
+{
+public:
+    CaptureStatistics();
+
+    void reset();
+
+    /** Sets the number of DMA buffers which were passed to grab() */
+    void setRingSize(uint32_t ring_size);
+
+    /**
+     * Records one successfully dequeued frame.
+     * @param timestamp_us dc1394 timestamp of the frame
+     * @param frames_behind value of dc1394video_frame_t::frames_behind
+     */
+    void recordDequeue(uint64_t timestamp_us, uint32_t frames_behind);
+    void recordDequeueError();
+    void recordSkippedFrames(uint32_t count);
+    void recordCopy(uint32_t bytes, uint32_t copy_time_us);
+    void recordLatency(uint32_t latency_us);
+
+    /**
+     * Records a software trigger, may be called from a trigger thread.
+     * @param trigger_time_us wall clock time of the trigger, like the
+     *                        dc1394 frame timestamps
+     */
+    void recordTrigger(uint64_t trigger_time_us);
+    void recordMissedTrigger();
+
+    /**
+     * Assigns the oldest pending trigger before the frame to the frame
+     * and records the trigger latency. Called by the capture thread.
+     *
+     * A pending trigger is expired as lost when a later trigger also
+     * precedes the frame and the frame arrives more than half a trigger
+     * period later than the smallest latency seen so far, so one lost
+     * frame does not shift the pairing of all later frames.
+     */
+    void matchTrigger(uint64_t frame_timestamp_us);
+
+    /** Records how long it took until the camera delivered frames */
+    void setStartupTime(uint32_t startup_time_us);
+
+    /**
+     * Records a recovery attempt of the RecoverySupervisor.
+     * @param recovery_time_us time from the detection of the error until
+     *                         capture was resumed or given up
+     */
+    void recordRecovery(bool success, uint32_t recovery_time_us);
+
+    /** Adds frames known to be lost (e.g. from an embedded frame counter) */
+    void recordDroppedFrames(uint32_t count);
+
+    /**
+     * When enabled, drops are only counted by recordDroppedFrames and no
+     * longer estimated from the timestamps.
+     */
+    void setExactDropCounting(bool enable);
+
+    CaptureStats getStats() const;
+
+    /** Monotonic clock in microseconds which is used for all durations */
+    static uint64_t now();
+
+private:
+    uint64_t frames_dequeued;
+    uint64_t frames_dropped;
+    uint64_t ring_overruns;
+    uint64_t dequeue_errors;
+    uint64_t frames_skipped;
+    uint64_t bytes_copied;
+    uint32_t ring_occupancy;
+    uint32_t ring_occupancy_max;
+    uint32_t ring_size;
+    uint32_t frame_interval_us;
+
+    // state of the frame interval estimation, only touched by the capture thread
+    uint64_t last_timestamp;
+    double frame_interval;
+    uint32_t interval_samples;
+    bool exact_drop_counting;
+
+    LatencyHistogram latency;
+    LatencyHistogram copy_time;
+
+    // pending software triggers, a single producer single consumer ring
+    enum { MAX_PENDING_TRIGGERS = 64 };
+    uint64_t pending_triggers[MAX_PENDING_TRIGGERS];
+    uint32_t trigger_head;
+    uint32_t trigger_tail;
+    uint64_t triggers_sent;
+    uint64_t triggers_missed;
+    uint64_t triggers_lost;
+    // written by the trigger thread
+    uint64_t last_trigger_time;
+    uint32_t trigger_period_us;
+    // smallest trigger latency, written by the capture thread
+    uint32_t min_trigger_latency_us;
+    LatencyHistogram trigger_latency;
+    uint32_t startup_time_us;
+    uint64_t recoveries;
+    uint64_t recovery_failures;
+    uint32_t last_recovery_time_us;
+    uint32_t max_recovery_time_us;
+};
+
+}
+
+#endif	/* _CAPTURESTATISTICS_H */
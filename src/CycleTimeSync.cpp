@@ -0,0 +1,277 @@
+/*
+ * File:   CycleTimeSync.cpp
+ *
+ * Correlation of the IEEE1394 bus cycle time with the host clock.
+ */
+
+#include "CycleTimeSync.h"
+#include <math.h>
+
+namespace camera
+{
+
+// the cycle timer register wraps after 128 seconds
+static const int64_t TICKS_PER_WRAP = 128LL * CycleTimeSync::TICKS_PER_SECOND;
+
+CycleTimeSync::CycleTimeSync()
+{
+    pthread_mutex_init(&jitter_mutex, NULL);
+    reset();
+}
+
+CycleTimeSync::~CycleTimeSync()
+{
+    pthread_mutex_destroy(&jitter_mutex);
+}
+
+void CycleTimeSync::reset()
+{
+    sample_count = 0;
+    next_sample = 0;
+    last_cycle_ticks = 0;
+    unwrapped_offset = 0;
+    bus_origin = 0;
+    host_origin = 0;
+    host_per_tick = 1e6 / TICKS_PER_SECOND;
+
+    frame_count = 0;
+    frame_next = 0;
+    frame_base = 0;
+    frame_index = 0;
+    frame_period = 0;
+    frame_samples = 0;
+    jitter_square_sum = 0;
+    jitter_max = 0;
+    delay_count = 0;
+    delay_next = 0;
+    last_stamp = 0;
+
+    pthread_mutex_lock(&jitter_mutex);
+    jitter.samples = 0;
+    jitter.clock_skew_ppm = 0;
+    jitter.mapping_rms_us = 0;
+    jitter.frame_jitter_rms_us = 0;
+    jitter.frame_jitter_max_us = 0;
+    jitter.frame_period_us = 0;
+    pthread_mutex_unlock(&jitter_mutex);
+}
+
+uint64_t CycleTimeSync::cycleTimerToTicks(uint32_t cycle_timer)
+{
+    // 7 bit seconds, 13 bit cycles (0..7999), 12 bit offset (0..3071)
+    uint64_t seconds = (cycle_timer >> 25) & 0x7F;
+    uint64_t cycles = (cycle_timer >> 12) & 0x1FFF;
+    uint64_t offset = cycle_timer & 0xFFF;
+    return seconds * TICKS_PER_SECOND + cycles * 3072 + offset;
+}
+
+void CycleTimeSync::addSample(uint32_t cycle_timer, uint64_t local_time_us)
+{
+    uint64_t ticks = cycleTimerToTicks(cycle_timer);
+    if (sample_count > 0 && ticks < last_cycle_ticks)
+        unwrapped_offset += TICKS_PER_WRAP;
+    last_cycle_ticks = ticks;
+
+    bus_ticks[next_sample] = unwrapped_offset + ticks;
+    host_us[next_sample] = local_time_us;
+    next_sample = (next_sample + 1) % MAX_SAMPLES;
+    if (sample_count < MAX_SAMPLES)
+        sample_count++;
+
+    fitMapping();
+}
+
+void CycleTimeSync::fitMapping()
+{
+    // the newest sample is the origin, which keeps the numbers small
+    uint32_t newest = (next_sample + MAX_SAMPLES - 1) % MAX_SAMPLES;
+    bus_origin = bus_ticks[newest];
+    host_origin = host_us[newest];
+    if (sample_count < 2)
+        return;
+
+    double mean_x = 0, mean_y = 0;
+    for (uint32_t i = 0; i < sample_count; i++)
+    {
+        mean_x += bus_ticks[i] - bus_origin;
+        mean_y += host_us[i] - host_origin;
+    }
+    mean_x /= sample_count;
+    mean_y /= sample_count;
+
+    double sxx = 0, sxy = 0;
+    for (uint32_t i = 0; i < sample_count; i++)
+    {
+        double dx = bus_ticks[i] - bus_origin - mean_x;
+        double dy = host_us[i] - host_origin - mean_y;
+        sxx += dx * dx;
+        sxy += dx * dy;
+    }
+    if (sxx <= 0)
+        return;
+    host_per_tick = sxy / sxx;
+
+    // move the origin onto the fitted line
+    double intercept = mean_y - host_per_tick * mean_x;
+    host_origin += (int64_t)floor(intercept + 0.5);
+
+    double square_sum = 0;
+    for (uint32_t i = 0; i < sample_count; i++)
+    {
+        double residual = host_us[i] - host_origin - host_per_tick * (bus_ticks[i] - bus_origin);
+        square_sum += residual * residual;
+    }
+
+    pthread_mutex_lock(&jitter_mutex);
+    jitter.samples = sample_count;
+    jitter.clock_skew_ppm = (host_per_tick * TICKS_PER_SECOND / 1e6 - 1.0) * 1e6;
+    jitter.mapping_rms_us = sqrt(square_sum / sample_count);
+    pthread_mutex_unlock(&jitter_mutex);
+}
+
+bool CycleTimeSync::isValid() const
+{
+    return sample_count >= 2;
+}
+
+int64_t CycleTimeSync::unwrapCycleTimer(uint32_t cycle_timer) const
+{
+    // take the wrap around into account relative to the last sample
+    int64_t delta = (int64_t)cycleTimerToTicks(cycle_timer) - (int64_t)last_cycle_ticks;
+    if (delta > TICKS_PER_WRAP / 2)
+        delta -= TICKS_PER_WRAP;
+    else if (delta < -TICKS_PER_WRAP / 2)
+        delta += TICKS_PER_WRAP;
+    return unwrapped_offset + last_cycle_ticks + delta;
+}
+
+uint64_t CycleTimeSync::busToHost(int64_t bus_ticks) const
+{
+    return host_origin + (int64_t)floor(host_per_tick * (bus_ticks - bus_origin) + 0.5);
+}
+
+uint64_t CycleTimeSync::cycleTimerToHost(uint32_t cycle_timer) const
+{
+    return busToHost(unwrapCycleTimer(cycle_timer));
+}
+
+uint64_t CycleTimeSync::stampFrame(uint32_t cycle_timer, uint64_t receive_time_us)
+{
+    uint64_t stamp = cycleTimerToHost(cycle_timer);
+
+    // the receive delay varies by the jitter, the smallest delay of the
+    // window is taken as the jitter free one
+    delays[delay_next] = (double)receive_time_us - (double)stamp;
+    delay_next = (delay_next + 1) % MAX_FRAMES;
+    if (delay_count < MAX_FRAMES)
+        delay_count++;
+    double min_delay = delays[0];
+    for (uint32_t i = 1; i < delay_count; i++)
+        if (delays[i] < min_delay)
+            min_delay = delays[i];
+
+    double period = last_stamp != 0 && stamp > last_stamp ? stamp - last_stamp : 0;
+    last_stamp = stamp;
+    updateFrameJitter(delays[(delay_next + MAX_FRAMES - 1) % MAX_FRAMES] - min_delay, period);
+    return stamp;
+}
+
+void CycleTimeSync::updateFrameJitter(double error, double period)
+{
+    frame_samples++;
+    jitter_square_sum += error * error;
+    if (error > jitter_max)
+        jitter_max = error;
+
+    pthread_mutex_lock(&jitter_mutex);
+    jitter.frame_jitter_rms_us = sqrt(jitter_square_sum / frame_samples);
+    jitter.frame_jitter_max_us = jitter_max;
+    jitter.frame_period_us = period;
+    pthread_mutex_unlock(&jitter_mutex);
+}
+
+uint64_t CycleTimeSync::correctFrameTime(uint64_t receive_time_us, uint32_t transfer_time_us)
+{
+    double measured = (double)receive_time_us - transfer_time_us;
+
+    if (frame_count > 0)
+    {
+        // number of frame periods since the last frame, > 1 when frames
+        // were dropped or skipped
+        double interval = measured - frame_base - frame_y[(frame_next + MAX_FRAMES - 1) % MAX_FRAMES];
+        double periods = 1;
+        if (frame_period > 0)
+        {
+            periods = floor(interval / frame_period + 0.5);
+            if (periods < 1 || fabs(interval - periods * frame_period) > frame_period / 2)
+            {
+                // the frame does not fit the lattice (e.g. frame rate changed)
+                frame_count = 0;
+                periods = 0;
+            }
+        }
+        else if (interval <= 0)
+        {
+            frame_count = 0;
+            periods = 0;
+        }
+        frame_index += periods;
+    }
+    if (frame_count == 0)
+    {
+        frame_base = measured;
+        frame_index = 0;
+        frame_period = 0;
+        frame_next = 0;
+    }
+
+    frame_x[frame_next] = frame_index;
+    frame_y[frame_next] = measured - frame_base;
+    frame_next = (frame_next + 1) % MAX_FRAMES;
+    if (frame_count < MAX_FRAMES)
+        frame_count++;
+    if (frame_count < 2)
+        return (uint64_t)(measured + 0.5);
+
+    // line through the frames of the window
+    double mean_x = 0, mean_y = 0;
+    for (uint32_t i = 0; i < frame_count; i++)
+    {
+        mean_x += frame_x[i];
+        mean_y += frame_y[i];
+    }
+    mean_x /= frame_count;
+    mean_y /= frame_count;
+    double sxx = 0, sxy = 0;
+    for (uint32_t i = 0; i < frame_count; i++)
+    {
+        sxx += (frame_x[i] - mean_x) * (frame_x[i] - mean_x);
+        sxy += (frame_x[i] - mean_x) * (frame_y[i] - mean_y);
+    }
+    frame_period = sxy / sxx;
+    double intercept = mean_y - frame_period * mean_x;
+
+    // timestamps are only ever delayed by jitter, so the line is moved
+    // down onto the earliest frame of the window
+    double min_residual = 0;
+    for (uint32_t i = 0; i < frame_count; i++)
+    {
+        double residual = frame_y[i] - intercept - frame_period * frame_x[i];
+        if (i == 0 || residual < min_residual)
+            min_residual = residual;
+    }
+    double corrected = intercept + frame_period * frame_index + min_residual;
+    updateFrameJitter(measured - frame_base - corrected, frame_period);
+
+    return (uint64_t)(frame_base + corrected + 0.5);
+}
+
+TimestampJitter CycleTimeSync::getJitter() const
+{
+    pthread_mutex_lock(&jitter_mutex);
+    TimestampJitter result = jitter;
+    pthread_mutex_unlock(&jitter_mutex);
+    return result;
+}
+
+}
@@ -0,0 +1,152 @@
+/*
+ * File:   CycleTimeSync.h
+ *
+ * Correlation of the IEEE1394 bus cycle time with the host clock.
+ */
+
+#ifndef _CYCLETIMESYNC_H
+#define	_CYCLETIMESYNC_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+namespace camera
+{
+
+/**
+ * Quality of the timestamp correction.
+ */
+struct TimestampJitter
+{
+    // number of cycle timer samples used for the clock mapping
+    uint32_t samples;
+    // rate difference between host clock and bus clock
+    double clock_skew_ppm;
+    // residuals of the cycle timer samples against the clock mapping
+    double mapping_rms_us;
+    // raw frame timestamps against the filtered ones
+    double frame_jitter_rms_us;
+    double frame_jitter_max_us;
+    // estimated frame period
+    double frame_period_us;
+};
+
+/**
+ * Maintains a mapping from the 1394 bus cycle time to the host clock and
+ * stamps frames with it.
+ *
+ * The mapping is a least squares line through the last samples of
+ * dc1394_read_cycle_timer, which reads the cycle timer register and the
+ * host clock atomically. Frames which carry the cycle time of their
+ * exposure (embedded frame information) are stamped by converting it
+ * through this line, see stampFrame().
+ *
+ * libdc1394 does not report the isochronous cycle in which a frame was
+ * received, so frames without an embedded cycle time only have the host
+ * receive timestamp. It is only ever delayed by bus and scheduling
+ * jitter, therefore these frames are fitted to a line of constant frame
+ * period which is moved onto the earliest frame of the last MAX_FRAMES
+ * frames, see correctFrameTime(). The cost per frame is bounded by
+ * MAX_FRAMES.
+ */
+class CycleTimeSync
+{
+public:
+    /** Cycle timer ticks per second (24.576 MHz) */
+    static const uint32_t TICKS_PER_SECOND = 24576000;
+    /** Duration of one isochronous cycle in microseconds */
+    static const uint32_t CYCLE_TIME_US = 125;
+    enum { MAX_SAMPLES = 32, MAX_FRAMES = 64 };
+
+    CycleTimeSync();
+    ~CycleTimeSync();
+
+    void reset();
+
+    /**
+     * Adds a sample read by dc1394_read_cycle_timer.
+     * @param cycle_timer content of the CYCLE_TIME register
+     * @param local_time_us host time at which the register was read
+     */
+    void addSample(uint32_t cycle_timer, uint64_t local_time_us);
+
+    /** @return true when at least two samples were added */
+    bool isValid() const;
+
+    /**
+     * Converts a cycle timer value to host time. The value must lie
+     * within +/- 64 s of the last sample, as the register wraps every
+     * 128 s.
+     */
+    uint64_t cycleTimerToHost(uint32_t cycle_timer) const;
+
+    /** Converts unwrapped bus time in ticks to host time with the fitted line */
+    uint64_t busToHost(int64_t bus_ticks) const;
+
+    /**
+     * Stamps a frame with the cycle time embedded by the camera.
+     * @param cycle_timer embedded cycle time of the frame
+     * @param receive_time_us dc1394 timestamp of the frame, only used for
+     *                        the jitter statistics
+     * @return host time of the embedded cycle time
+     */
+    uint64_t stampFrame(uint32_t cycle_timer, uint64_t receive_time_us);
+
+    /**
+     * Filters the receive timestamp of a frame without embedded cycle
+     * time.
+     * @param receive_time_us dc1394 timestamp of the frame
+     * @param transfer_time_us nominal time needed to transfer the frame,
+     *                         the result is moved back by this duration
+     * @return corrected host time of the start of the transfer
+     */
+    uint64_t correctFrameTime(uint64_t receive_time_us, uint32_t transfer_time_us);
+
+    TimestampJitter getJitter() const;
+
+    /** Converts a register value to ticks within the 128 s period */
+    static uint64_t cycleTimerToTicks(uint32_t cycle_timer);
+
+private:
+    void fitMapping();
+    /** Unwraps a register value relative to the last sample */
+    int64_t unwrapCycleTimer(uint32_t cycle_timer) const;
+    void updateFrameJitter(double error, double period);
+
+    // cycle timer samples, bus time unwrapped to ticks
+    int64_t bus_ticks[MAX_SAMPLES];
+    int64_t host_us[MAX_SAMPLES];
+    uint32_t sample_count;
+    uint32_t next_sample;
+    uint64_t last_cycle_ticks;
+    int64_t unwrapped_offset;
+
+    // host_us = host_origin + host_per_tick * (bus_ticks - bus_origin)
+    int64_t bus_origin;
+    int64_t host_origin;
+    double host_per_tick;
+
+    // frame timestamp filter, frame_y is relative to frame_base
+    double frame_x[MAX_FRAMES];
+    double frame_y[MAX_FRAMES];
+    uint32_t frame_count;
+    uint32_t frame_next;
+    double frame_base;
+    double frame_index;
+    double frame_period;
+    uint32_t frame_samples;
+    double jitter_square_sum;
+    double jitter_max;
+    // stampFrame(): receive delays of the last frames and the last stamp
+    double delays[MAX_FRAMES];
+    uint32_t delay_count;
+    uint32_t delay_next;
+    uint64_t last_stamp;
+
+    TimestampJitter jitter;
+    mutable pthread_mutex_t jitter_mutex;
+};
+
+}
+
+#endif	/* _CYCLETIMESYNC_H */
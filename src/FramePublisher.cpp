@@ -0,0 +1,363 @@
+/*
+ * File:   FramePublisher.cpp
+ *
+ * Reference counted fan-out of captured frames to several consumers.
+ */
+
+#include "FramePublisher.h"
+#include "CamFireWire.h"
+#include <algorithm>
+#include <errno.h>
+#include <time.h>
+
+using namespace base::samples::frame;
+
+namespace camera
+{
+
+// absolute CLOCK_REALTIME deadline for pthread_cond_timedwait
+static timespec deadlineIn(int timeout_ms)
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+FrameRef::FrameRef()
+    : slot(NULL)
+{
+}
+
+FrameRef::FrameRef(PooledFrame *slot)
+    : slot(slot)
+{
+}
+
+FrameRef::FrameRef(const FrameRef &other)
+    : slot(other.slot)
+{
+    if (slot)
+        FramePublisher::addRef(slot);
+}
+
+FrameRef &FrameRef::operator=(const FrameRef &other)
+{
+    if (other.slot)
+        FramePublisher::addRef(other.slot);
+    release();
+    slot = other.slot;
+    return *this;
+}
+
+FrameRef::~FrameRef()
+{
+    release();
+}
+
+bool FrameRef::isValid() const
+{
+    return slot != NULL;
+}
+
+void FrameRef::release()
+{
+    if (slot)
+        FramePublisher::releaseRef(slot);
+    slot = NULL;
+}
+
+const Frame &FrameRef::operator*() const
+{
+    return slot->frame;
+}
+
+const Frame *FrameRef::operator->() const
+{
+    return &slot->frame;
+}
+
+FrameSubscription::FrameSubscription(SubscriberPolicy policy, uint32_t depth, int block_timeout_ms)
+    : policy(policy), depth(policy == SubscribeLatestOnly || depth == 0 ? 1 : depth),
+      block_timeout_ms(block_timeout_ms), dropped(0)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&not_empty, NULL);
+    pthread_cond_init(&not_full, NULL);
+}
+
+FrameSubscription::~FrameSubscription()
+{
+    clear();
+    pthread_cond_destroy(&not_full);
+    pthread_cond_destroy(&not_empty);
+    pthread_mutex_destroy(&mutex);
+}
+
+void FrameSubscription::clear()
+{
+    pthread_mutex_lock(&mutex);
+    std::deque<PooledFrame *> queued;
+    queued.swap(queue);
+    pthread_cond_broadcast(&not_full);
+    pthread_mutex_unlock(&mutex);
+
+    for (size_t i = 0; i < queued.size(); i++)
+        FramePublisher::releaseRef(queued[i]);
+}
+
+void FrameSubscription::push(PooledFrame *slot)
+{
+    PooledFrame *evicted = NULL;
+    FramePublisher::addRef(slot);
+
+    pthread_mutex_lock(&mutex);
+    if (queue.size() >= depth && policy == SubscribeBlock)
+    {
+        timespec deadline = deadlineIn(block_timeout_ms);
+        while (queue.size() >= depth)
+        {
+            if (pthread_cond_timedwait(&not_full, &mutex, &deadline) == ETIMEDOUT)
+                break;
+        }
+    }
+
+    if (queue.size() >= depth)
+    {
+        dropped++;
+        if (policy == SubscribeBlock)
+            evicted = slot;
+        else
+        {
+            evicted = queue.front();
+            queue.pop_front();
+        }
+    }
+    if (evicted != slot)
+    {
+        queue.push_back(slot);
+        pthread_cond_signal(&not_empty);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    // releasing may recycle the buffer, which takes the pool lock
+    if (evicted)
+        FramePublisher::releaseRef(evicted);
+}
+
+bool FrameSubscription::pop(FrameRef &frame, int timeout_ms)
+{
+    pthread_mutex_lock(&mutex);
+    if (timeout_ms < 0)
+    {
+        while (queue.empty())
+            pthread_cond_wait(&not_empty, &mutex);
+    }
+    else if (queue.empty() && timeout_ms > 0)
+    {
+        timespec deadline = deadlineIn(timeout_ms);
+        while (queue.empty())
+        {
+            if (pthread_cond_timedwait(&not_empty, &mutex, &deadline) == ETIMEDOUT)
+                break;
+        }
+    }
+    if (queue.empty())
+    {
+        pthread_mutex_unlock(&mutex);
+        return false;
+    }
+
+    // the queue's reference is handed over to the caller
+    PooledFrame *slot = queue.front();
+    queue.pop_front();
+    pthread_cond_signal(&not_full);
+    pthread_mutex_unlock(&mutex);
+
+    frame.release();
+    frame.slot = slot;
+    return true;
+}
+
+SubscriberPolicy FrameSubscription::getPolicy() const
+{
+    return policy;
+}
+
+uint32_t FrameSubscription::getQueued() const
+{
+    pthread_mutex_lock(&mutex);
+    uint32_t count = queue.size();
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
+
+uint64_t FrameSubscription::getDropped() const
+{
+    pthread_mutex_lock(&mutex);
+    uint64_t count = dropped;
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
+
+FramePublisher::FramePublisher(CamFireWire &camera, uint32_t pool_limit)
+    : camera(camera), pool_limit(pool_limit ? pool_limit : 1), pool_exhausted(0), published(0)
+{
+    pthread_mutex_init(&pool_mutex, NULL);
+    pthread_mutex_init(&subscription_mutex, NULL);
+    pthread_mutex_init(&distribute_mutex, NULL);
+}
+
+FramePublisher::~FramePublisher()
+{
+    for (size_t i = 0; i < subscriptions.size(); i++)
+        delete subscriptions[i];
+    for (size_t i = 0; i < pool.size(); i++)
+        delete pool[i];
+    pthread_mutex_destroy(&distribute_mutex);
+    pthread_mutex_destroy(&subscription_mutex);
+    pthread_mutex_destroy(&pool_mutex);
+}
+
+FrameSubscription *FramePublisher::subscribe(SubscriberPolicy policy, uint32_t depth, int block_timeout_ms)
+{
+    FrameSubscription *subscription = new FrameSubscription(policy, depth, block_timeout_ms);
+    pthread_mutex_lock(&subscription_mutex);
+    subscriptions.push_back(subscription);
+    pthread_mutex_unlock(&subscription_mutex);
+    return subscription;
+}
+
+void FramePublisher::unsubscribe(FrameSubscription *subscription)
+{
+    pthread_mutex_lock(&subscription_mutex);
+    std::vector<FrameSubscription *>::iterator it =
+        std::find(subscriptions.begin(), subscriptions.end(), subscription);
+    bool found = it != subscriptions.end();
+    if (found)
+        subscriptions.erase(it);
+    pthread_mutex_unlock(&subscription_mutex);
+    if (!found)
+        return;
+
+    // a frame which is being pushed may still target the subscription
+    pthread_mutex_lock(&distribute_mutex);
+    pthread_mutex_unlock(&distribute_mutex);
+    delete subscription;
+}
+
+void FramePublisher::addRef(PooledFrame *slot)
+{
+    __sync_fetch_and_add(&slot->refs, 1);
+}
+
+void FramePublisher::releaseRef(PooledFrame *slot)
+{
+    if (__sync_sub_and_fetch(&slot->refs, 1) == 0)
+        slot->owner->recycle(slot);
+}
+
+void FramePublisher::recycle(PooledFrame *slot)
+{
+    pthread_mutex_lock(&pool_mutex);
+    free_slots.push_back(slot);
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+PooledFrame *FramePublisher::acquire()
+{
+    PooledFrame *slot = NULL;
+    pthread_mutex_lock(&pool_mutex);
+    if (!free_slots.empty())
+    {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    }
+    else if (pool.size() < pool_limit)
+    {
+        slot = new PooledFrame;
+        slot->owner = this;
+        pool.push_back(slot);
+        // reserved once, so recycle() never allocates
+        free_slots.reserve(pool_limit);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    if (slot)
+        slot->refs = 1;
+    return slot;
+}
+
+void FramePublisher::distribute(PooledFrame *slot)
+{
+    // a blocking push must not hold the subscription lock, only the
+    // first frame after a new subscriber may allocate here
+    pthread_mutex_lock(&distribute_mutex);
+    pthread_mutex_lock(&subscription_mutex);
+    targets.assign(subscriptions.begin(), subscriptions.end());
+    pthread_mutex_unlock(&subscription_mutex);
+    for (size_t i = 0; i < targets.size(); i++)
+        targets[i]->push(slot);
+    pthread_mutex_unlock(&distribute_mutex);
+
+    __sync_fetch_and_add(&published, 1);
+    releaseRef(slot);
+}
+
+bool FramePublisher::retrieve(int timeout)
+{
+    PooledFrame *slot = acquire();
+    if (!slot)
+    {
+        // the frame still has to leave the DMA ring
+        __sync_fetch_and_add(&pool_exhausted, 1);
+        camera.retrieveFrame(spare, timeout);
+        return false;
+    }
+
+    if (!camera.retrieveFrame(slot->frame, timeout))
+    {
+        releaseRef(slot);
+        return false;
+    }
+    distribute(slot);
+    return true;
+}
+
+bool FramePublisher::publish(const Frame &frame)
+{
+    PooledFrame *slot = acquire();
+    if (!slot)
+    {
+        __sync_fetch_and_add(&pool_exhausted, 1);
+        return false;
+    }
+    slot->frame.init(frame, true);
+    distribute(slot);
+    return true;
+}
+
+uint32_t FramePublisher::getPoolSize() const
+{
+    pthread_mutex_lock(const_cast<pthread_mutex_t *>(&pool_mutex));
+    uint32_t size = pool.size();
+    pthread_mutex_unlock(const_cast<pthread_mutex_t *>(&pool_mutex));
+    return size;
+}
+
+uint64_t FramePublisher::getPoolExhausted() const
+{
+    return __sync_fetch_and_add(const_cast<uint64_t *>(&pool_exhausted), 0);
+}
+
+uint64_t FramePublisher::getPublished() const
+{
+    return __sync_fetch_and_add(const_cast<uint64_t *>(&published), 0);
+}
+
+}
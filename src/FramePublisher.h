@@ -0,0 +1,194 @@
+/*
+ * File:   FramePublisher.h
+ *
+ * Reference counted fan-out of captured frames to several consumers.
+ */
+
+#ifndef _FRAMEPUBLISHER_H
+#define	_FRAMEPUBLISHER_H
+
+#include <deque>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include "base/samples/Frame.hpp"
+
+namespace camera
+{
+
+class CamFireWire;
+class FramePublisher;
+
+/**
+ * Defines what happens with a frame for a subscriber whose queue is full.
+ */
+enum SubscriberPolicy
+{
+    // wait up to the block timeout for the subscriber, then drop the frame
+    SubscribeBlock,
+    // drop the oldest queued frame
+    SubscribeDropOldest,
+    // keep only the newest frame (queue depth 1)
+    SubscribeLatestOnly
+};
+
+/**
+ * Buffer of the pool of a FramePublisher.
+ */
+struct PooledFrame
+{
+    base::samples::frame::Frame frame;
+    int refs;
+    FramePublisher *owner;
+};
+
+/**
+ * Shared read-only reference to a published frame. Copying the reference
+ * does not copy the image, the buffer goes back to the pool when the last
+ * reference is released. References may be released from any thread,
+ * but must not outlive their publisher.
+ */
+class FrameRef
+{
+public:
+    FrameRef();
+    FrameRef(const FrameRef &other);
+    FrameRef &operator=(const FrameRef &other);
+    ~FrameRef();
+
+    bool isValid() const;
+    void release();
+
+    const base::samples::frame::Frame &operator*() const;
+    const base::samples::frame::Frame *operator->() const;
+
+private:
+    friend class FramePublisher;
+    friend class FrameSubscription;
+    explicit FrameRef(PooledFrame *slot);
+
+    PooledFrame *slot;
+};
+
+/**
+ * Queue of one subscriber, created by FramePublisher::subscribe().
+ */
+class FrameSubscription
+{
+public:
+    /**
+     * Takes the oldest queued frame.
+     * @param timeout_ms time to wait for a frame, 0 does not wait and a
+     *                   negative value waits until a frame arrives
+     * @return false if no frame arrived within the timeout
+     */
+    bool pop(FrameRef &frame, int timeout_ms = -1);
+
+    SubscriberPolicy getPolicy() const;
+    uint32_t getQueued() const;
+    /** Frames which were dropped for this subscriber */
+    uint64_t getDropped() const;
+
+private:
+    friend class FramePublisher;
+    FrameSubscription(SubscriberPolicy policy, uint32_t depth, int block_timeout_ms);
+    ~FrameSubscription();
+
+    void push(PooledFrame *slot);
+    void clear();
+
+    SubscriberPolicy policy;
+    uint32_t depth;
+    int block_timeout_ms;
+    std::deque<PooledFrame *> queue;
+    uint64_t dropped;
+    mutable pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+/**
+ * Hands out the frames of a camera to several subscribers without
+ * copying them.
+ *
+ * retrieve() captures into a free buffer of a pool and queues a
+ * reference to it for every subscriber, so the image is copied exactly
+ * once, out of the DMA ring. Every subscriber has its own queue and drop
+ * policy, so a slow subscriber only loses frames itself. The frame is
+ * pushed to the subscribers one after the other without holding the
+ * subscription lock, so a blocking subscriber stalls neither subscribe()
+ * nor the other getters. The capture thread is stalled at most for the
+ * sum of the block timeouts of the blocking subscribers whose queues are
+ * full, and unsubscribe() waits for a frame which is being pushed.
+ *
+ * The pool grows on demand up to its limit and is not freed before the
+ * publisher is destroyed, so no allocation happens once every buffer has
+ * been used. When all buffers are referenced, the frame is retrieved into
+ * a spare buffer and not published.
+ */
+class FramePublisher
+{
+public:
+    /**
+     * @param pool_limit maximum number of buffers, should be at least the
+     *                   sum of the queue depths plus one per subscriber
+     *                   and one for the capture
+     */
+    explicit FramePublisher(CamFireWire &camera, uint32_t pool_limit = 16);
+    ~FramePublisher();
+
+    /**
+     * Adds a subscriber, can be called while publishing.
+     * @param depth queue depth, ignored for SubscribeLatestOnly
+     * @param block_timeout_ms wait of SubscribeBlock for a full queue
+     */
+    FrameSubscription *subscribe(SubscriberPolicy policy, uint32_t depth = 4, int block_timeout_ms = 10);
+    /** Removes and deletes the subscription, queued frames are released */
+    void unsubscribe(FrameSubscription *subscription);
+
+    /**
+     * Retrieves a frame from the camera (see CamFireWire::retrieveFrame)
+     * and publishes it.
+     */
+    bool retrieve(int timeout);
+
+    /** Publishes a copy of the frame, for sources other than a camera */
+    bool publish(const base::samples::frame::Frame &frame);
+
+    /** Buffers allocated so far */
+    uint32_t getPoolSize() const;
+    /** Frames which were not published because the pool was exhausted */
+    uint64_t getPoolExhausted() const;
+    uint64_t getPublished() const;
+
+private:
+    friend class FrameRef;
+    friend class FrameSubscription;
+    PooledFrame *acquire();
+    void distribute(PooledFrame *slot);
+    static void addRef(PooledFrame *slot);
+    static void releaseRef(PooledFrame *slot);
+    void recycle(PooledFrame *slot);
+
+    CamFireWire &camera;
+    uint32_t pool_limit;
+    std::vector<PooledFrame *> pool;
+    std::vector<PooledFrame *> free_slots;
+    pthread_mutex_t pool_mutex;
+    // target of retrieve() when the pool is exhausted
+    base::samples::frame::Frame spare;
+
+    std::vector<FrameSubscription *> subscriptions;
+    pthread_mutex_t subscription_mutex;
+    // held while a frame is pushed, guards targets
+    pthread_mutex_t distribute_mutex;
+    // copy of subscriptions for the push, keeps its capacity
+    std::vector<FrameSubscription *> targets;
+
+    uint64_t pool_exhausted;
+    uint64_t published;
+};
+
+}
+
+#endif	/* _FRAMEPUBLISHER_H */
@@ -0,0 +1,172 @@
+/*
+ * File:   FrameRecorder.cpp
+ *
+ * Sequential recording of frames into a file.
+ */
+
+#include "FrameRecorder.h"
+#include <base-logging/Logging.hpp>
+#include <string.h>
+#include <errno.h>
+
+using namespace base::samples::frame;
+
+namespace camera
+{
+
+static const char SIGNATURE[8] = { 'F', 'W', 'R', 'E', 'C', '0', '0', '1' };
+// stdio buffer, large writes go to the file directly anyway
+static const size_t FILE_BUFFER_SIZE = 1 << 20;
+
+FrameRecorder::FrameRecorder()
+    : file(NULL), codec(RecordHeader::CodecRaw),
+      frames_written(0), bytes_written(0), image_bytes(0)
+{
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    close();
+}
+
+bool FrameRecorder::open(const std::string &path)
+{
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        LOG_ERROR_S << "FrameRecorder: cannot open " << path << ": " << strerror(errno);
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, FILE_BUFFER_SIZE);
+    frames_written = 0;
+    bytes_written = 0;
+    image_bytes = 0;
+    if (fwrite(SIGNATURE, sizeof(SIGNATURE), 1, file) != 1)
+    {
+        close();
+        return false;
+    }
+    bytes_written = sizeof(SIGNATURE);
+    return true;
+}
+
+void FrameRecorder::setCodec(RecordHeader::Codec value, unsigned threads)
+{
+    codec = value;
+    bayer_codec.setThreads(threads);
+}
+
+void FrameRecorder::close()
+{
+    if (!file)
+        return;
+    fclose(file);
+    file = NULL;
+}
+
+bool FrameRecorder::isOpen() const
+{
+    return file != NULL;
+}
+
+bool FrameRecorder::write(const Frame &frame)
+{
+    if (!file)
+        return false;
+
+    RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = RecordHeader::MAGIC;
+    header.width = frame.getWidth();
+    header.height = frame.getHeight();
+    header.data_depth = frame.getDataDepth();
+    header.codec = RecordHeader::CodecRaw;
+    header.frame_mode = frame.getFrameMode();
+    header.image_bytes = frame.getNumberOfBytes();
+    header.payload_bytes = header.image_bytes;
+    header.time_us = frame.time.toMicroseconds();
+
+    const uint8_t *payload = frame.getImageConstPtr();
+    if (codec == RecordHeader::CodecBayerRice && filter::BayerCodec::isSupported(frame) &&
+        bayer_codec.encode(frame, encoded) && encoded.size() < header.image_bytes)
+    {
+        header.codec = RecordHeader::CodecBayerRice;
+        header.payload_bytes = encoded.size();
+        payload = &encoded[0];
+    }
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(payload, header.payload_bytes, 1, file) != 1)
+    {
+        LOG_ERROR_S << "FrameRecorder: write failed: " << strerror(errno);
+        return false;
+    }
+    frames_written++;
+    bytes_written += sizeof(header) + header.payload_bytes;
+    image_bytes += header.image_bytes;
+    return true;
+}
+
+uint64_t FrameRecorder::getFramesWritten() const
+{
+    return frames_written;
+}
+
+uint64_t FrameRecorder::getBytesWritten() const
+{
+    return bytes_written;
+}
+
+uint64_t FrameRecorder::getImageBytes() const
+{
+    return image_bytes;
+}
+
+FILE *FrameRecorder::openRecording(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return NULL;
+    char signature[sizeof(SIGNATURE)];
+    if (fread(signature, sizeof(signature), 1, file) != 1 || memcmp(signature, SIGNATURE, sizeof(SIGNATURE)) != 0)
+    {
+        fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+bool FrameRecorder::read(FILE *file, Frame &frame)
+{
+    RecordHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != RecordHeader::MAGIC)
+        return false;
+
+    if (header.codec == RecordHeader::CodecBayerRice)
+    {
+        filter::BayerCodec decoder(1);
+        std::vector<uint8_t> payload(header.payload_bytes);
+        if (payload.empty() || fread(&payload[0], payload.size(), 1, file) != 1 ||
+            !decoder.decode(&payload[0], payload.size(), frame) ||
+            frame.getNumberOfBytes() != header.image_bytes)
+            return false;
+    }
+    else if (header.codec == RecordHeader::CodecRaw && header.payload_bytes == header.image_bytes)
+    {
+        frame.init(header.width, header.height, header.data_depth, (frame_mode_t)header.frame_mode);
+        if (frame.getNumberOfBytes() != header.image_bytes ||
+            fread(frame.getImagePtr(), header.image_bytes, 1, file) != 1)
+            return false;
+    }
+    else
+    {
+        LOG_ERROR_S << "FrameRecorder: unknown codec " << (int)header.codec;
+        return false;
+    }
+    frame.time = base::Time::fromMicroseconds(header.time_us);
+    frame.setStatus(STATUS_VALID);
+    return true;
+}
+
+}
@@ -0,0 +1,94 @@
+/*
+ * File:   FrameRecorder.h
+ *
+ * Sequential recording of frames into a file.
+ */
+
+#ifndef _FRAMERECORDER_H
+#define	_FRAMERECORDER_H
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include "base/samples/Frame.hpp"
+#include "filter/bayer_codec.h"
+
+namespace camera
+{
+
+/**
+ * Header in front of every frame of a recording. The file starts with
+ * the 8 byte signature "FWREC001".
+ */
+struct RecordHeader
+{
+    enum { MAGIC = 0x4d415246 };
+    enum Codec { CodecRaw = 0, CodecBayerRice = 1 };
+
+    uint32_t magic;
+    uint16_t width;
+    uint16_t height;
+    uint8_t data_depth;
+    uint8_t codec;
+    uint16_t frame_mode;
+    // size of the image after the header, encoded if codec != CodecRaw
+    uint32_t payload_bytes;
+    // size of the decoded image
+    uint32_t image_bytes;
+    int64_t time_us;
+};
+
+/**
+ * Writes frames with their geometry and timestamp into a file and reads
+ * them back. Writing is not thread safe, a recorder is fed from one
+ * thread.
+ */
+class FrameRecorder
+{
+public:
+    FrameRecorder();
+    ~FrameRecorder();
+
+    bool open(const std::string &path);
+
+    /**
+     * Compression of the frames written from now on. CodecBayerRice
+     * (filter::BayerCodec) codes single channel 8 and 16 bit frames on
+     * the given number of threads (0 uses all cores), other frames and
+     * frames which do not get smaller are written raw. The encoder
+     * threads are started once and belong to this recorder.
+     */
+    void setCodec(RecordHeader::Codec codec, unsigned threads = 0);
+    void close();
+    bool isOpen() const;
+
+    bool write(const base::samples::frame::Frame &frame);
+
+    uint64_t getFramesWritten() const;
+    /** Bytes written including the headers */
+    uint64_t getBytesWritten() const;
+
+    /** Image bytes of the frames before compression */
+    uint64_t getImageBytes() const;
+
+    /** Reads the next frame of a recording written by FrameRecorder,
+     * compressed frames are decoded on the calling thread
+     */
+    static bool read(FILE *file, base::samples::frame::Frame &frame);
+    /** Opens a recording and checks its signature */
+    static FILE *openRecording(const std::string &path);
+
+private:
+    FILE *file;
+    RecordHeader::Codec codec;
+    filter::BayerCodec bayer_codec;
+    std::vector<uint8_t> encoded;
+    uint64_t frames_written;
+    uint64_t bytes_written;
+    uint64_t image_bytes;
+};
+
+}
+
+#endif	/* _FRAMERECORDER_H */
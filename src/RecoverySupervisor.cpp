@@ -0,0 +1,135 @@
+/*
+ * File:   RecoverySupervisor.cpp
+ *
+ * Recovery of a capturing camera after capture errors and bus resets.
+ */
+
+#include "RecoverySupervisor.h"
+#include "CamFireWire.h"
+#include <base-logging/Logging.hpp>
+
+namespace camera
+{
+
+// backoff between recovery attempts
+static const uint32_t MIN_BACKOFF_US = 50000;
+static const uint32_t MAX_BACKOFF_US = 1000000;
+
+RecoverySupervisor::RecoverySupervisor(CamFireWire &camera)
+    : camera(camera), error_threshold(3), check_interval_us(500000), max_attempts(10),
+      consecutive_errors(0), last_check(0), failed(false),
+      recovering(false), attempts(0), backoff_us(0), recovery_start(0), next_attempt(0)
+{
+}
+
+void RecoverySupervisor::setErrorThreshold(uint32_t errors)
+{
+    error_threshold = errors ? errors : 1;
+}
+
+void RecoverySupervisor::setCheckInterval(uint32_t interval_ms)
+{
+    check_interval_us = interval_ms * 1000;
+}
+
+void RecoverySupervisor::setMaxAttempts(uint32_t attempts)
+{
+    max_attempts = attempts ? attempts : 1;
+}
+
+bool RecoverySupervisor::update(FrameResult result)
+{
+    if (failed)
+        return false;
+    if (recovering)
+        return attemptRecovery();
+
+    if (result == FrameOk)
+        consecutive_errors = 0;
+    else if (result == FrameError)
+        consecutive_errors++;
+    if (consecutive_errors >= error_threshold)
+    {
+        LOG_WARN_S << "RecoverySupervisor: " << consecutive_errors << " consecutive frame errors";
+        return recover();
+    }
+
+    uint64_t now = CaptureStatistics::now();
+    if (now - last_check < check_interval_us)
+        return true;
+    last_check = now;
+
+    if (camera.hasBusReset())
+    {
+        LOG_WARN_S << "RecoverySupervisor: bus reset detected";
+        return recover();
+    }
+
+    // enum and double attributes are not tracked one by one, the snapshot
+    // is read again while the camera is known to be healthy
+    if (result == FrameOk && camera.settings_changed)
+        camera.snapshotSettings();
+    return true;
+}
+
+bool RecoverySupervisor::recover()
+{
+    recovering = true;
+    failed = false;
+    attempts = 0;
+    backoff_us = MIN_BACKOFF_US;
+    recovery_start = CaptureStatistics::now();
+    next_attempt = recovery_start;
+    return attemptRecovery();
+}
+
+bool RecoverySupervisor::attemptRecovery()
+{
+    uint64_t now = CaptureStatistics::now();
+    if (now < next_attempt)
+        return false;
+
+    // a restart is enough after most bus resets, the node is only
+    // gone when the camera was unplugged or lost power
+    attempts++;
+    bool success = camera.restartCapture();
+    if (!success)
+    {
+        LOG_INFO_S << "RecoverySupervisor: restart failed, reopening the camera (attempt "
+                   << attempts << ")";
+        success = camera.reopen();
+    }
+
+    now = CaptureStatistics::now();
+    if (!success && attempts < max_attempts)
+    {
+        next_attempt = now + backoff_us;
+        backoff_us = backoff_us * 2 > MAX_BACKOFF_US ? MAX_BACKOFF_US : backoff_us * 2;
+        return false;
+    }
+
+    const uint32_t duration = now - recovery_start;
+    camera.capture_stats.recordRecovery(success, duration);
+    recovering = false;
+    consecutive_errors = 0;
+    last_check = now;
+    failed = !success;
+
+    if (success)
+        LOG_INFO_S << "RecoverySupervisor: capture resumed after " << duration / 1000 << " ms";
+    else
+        LOG_ERROR_S << "RecoverySupervisor: giving up after " << max_attempts << " attempts";
+    return success;
+}
+
+bool RecoverySupervisor::isRecovering() const
+{
+    return recovering;
+}
+
+bool RecoverySupervisor::isFailed() const
+{
+    return failed;
+}
+
+}
@@ -0,0 +1,95 @@
+/*
+ * File:   RecoverySupervisor.h
+ *
+ * Recovery of a capturing camera after capture errors and bus resets.
+ */
+
+#ifndef _RECOVERYSUPERVISOR_H
+#define	_RECOVERYSUPERVISOR_H
+
+#include <stdint.h>
+
+namespace camera
+{
+
+class CamFireWire;
+
+/**
+ * Watches a capturing camera and resumes capturing after errors.
+ *
+ * update() is called once per retrieveFrame() with its result. After
+ * error_threshold consecutive errors, or when the bus generation changed
+ * (polled every check_interval ms), a recovery starts: it first restarts
+ * capturing on the existing handle and, if that fails, frees the camera,
+ * opens it again by its guid and restores the settings of the last
+ * snapshot. The capture thread is never put to sleep, each update() during
+ * a recovery makes at most one attempt and the attempts are spaced by an
+ * exponential backoff, up to max_attempts times. Recoveries and their
+ * durations are reported in the CaptureStats of the camera.
+ */
+class RecoverySupervisor
+{
+public:
+    /** Result of a retrieveFrame() call */
+    enum FrameResult
+    {
+        // a frame was delivered
+        FrameOk,
+        // the ring was empty, which is no error in the realtime mode
+        FrameMissing,
+        // the frame could not be dequeued or the camera is gone
+        FrameError
+    };
+
+    explicit RecoverySupervisor(CamFireWire &camera);
+
+    /** Consecutive frame errors which trigger a recovery (default 3) */
+    void setErrorThreshold(uint32_t errors);
+    /** Interval in ms in which the bus generation is polled (default 500) */
+    void setCheckInterval(uint32_t interval_ms);
+    /** Attempts before the camera is given up (default 10) */
+    void setMaxAttempts(uint32_t attempts);
+
+    /**
+     * Tracks the result of the last retrieveFrame() and recovers the
+     * camera when necessary. In the realtime mode retrieveFrame() also
+     * returns false for an empty ring, which is FrameMissing if the
+     * dequeue_errors of the CaptureStats did not grow.
+     * @return true if capturing is running, false while recovering or
+     * after the recovery gave up
+     */
+    bool update(FrameResult result);
+
+    /** Starts a recovery and makes its first attempt right away */
+    bool recover();
+
+    /** True while a recovery waits for its next attempt */
+    bool isRecovering() const;
+
+    /** True if the last recovery gave up */
+    bool isFailed() const;
+
+private:
+    /** Makes the next recovery attempt once its backoff has passed */
+    bool attemptRecovery();
+
+    CamFireWire &camera;
+    uint32_t error_threshold;
+    uint32_t check_interval_us;
+    uint32_t max_attempts;
+
+    uint32_t consecutive_errors;
+    uint64_t last_check;
+    bool failed;
+
+    // state of the running recovery
+    bool recovering;
+    uint32_t attempts;
+    uint32_t backoff_us;
+    uint64_t recovery_start;
+    uint64_t next_attempt;
+};
+
+}
+
+#endif	/* _RECOVERYSUPERVISOR_H */
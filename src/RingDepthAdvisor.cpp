@@ -0,0 +1,156 @@
+/*
+ * File:   RingDepthAdvisor.cpp
+ *
+ * Recommendation of the DMA ring depth from the consumer lag.
+ */
+
+#include "RingDepthAdvisor.h"
+#include <stdexcept>
+#include <math.h>
+
+namespace camera
+{
+
+RingDepthAdvisor::RingDepthAdvisor()
+    : min_depth(3), max_depth(64), window(300), margin(2), shrink_windows(3)
+{
+    reset();
+}
+
+void RingDepthAdvisor::reset()
+{
+    last_timestamp = 0;
+    last_retrieve = 0;
+    frame_period = 0;
+    window_frames = 0;
+    window_occupancy = 0;
+    window_lag = 0;
+    calm_windows = 0;
+    shrink_target = 0;
+    peak_occupancy = 0;
+    peak_lag = 0;
+    recommended = 0;
+}
+
+void RingDepthAdvisor::setLimits(uint32_t min, uint32_t max)
+{
+    if (min < 2 || max < min)
+        throw std::runtime_error("RingDepthAdvisor: invalid ring depth limits!");
+    min_depth = min;
+    max_depth = max;
+}
+
+void RingDepthAdvisor::setWindow(uint32_t frames)
+{
+    window = frames ? frames : 1;
+}
+
+void RingDepthAdvisor::setMargin(uint32_t buffers)
+{
+    margin = buffers;
+}
+
+void RingDepthAdvisor::setShrinkWindows(uint32_t windows)
+{
+    shrink_windows = windows ? windows : 1;
+}
+
+uint32_t RingDepthAdvisor::clamp(uint32_t depth) const
+{
+    if (depth < min_depth)
+        return min_depth;
+    if (depth > max_depth)
+        return max_depth;
+    return depth;
+}
+
+bool RingDepthAdvisor::record(uint64_t timestamp_us, uint32_t frames_behind, uint32_t ring_size, uint64_t now_us)
+{
+    // a ring outside the limits is kept until a window measured the need
+    if (recommended == 0)
+        recommended = ring_size;
+
+    // frame period from consecutive frames, which are never reordered
+    if (last_timestamp != 0 && timestamp_us > last_timestamp)
+    {
+        double interval = timestamp_us - last_timestamp;
+        if (frame_period == 0 || interval < frame_period * 1.5)
+            frame_period = frame_period == 0 ? interval : frame_period + (interval - frame_period) * 0.05;
+    }
+    last_timestamp = timestamp_us;
+
+    // frames the camera delivered while the consumer was away
+    uint32_t lag = 0;
+    if (last_retrieve != 0 && frame_period > 0)
+        lag = (uint32_t)ceil((now_us - last_retrieve) / frame_period);
+    last_retrieve = now_us;
+
+    const uint32_t occupancy = frames_behind + 1;
+    if (occupancy > window_occupancy)
+        window_occupancy = occupancy;
+    if (lag > window_lag)
+        window_lag = lag;
+
+    // a full ring has most likely dropped frames already
+    if (occupancy >= ring_size)
+    {
+        uint32_t grown = clamp(ring_size * 2);
+        recommended = grown > ring_size ? grown : ring_size;
+        calm_windows = 0;
+        window_frames = 0;
+        window_occupancy = 0;
+        window_lag = 0;
+        return recommended != ring_size;
+    }
+
+    if (++window_frames < window)
+        return recommended != ring_size;
+
+    peak_occupancy = window_occupancy;
+    peak_lag = window_lag;
+    uint32_t needed = clamp((window_occupancy > window_lag + 1 ? window_occupancy : window_lag + 1) + margin);
+    window_frames = 0;
+    window_occupancy = 0;
+    window_lag = 0;
+
+    if (needed >= ring_size)
+    {
+        recommended = needed;
+        calm_windows = 0;
+    }
+    else
+    {
+        // the ring is shrunk to the largest need of the calm windows
+        shrink_target = calm_windows == 0 || needed > shrink_target ? needed : shrink_target;
+        if (++calm_windows >= shrink_windows)
+        {
+            recommended = shrink_target;
+            calm_windows = 0;
+        }
+        else
+            recommended = ring_size;
+    }
+    return recommended != ring_size;
+}
+
+uint32_t RingDepthAdvisor::getRecommendedDepth() const
+{
+    return recommended;
+}
+
+uint32_t RingDepthAdvisor::getPeakOccupancy() const
+{
+    return peak_occupancy;
+}
+
+uint32_t RingDepthAdvisor::getPeakLag() const
+{
+    return peak_lag;
+}
+
+double RingDepthAdvisor::getFramePeriod() const
+{
+    return frame_period;
+}
+
+}
@@ -0,0 +1,92 @@
+/*
+ * File:   RingDepthAdvisor.h
+ *
+ * Recommendation of the DMA ring depth from the consumer lag.
+ */
+
+#ifndef _RINGDEPTHADVISOR_H
+#define	_RINGDEPTHADVISOR_H
+
+#include <stdint.h>
+
+namespace camera
+{
+
+/**
+ * Derives the smallest DMA ring depth which does not drop frames.
+ *
+ * Each retrieved frame is recorded with its frames_behind, the ring
+ * depth and the time of the retrieval. Per window of frames the advisor
+ * takes the highest ring occupancy and the longest gap between two
+ * retrievals in frame periods, which is the number of frames the camera
+ * delivered while the consumer was away. The needed depth plus a margin
+ * is recommended at the end of the window. A full ring (an overrun)
+ * immediately recommends twice the depth, but never less than the
+ * current one. The ring is only shrunk when several windows in a row
+ * agree, so a short calm phase does not undo a grow, and a ring outside
+ * the limits is kept until the first window has measured the need.
+ *
+ * Every buffer of the ring is locked kernel memory and a deep ring with
+ * RetrieveOldest adds up to depth frame periods of latency, so the
+ * advisor aims at the lowest depth which still absorbs the jitter.
+ */
+class RingDepthAdvisor
+{
+public:
+    RingDepthAdvisor();
+
+    void reset();
+
+    /** Range of the recommended depth (default 3..64) */
+    void setLimits(uint32_t min_depth, uint32_t max_depth);
+    /** Frames per evaluation window (default 300) */
+    void setWindow(uint32_t frames);
+    /** Buffers added to the measured need (default 2) */
+    void setMargin(uint32_t buffers);
+    /** Windows which have to agree before the ring is shrunk (default 3) */
+    void setShrinkWindows(uint32_t windows);
+
+    /**
+     * Records a retrieved frame.
+     * @param timestamp_us dc1394 timestamp of the frame
+     * @param frames_behind value of dc1394video_frame_t::frames_behind
+     * @param ring_size current depth of the ring
+     * @param now_us time of the retrieval, see CaptureStatistics::now()
+     * @return true if the recommended depth differs from ring_size
+     */
+    bool record(uint64_t timestamp_us, uint32_t frames_behind, uint32_t ring_size, uint64_t now_us);
+
+    uint32_t getRecommendedDepth() const;
+    /** Occupancy and retrieval gap (in frames) of the last window */
+    uint32_t getPeakOccupancy() const;
+    uint32_t getPeakLag() const;
+    /** Estimated frame period in microseconds */
+    double getFramePeriod() const;
+
+private:
+    uint32_t clamp(uint32_t depth) const;
+
+    uint32_t min_depth;
+    uint32_t max_depth;
+    uint32_t window;
+    uint32_t margin;
+    uint32_t shrink_windows;
+
+    uint64_t last_timestamp;
+    uint64_t last_retrieve;
+    double frame_period;
+
+    uint32_t window_frames;
+    uint32_t window_occupancy;
+    uint32_t window_lag;
+    uint32_t calm_windows;
+    uint32_t shrink_target;
+
+    uint32_t peak_occupancy;
+    uint32_t peak_lag;
+    uint32_t recommended;
+};
+
+}
+
+#endif	/* _RINGDEPTHADVISOR_H */
@@ -0,0 +1,452 @@
+/*
+ * File:   ShmFrameRing.cpp
+ *
+ * Shared memory frame ring for consumers in other processes.
+ */
+
+#include "ShmFrameRing.h"
+#include "CamFireWire.h"
+#include <base-logging/Logging.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <signal.h>
+
+using namespace base::samples::frame;
+
+namespace camera
+{
+
+static const size_t PAGE_SIZE_BYTES = 4096;
+// offset of the image within a slot
+static const size_t SLOT_DATA_OFFSET = 64;
+
+static size_t pageAlign(size_t size)
+{
+    return (size + PAGE_SIZE_BYTES - 1) / PAGE_SIZE_BYTES * PAGE_SIZE_BYTES;
+}
+
+static std::string shmName(const std::string &name)
+{
+    return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+static ShmSlotHeader *slotAt(ShmRingHeader *header, uint64_t index)
+{
+    uint8_t *base = reinterpret_cast<uint8_t *>(header) + PAGE_SIZE_BYTES;
+    return reinterpret_cast<ShmSlotHeader *>(base + (index % header->slot_count) * header->slot_stride);
+}
+
+// true if /name is a frame ring whose writer process has exited
+static bool isStaleRing(const std::string &name)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    void *memory = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(ShmRingHeader))
+        memory = mmap(NULL, sizeof(ShmRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+        return false;
+
+    const ShmRingHeader *header = static_cast<const ShmRingHeader *>(memory);
+    bool stale = header->magic == ShmRingHeader::MAGIC && header->writer_pid > 0 &&
+        kill(header->writer_pid, 0) != 0 && errno == ESRCH;
+    munmap(memory, sizeof(ShmRingHeader));
+    return stale;
+}
+
+static int futexWait(int32_t *address, int32_t value, const timespec *timeout)
+{
+    // the segment is shared between processes, so no FUTEX_PRIVATE_FLAG
+    return syscall(SYS_futex, address, FUTEX_WAIT, value, timeout, NULL, 0);
+}
+
+static void futexWakeAll(int32_t *address)
+{
+    syscall(SYS_futex, address, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+ShmFrameWriter::ShmFrameWriter()
+    : header(NULL), mapped_size(0), permissions(0600)
+{
+}
+
+ShmFrameWriter::~ShmFrameWriter()
+{
+    close();
+}
+
+bool ShmFrameWriter::create(const std::string &segment, uint32_t slot_count, uint32_t slot_size)
+{
+    close();
+    if (slot_count < 2 || slot_size == 0)
+        throw std::runtime_error("ShmFrameWriter: at least two slots of a positive size are needed!");
+
+    name = shmName(segment);
+    const uint32_t slot_stride = pageAlign(SLOT_DATA_OFFSET + slot_size);
+    mapped_size = PAGE_SIZE_BYTES + (size_t)slot_count * slot_stride;
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, permissions);
+    if (fd < 0 && errno == EEXIST && isStaleRing(name))
+    {
+        // left behind by a crashed writer, its readers keep their mapping
+        LOG_WARN_S << "ShmFrameWriter: replacing " << name << " of a writer which is gone";
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, permissions);
+    }
+    if (fd < 0)
+    {
+        LOG_ERROR_S << "ShmFrameWriter: cannot create " << name << ": " << strerror(errno);
+        return false;
+    }
+    // the umask may have taken bits of the mode
+    if (fchmod(fd, permissions) != 0)
+    {
+        LOG_ERROR_S << "ShmFrameWriter: cannot set the mode of " << name << ": " << strerror(errno);
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    if (ftruncate(fd, mapped_size) != 0)
+    {
+        LOG_ERROR_S << "ShmFrameWriter: cannot size " << name << ": " << strerror(errno);
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void *memory = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+    {
+        LOG_ERROR_S << "ShmFrameWriter: cannot map " << name << ": " << strerror(errno);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    header = static_cast<ShmRingHeader *>(memory);
+    header->version = ShmRingHeader::VERSION;
+    header->slot_count = slot_count;
+    header->slot_size = slot_size;
+    header->slot_stride = slot_stride;
+    header->futex = 0;
+    header->waiters = 0;
+    header->writer_pid = getpid();
+    header->frames_written = 0;
+    // readers check the magic last
+    __sync_synchronize();
+    header->magic = ShmRingHeader::MAGIC;
+    return true;
+}
+
+bool ShmFrameWriter::create(const std::string &segment, uint32_t slot_count, const CamFireWire &camera)
+{
+    const frame_size_t &size = camera.image_size_;
+    uint32_t bytes_per_channel = (camera.data_depth + 7) / 8;
+    uint32_t slot_size = size.width * size.height * Frame::getChannelCount(camera.frame_mode) * bytes_per_channel;
+    if (slot_size == 0)
+        throw std::runtime_error("ShmFrameWriter: set the frame settings of the camera first!");
+    return create(segment, slot_count, slot_size);
+}
+
+void ShmFrameWriter::setPermissions(mode_t mode)
+{
+    permissions = mode;
+}
+
+void ShmFrameWriter::close()
+{
+    if (!header)
+        return;
+    munmap(header, mapped_size);
+    shm_unlink(name.c_str());
+    header = NULL;
+    mapped_size = 0;
+}
+
+bool ShmFrameWriter::isOpen() const
+{
+    return header != NULL;
+}
+
+ShmSlotHeader *ShmFrameWriter::beginSlot(uint8_t *&data)
+{
+    ShmSlotHeader *slot = slotAt(header, header->frames_written);
+    // odd while writing, readers of the old frame see the change
+    slot->sequence++;
+    __sync_synchronize();
+    data = reinterpret_cast<uint8_t *>(slot) + SLOT_DATA_OFFSET;
+    return slot;
+}
+
+void ShmFrameWriter::commitSlot(ShmSlotHeader *slot)
+{
+    slot->frame_index = header->frames_written;
+    __sync_synchronize();
+    slot->sequence++;
+    __sync_synchronize();
+    header->frames_written++;
+    __sync_fetch_and_add(&header->futex, 1);
+    if (__sync_fetch_and_add(&header->waiters, 0) > 0)
+        futexWakeAll(&header->futex);
+}
+
+void ShmFrameWriter::rollbackSlot(ShmSlotHeader *slot)
+{
+    // nothing was written, the old frame stays valid
+    __sync_synchronize();
+    slot->sequence--;
+}
+
+bool ShmFrameWriter::write(const Frame &frame)
+{
+    if (!header)
+        return false;
+    const uint32_t bytes = frame.getNumberOfBytes();
+    if (bytes > header->slot_size)
+    {
+        LOG_ERROR_S << "ShmFrameWriter: frame of " << bytes << " bytes does not fit into a slot";
+        return false;
+    }
+
+    uint8_t *data;
+    ShmSlotHeader *slot = beginSlot(data);
+    memcpy(data, frame.getImageConstPtr(), bytes);
+    slot->width = frame.getWidth();
+    slot->height = frame.getHeight();
+    slot->data_depth = frame.getDataDepth();
+    slot->frame_mode = frame.getFrameMode();
+    slot->image_bytes = bytes;
+    slot->flags = frame.isHDR() ? ShmSlotHeader::FLAG_HDR : 0;
+    slot->time_us = frame.time.toMicroseconds();
+    commitSlot(slot);
+    return true;
+}
+
+bool ShmFrameWriter::retrieve(CamFireWire &camera, const int timeout)
+{
+    if (!header)
+        return false;
+
+    // readers see the slot as overwritten while it is odd, so it is only
+    // taken once the frame is there
+    if (timeout != 0 && !camera.waitForFrame(timeout))
+        return false;
+
+    uint8_t *data;
+    ShmSlotHeader *slot = beginSlot(data);
+    uint32_t bytes;
+    base::Time time;
+    bool retrieved;
+    try
+    {
+        retrieved = camera.retrieveFrameData(data, header->slot_size, bytes, time, 0);
+    }
+    catch (...)
+    {
+        rollbackSlot(slot);
+        throw;
+    }
+    if (!retrieved)
+    {
+        rollbackSlot(slot);
+        return false;
+    }
+    slot->width = camera.image_size_.width;
+    slot->height = camera.image_size_.height;
+    slot->data_depth = camera.data_depth;
+    slot->frame_mode = camera.frame_mode;
+    slot->image_bytes = bytes;
+    slot->flags = camera.hdr_enabled ? ShmSlotHeader::FLAG_HDR : 0;
+    slot->time_us = time.toMicroseconds();
+    commitSlot(slot);
+    return true;
+}
+
+uint64_t ShmFrameWriter::getFramesWritten() const
+{
+    return header ? header->frames_written : 0;
+}
+
+ShmFrameReader::ShmFrameReader()
+    : header(NULL), mapped_size(0), next_index(0), dropped(0)
+{
+}
+
+ShmFrameReader::~ShmFrameReader()
+{
+    close();
+}
+
+bool ShmFrameReader::open(const std::string &segment)
+{
+    close();
+    const std::string name = shmName(segment);
+
+    // read-write, since waiting readers register in the header
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < PAGE_SIZE_BYTES)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *memory = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+        return false;
+
+    header = static_cast<ShmRingHeader *>(memory);
+    mapped_size = info.st_size;
+    if (header->magic != ShmRingHeader::MAGIC || header->version != ShmRingHeader::VERSION ||
+        PAGE_SIZE_BYTES + (size_t)header->slot_count * header->slot_stride > mapped_size)
+    {
+        LOG_ERROR_S << "ShmFrameReader: " << name << " is no frame ring";
+        close();
+        return false;
+    }
+
+    // start with the next frame
+    next_index = header->frames_written;
+    dropped = 0;
+    return true;
+}
+
+void ShmFrameReader::close()
+{
+    if (!header)
+        return;
+    munmap(header, mapped_size);
+    header = NULL;
+    mapped_size = 0;
+}
+
+bool ShmFrameReader::isOpen() const
+{
+    return header != NULL;
+}
+
+bool ShmFrameReader::wait(int timeout_ms)
+{
+    if (!header)
+        return false;
+
+    const uint64_t deadline = CaptureStatistics::now() + (uint64_t)(timeout_ms > 0 ? timeout_ms : 0) * 1000;
+    while (true)
+    {
+        int32_t value = __sync_fetch_and_add(&header->futex, 0);
+        if (header->frames_written > next_index)
+            return true;
+
+        timespec timeout;
+        timespec *timeout_ptr = NULL;
+        if (timeout_ms >= 0)
+        {
+            uint64_t now = CaptureStatistics::now();
+            if (now >= deadline)
+                return false;
+            timeout.tv_sec = (deadline - now) / 1000000;
+            timeout.tv_nsec = (deadline - now) % 1000000 * 1000;
+            timeout_ptr = &timeout;
+        }
+
+        // the writer only wakes if it sees a waiter, the value check of
+        // the futex covers a frame written in between
+        __sync_fetch_and_add(&header->waiters, 1);
+        futexWait(&header->futex, value, timeout_ptr);
+        __sync_fetch_and_sub(&header->waiters, 1);
+    }
+}
+
+bool ShmFrameReader::acquire(ShmFrameView &view)
+{
+    if (!header)
+        return false;
+
+    while (true)
+    {
+        const uint64_t written = header->frames_written;
+        __sync_synchronize();
+        if (next_index >= written)
+            return false;
+
+        // the slot after the newest frame may already be written again
+        const uint64_t oldest = written > header->slot_count - 1 ? written - (header->slot_count - 1) : 0;
+        if (next_index < oldest)
+        {
+            dropped += oldest - next_index;
+            next_index = oldest;
+        }
+
+        const ShmSlotHeader *slot = slotAt(header, next_index);
+        const uint32_t sequence = slot->sequence;
+        __sync_synchronize();
+        if ((sequence & 1) || slot->frame_index != next_index)
+        {
+            // overwritten in the meantime
+            dropped++;
+            next_index++;
+            continue;
+        }
+
+        view.data = reinterpret_cast<const uint8_t *>(slot) + SLOT_DATA_OFFSET;
+        view.width = slot->width;
+        view.height = slot->height;
+        view.data_depth = slot->data_depth;
+        view.frame_mode = (frame_mode_t)slot->frame_mode;
+        view.image_bytes = slot->image_bytes;
+        view.flags = slot->flags;
+        view.frame_index = slot->frame_index;
+        view.time = base::Time::fromMicroseconds(slot->time_us);
+        view.slot = slot;
+        view.sequence = sequence;
+        next_index++;
+        if (isValid(view))
+            return true;
+        dropped++;
+    }
+}
+
+bool ShmFrameReader::isValid(const ShmFrameView &view) const
+{
+    __sync_synchronize();
+    return view.slot && view.slot->sequence == view.sequence;
+}
+
+bool ShmFrameReader::read(Frame &frame)
+{
+    ShmFrameView view;
+    while (acquire(view))
+    {
+        frame.init(view.width, view.height, view.data_depth, view.frame_mode);
+        frame.setImage((const char *)view.data, view.image_bytes);
+        if (view.flags & ShmSlotHeader::FLAG_HDR)
+            frame.setHDR(true);
+        frame.time = view.time;
+        if (isValid(view))
+        {
+            frame.setStatus(STATUS_VALID);
+            return true;
+        }
+        dropped++;
+    }
+    return false;
+}
+
+uint64_t ShmFrameReader::getDropped() const
+{
+    return dropped;
+}
+
+}
@@ -0,0 +1,191 @@
+/*
+ * File:   ShmFrameRing.h
+ *
+ * Shared memory frame ring for consumers in other processes.
+ */
+
+#ifndef _SHMFRAMERING_H
+#define	_SHMFRAMERING_H
+
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+#include "base/samples/Frame.hpp"
+
+namespace camera
+{
+
+class CamFireWire;
+
+/**
+ * Layout of the shared memory segment. The ring header is followed by
+ * slot_count slots of slot_stride bytes, each starting with a
+ * ShmSlotHeader and the image 64 bytes after its start. All slots are
+ * page aligned.
+ */
+struct ShmRingHeader
+{
+    enum { MAGIC = 0x46524e47, VERSION = 2 };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    // maximum image size of a slot
+    uint32_t slot_size;
+    uint32_t slot_stride;
+    // incremented for every frame, readers wait on it with FUTEX_WAIT
+    int32_t futex;
+    // readers blocked in the futex, the writer only wakes if there are any
+    int32_t waiters;
+    // process of the writer, a segment of a dead writer may be replaced
+    int32_t writer_pid;
+    // frames written so far, frame n is in slot n % slot_count
+    uint64_t frames_written;
+};
+
+struct ShmSlotHeader
+{
+    enum Flags { FLAG_HDR = 1 };
+
+    // seqlock, odd while the writer fills the slot
+    uint32_t sequence;
+    uint32_t width;
+    uint32_t height;
+    uint32_t data_depth;
+    uint32_t frame_mode;
+    uint32_t image_bytes;
+    // combination of Flags
+    uint32_t flags;
+    uint64_t frame_index;
+    int64_t time_us;
+};
+
+/**
+ * A frame in the shared memory ring, valid as long as ShmFrameReader::
+ * isValid() returns true for it.
+ */
+struct ShmFrameView
+{
+    const uint8_t *data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t data_depth;
+    base::samples::frame::frame_mode_t frame_mode;
+    uint32_t image_bytes;
+    // combination of ShmSlotHeader::Flags
+    uint32_t flags;
+    uint64_t frame_index;
+    base::Time time;
+
+    // seqlock state of the slot when the view was taken
+    const ShmSlotHeader *slot;
+    uint32_t sequence;
+};
+
+/**
+ * Writes frames into a POSIX shared memory ring.
+ *
+ * Frames are written round-robin into the slots, each slot is protected
+ * by a seqlock, so the writer never waits for readers: a reader which is
+ * too slow finds its slot overwritten and skips ahead. Readers are woken
+ * through a futex in the shared segment.
+ */
+class ShmFrameWriter
+{
+public:
+    ShmFrameWriter();
+    ~ShmFrameWriter();
+
+    /**
+     * Creates the segment /name. An existing segment is only replaced if
+     * it is a frame ring whose writer process is gone.
+     * @param slot_size maximum image size in bytes
+     */
+    bool create(const std::string &name, uint32_t slot_count, uint32_t slot_size);
+
+    /** Creates the segment with slots for the current frame size of the camera */
+    bool create(const std::string &name, uint32_t slot_count, const CamFireWire &camera);
+
+    /**
+     * Access mode of the segments created from now on. The default 0600
+     * only lets processes of the same user read the frames, 0660 lets the
+     * group in as well. The umask does not apply.
+     */
+    void setPermissions(mode_t mode);
+
+    /** Removes the segment, mapped readers keep their mapping */
+    void close();
+    bool isOpen() const;
+
+    /** Writes a copy of the frame */
+    bool write(const base::samples::frame::Frame &frame);
+
+    /**
+     * Retrieves the next frame of the camera directly into the next slot
+     * (see CamFireWire::retrieveFrameData). The slot keeps its old frame
+     * if no frame arrives or the camera throws.
+     * @param timeout ms to wait for the frame, 0 polls, negative waits
+     * forever
+     */
+    bool retrieve(CamFireWire &camera, const int timeout);
+
+    uint64_t getFramesWritten() const;
+
+private:
+    ShmSlotHeader *beginSlot(uint8_t *&data);
+    void commitSlot(ShmSlotHeader *slot);
+    /** Gives the slot its old frame back */
+    void rollbackSlot(ShmSlotHeader *slot);
+
+    std::string name;
+    ShmRingHeader *header;
+    size_t mapped_size;
+    mode_t permissions;
+};
+
+/**
+ * Reads frames from a ShmFrameWriter in another process without copying.
+ *
+ * acquire() returns a view into the shared memory. Since the writer may
+ * overwrite the slot at any time, a consumer has to check isValid()
+ * after it used the view; a false result means the data was torn and has
+ * to be discarded.
+ */
+class ShmFrameReader
+{
+public:
+    ShmFrameReader();
+    ~ShmFrameReader();
+
+    bool open(const std::string &name);
+    void close();
+    bool isOpen() const;
+
+    /**
+     * Waits until a frame which was not read yet is available.
+     * @param timeout_ms negative waits forever
+     */
+    bool wait(int timeout_ms);
+
+    /** Takes the next unread frame, false if there is none */
+    bool acquire(ShmFrameView &view);
+
+    /** True if the slot of the view was not overwritten meanwhile */
+    bool isValid(const ShmFrameView &view) const;
+
+    /** acquire() and copy the frame, retried if it was overwritten */
+    bool read(base::samples::frame::Frame &frame);
+
+    /** Frames which were overwritten before they were read */
+    uint64_t getDropped() const;
+
+private:
+    ShmRingHeader *header;
+    size_t mapped_size;
+    uint64_t next_index;
+    uint64_t dropped;
+};
+
+}
+
+#endif	/* _SHMFRAMERING_H */
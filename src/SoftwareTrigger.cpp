@@ -0,0 +1,181 @@
+/*
+ * File:   SoftwareTrigger.cpp
+ *
+ * Thread which fires software triggers at precise times.
+ */
+
+#include "SoftwareTrigger.h"
+#include "CamFireWire.h"
+#include <time.h>
+#include <errno.h>
+
+namespace camera
+{
+
+static const uint64_t NSEC_PER_SEC = 1000000000ULL;
+
+// stop() is noticed within this time even if the next deadline is far away
+static const uint64_t MAX_SLEEP_NS = 100000000ULL;
+
+static uint64_t monotonicNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+SoftwareTrigger::SoftwareTrigger(CamFireWire &camera)
+    : camera(camera), thread_started(false), start_ns(0), period_ns(0), count(0),
+      stop_requested(false), running(false), fired(0), missed(0), max_lateness_us(0)
+{
+}
+
+SoftwareTrigger::~SoftwareTrigger()
+{
+    stop();
+}
+
+bool SoftwareTrigger::start(double rate, uint32_t trigger_count)
+{
+    if (rate <= 0)
+        throw std::runtime_error("SoftwareTrigger: rate must be positive!");
+    stop();
+
+    times_us.clear();
+    period_ns = (uint64_t)(NSEC_PER_SEC / rate + 0.5);
+    count = trigger_count;
+    // the first trigger one period from now, so the caller can retrieve
+    start_ns = monotonicNs() + period_ns;
+    return startThread();
+}
+
+bool SoftwareTrigger::start(const std::vector<uint64_t> &times)
+{
+    stop();
+    if (times.empty())
+        return true;
+
+    times_us = times;
+    period_ns = 0;
+    count = times.size();
+    return startThread();
+}
+
+bool SoftwareTrigger::startThread()
+{
+    stop_requested = false;
+    fired = 0;
+    missed = 0;
+    max_lateness_us = 0;
+    running = true;
+    if (!createThread(thread, &SoftwareTrigger::threadFunc, this, thread_settings))
+    {
+        running = false;
+        return false;
+    }
+    thread_started = true;
+    return true;
+}
+
+void SoftwareTrigger::stop()
+{
+    stop_requested = true;
+    wait();
+}
+
+void SoftwareTrigger::wait()
+{
+    if (!thread_started)
+        return;
+    pthread_join(thread, NULL);
+    thread_started = false;
+}
+
+bool SoftwareTrigger::isRunning() const
+{
+    return running;
+}
+
+void SoftwareTrigger::setThreadSettings(const ThreadSettings &settings)
+{
+    thread_settings = settings;
+}
+
+uint32_t SoftwareTrigger::getFiredCount() const
+{
+    return __sync_fetch_and_add(const_cast<uint32_t *>(&fired), 0);
+}
+
+uint32_t SoftwareTrigger::getMissedCount() const
+{
+    return __sync_fetch_and_add(const_cast<uint32_t *>(&missed), 0);
+}
+
+uint32_t SoftwareTrigger::getMaxLateness() const
+{
+    return __sync_fetch_and_add(const_cast<uint32_t *>(&max_lateness_us), 0);
+}
+
+void *SoftwareTrigger::threadFunc(void *arg)
+{
+    static_cast<SoftwareTrigger *>(arg)->run();
+    return NULL;
+}
+
+bool SoftwareTrigger::nextDeadline(uint64_t index, uint64_t &deadline_ns) const
+{
+    if (count != 0 && index >= count)
+        return false;
+    if (period_ns)
+        deadline_ns = start_ns + index * period_ns;
+    else
+        deadline_ns = times_us[index] * 1000;
+    return true;
+}
+
+void SoftwareTrigger::run()
+{
+    uint64_t deadline_ns;
+    for (uint64_t index = 0; !stop_requested && nextDeadline(index, deadline_ns); index++)
+    {
+        // sleep in slices, so stop() does not wait for a far deadline
+        uint64_t now_ns = monotonicNs();
+        while (!stop_requested && now_ns < deadline_ns)
+        {
+            uint64_t wake_ns = deadline_ns;
+            if (wake_ns - now_ns > MAX_SLEEP_NS)
+                wake_ns = now_ns + MAX_SLEEP_NS;
+            timespec wake;
+            wake.tv_sec = wake_ns / NSEC_PER_SEC;
+            wake.tv_nsec = wake_ns % NSEC_PER_SEC;
+            int err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+            if (err != 0 && err != EINTR)
+                break;
+            now_ns = monotonicNs();
+        }
+        if (stop_requested)
+            break;
+
+        // a deadline which has already passed by a whole period is skipped,
+        // firing it late would shift all following frames
+        uint64_t lateness_ns = now_ns - deadline_ns;
+        if (period_ns && lateness_ns >= period_ns)
+        {
+            __sync_fetch_and_add(&missed, 1);
+            continue;
+        }
+
+        if (camera.softwareTrigger())
+        {
+            __sync_fetch_and_add(&fired, 1);
+            uint32_t lateness_us = lateness_ns / 1000;
+            if (lateness_us > max_lateness_us)
+                __sync_lock_test_and_set(&max_lateness_us, lateness_us);
+        }
+        else
+            __sync_fetch_and_add(&missed, 1);
+    }
+    running = false;
+}
+
+}
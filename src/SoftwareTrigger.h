@@ -0,0 +1,95 @@
+/*
+ * File:   SoftwareTrigger.h
+ *
+ * Thread which fires software triggers at precise times.
+ */
+
+#ifndef _SOFTWARETRIGGER_H
+#define	_SOFTWARETRIGGER_H
+
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include "ThreadUtils.h"
+
+namespace camera
+{
+
+class CamFireWire;
+
+/**
+ * Fires the software trigger of a camera at a fixed rate or at explicit
+ * times from a separate thread.
+ *
+ * The thread sleeps with clock_nanosleep on absolute CLOCK_MONOTONIC
+ * deadlines, so the trigger times do not drift with the time spent
+ * triggering. A deadline at which the camera has not yet processed the
+ * previous trigger is skipped and counted as missed (see
+ * CaptureStats::triggers_missed). The camera must be grabbing with the
+ * software trigger source selected. The register accesses are serialized
+ * with those of the capture thread by the camera.
+ */
+class SoftwareTrigger
+{
+public:
+    explicit SoftwareTrigger(CamFireWire &camera);
+    ~SoftwareTrigger();
+
+    /**
+     * Starts triggering with the given rate.
+     * @param count number of triggers, 0 triggers until stop()
+     */
+    bool start(double rate, uint32_t count = 0);
+
+    /**
+     * Starts triggering at the given times.
+     * @param times_us ascending CLOCK_MONOTONIC times in microseconds,
+     *                 see CaptureStatistics::now()
+     */
+    bool start(const std::vector<uint64_t> &times_us);
+
+    /** Stops the thread, returns after it has finished */
+    void stop();
+
+    /** Waits until all requested triggers have been processed */
+    void wait();
+
+    bool isRunning() const;
+
+    /** Pinning and priority of the thread, applied at start() */
+    void setThreadSettings(const ThreadSettings &settings);
+
+    /** Triggers fired since the last start() */
+    uint32_t getFiredCount() const;
+    /** Deadlines skipped since the last start() */
+    uint32_t getMissedCount() const;
+    /** Largest delay of a trigger behind its deadline */
+    uint32_t getMaxLateness() const;
+
+private:
+    static void *threadFunc(void *arg);
+    void run();
+    bool startThread();
+    bool nextDeadline(uint64_t index, uint64_t &deadline_ns) const;
+
+    CamFireWire &camera;
+    pthread_t thread;
+    bool thread_started;
+    ThreadSettings thread_settings;
+
+    // schedule, written before the thread is started
+    uint64_t start_ns;
+    uint64_t period_ns;
+    uint64_t count;
+    std::vector<uint64_t> times_us;
+
+    volatile bool stop_requested;
+    volatile bool running;
+    uint32_t fired;
+    uint32_t missed;
+    uint32_t max_lateness_us;
+};
+
+}
+
+#endif	/* _SOFTWARETRIGGER_H */
@@ -206,6 +206,18 @@ int main(int argc, char**argv)
     double total_time = (1000000*te.tv_sec+te.tv_usec - 1000000*ts.tv_sec-ts.tv_usec)/1000000.0;
     std::cerr << total_time << " seconds" << std::endl;
     std::cerr << total_frames / total_time << " fps avg" << std::endl;
+
+    CaptureStats left_stats = left_camera.getCaptureStats();
+    std::cerr << "left: " << left_stats.frames_dequeued << " frames, "
+        << left_stats.frames_dropped << " dropped, latency p99 "
+        << left_stats.latency_p99_us << " us" << std::endl;
+    if(stereo)
+    {
+        CaptureStats right_stats = right_camera.getCaptureStats();
+        std::cerr << "right: " << right_stats.frames_dequeued << " frames, "
+            << right_stats.frames_dropped << " dropped, latency p99 "
+            << right_stats.latency_p99_us << " us" << std::endl;
+    }
     cvWaitKey();
 
     left_cam.setAttrib(camera::double_attrib::FrameRate,15);
@@ -0,0 +1,136 @@
+/*
+ * File:   ThreadUtils.cpp
+ *
+ * CPU affinity and real-time scheduling of the driver threads.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "ThreadUtils.h"
+#include <base-logging/Logging.hpp>
+#include <sched.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace camera
+{
+
+bool applyThreadSettings(pthread_t thread, const ThreadSettings &settings)
+{
+    bool success = true;
+    if (settings.cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(settings.cpu, &cpus);
+        int err = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+        if (err != 0)
+        {
+            LOG_WARN_S << "cannot pin thread to cpu " << settings.cpu << ": " << strerror(err);
+            success = false;
+        }
+    }
+
+    if (settings.priority > 0)
+    {
+        sched_param param;
+        param.sched_priority = settings.priority;
+        int err = pthread_setschedparam(thread, SCHED_FIFO, &param);
+        if (err != 0)
+        {
+            LOG_WARN_S << "cannot set SCHED_FIFO priority " << settings.priority << ": " << strerror(err);
+            success = false;
+        }
+    }
+    return success;
+}
+
+static int createThreadWith(pthread_t &thread, void *(*func)(void *), void *arg, int cpu, int priority)
+{
+    pthread_attr_t attr;
+    int err = pthread_attr_init(&attr);
+    if (err != 0)
+        return err;
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        err = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+    if (err == 0 && priority > 0)
+    {
+        // without PTHREAD_EXPLICIT_SCHED the policy of the creator is inherited
+        sched_param param;
+        param.sched_priority = priority;
+        err = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        if (err == 0)
+            err = pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        if (err == 0)
+            err = pthread_attr_setschedparam(&attr, &param);
+    }
+    if (err == 0)
+        err = pthread_create(&thread, &attr, func, arg);
+    pthread_attr_destroy(&attr);
+    return err;
+}
+
+bool createThread(pthread_t &thread, void *(*func)(void *), void *arg, const ThreadSettings &settings)
+{
+    // the settings are dropped one after the other until the thread starts
+    int err = createThreadWith(thread, func, arg, settings.cpu, settings.priority);
+    if (err != 0 && settings.priority > 0)
+    {
+        const int fifo_err = err;
+        err = createThreadWith(thread, func, arg, settings.cpu, 0);
+        if (err == 0)
+            LOG_WARN_S << "cannot set SCHED_FIFO priority " << settings.priority << ": " << strerror(fifo_err);
+    }
+    if (err != 0 && settings.cpu >= 0)
+    {
+        const int pin_err = err;
+        err = createThreadWith(thread, func, arg, -1, settings.priority);
+        if (err != 0 && settings.priority > 0)
+            err = createThreadWith(thread, func, arg, -1, 0);
+        if (err == 0)
+            LOG_WARN_S << "cannot pin thread to cpu " << settings.cpu << ": " << strerror(pin_err);
+    }
+    if (err != 0)
+        LOG_ERROR_S << "cannot start thread: " << strerror(err);
+    return err == 0;
+}
+
+int getCpuCount()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+}
+
+// users of the process wide memory lock
+static pthread_mutex_t memory_lock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int memory_lock_count = 0;
+
+bool lockProcessMemory()
+{
+    pthread_mutex_lock(&memory_lock_mutex);
+    bool success = memory_lock_count > 0 || mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+    if (success)
+        memory_lock_count++;
+    else
+        LOG_ERROR_S << "cannot lock memory: " << strerror(errno) << " (check RLIMIT_MEMLOCK)";
+    pthread_mutex_unlock(&memory_lock_mutex);
+    return success;
+}
+
+void unlockProcessMemory()
+{
+    pthread_mutex_lock(&memory_lock_mutex);
+    if (memory_lock_count > 0 && --memory_lock_count == 0)
+        munlockall();
+    pthread_mutex_unlock(&memory_lock_mutex);
+}
+
+}
@@ -0,0 +1,60 @@
+/*
+ * File:   ThreadUtils.h
+ *
+ * CPU affinity and real-time scheduling of the driver threads.
+ */
+
+#ifndef _THREADUTILS_H
+#define	_THREADUTILS_H
+
+#include <pthread.h>
+
+namespace camera
+{
+
+/**
+ * Scheduling of a thread of the driver (capture, trigger).
+ */
+struct ThreadSettings
+{
+    // core the thread is pinned to, -1 leaves the affinity alone
+    int cpu;
+    // SCHED_FIFO priority (1..99), 0 keeps the default scheduler
+    int priority;
+
+    ThreadSettings() : cpu(-1), priority(0) {}
+    ThreadSettings(int cpu, int priority) : cpu(cpu), priority(priority) {}
+};
+
+/**
+ * Applies the settings to a running thread. SCHED_FIFO needs
+ * CAP_SYS_NICE or an rtprio limit, a failure is logged and the thread
+ * keeps running with its previous scheduling.
+ * @return false if any of the settings could not be applied
+ */
+bool applyThreadSettings(pthread_t thread, const ThreadSettings &settings);
+
+/**
+ * Starts a thread which is pinned and scheduled by the settings from its
+ * first instruction on (pthread_attr_setaffinity_np, PTHREAD_EXPLICIT_SCHED).
+ * Settings which are not permitted are logged and dropped, the thread is
+ * started without them.
+ * @return false if no thread could be started
+ */
+bool createThread(pthread_t &thread, void *(*func)(void *), void *arg, const ThreadSettings &settings);
+
+/** Number of online CPUs */
+int getCpuCount();
+
+/**
+ * Locks all current and future pages of the process (mlockall). The lock
+ * is shared by all users in the process, only the last
+ * unlockProcessMemory() unlocks the pages again.
+ * @return false if the pages could not be locked (RLIMIT_MEMLOCK)
+ */
+bool lockProcessMemory();
+void unlockProcessMemory();
+
+}
+
+#endif	/* _THREADUTILS_H */
@@ -0,0 +1,97 @@
+/*
+ * File:   VideoModeTable.cpp
+ *
+ * Table of the fixed (non Format7) IIDC video modes.
+ */
+
+#include "VideoModeTable.h"
+
+using namespace base::samples::frame;
+
+namespace camera
+{
+
+static const VideoModeEntry VIDEO_MODES[] =
+{
+    { DC1394_VIDEO_MODE_160x120_YUV444,    160,  120, DC1394_COLOR_CODING_YUV444, MODE_UNDEFINED, 8, 24 },
+    { DC1394_VIDEO_MODE_320x240_YUV422,    320,  240, DC1394_COLOR_CODING_YUV422, MODE_UYVY,      8, 16 },
+    { DC1394_VIDEO_MODE_640x480_YUV411,    640,  480, DC1394_COLOR_CODING_YUV411, MODE_UNDEFINED, 8, 12 },
+    { DC1394_VIDEO_MODE_640x480_YUV422,    640,  480, DC1394_COLOR_CODING_YUV422, MODE_UYVY,      8, 16 },
+    { DC1394_VIDEO_MODE_640x480_RGB8,      640,  480, DC1394_COLOR_CODING_RGB8,   MODE_RGB,       8, 24 },
+    { DC1394_VIDEO_MODE_640x480_MONO8,     640,  480, DC1394_COLOR_CODING_MONO8,  MODE_GRAYSCALE, 8,  8 },
+    { DC1394_VIDEO_MODE_640x480_MONO16,    640,  480, DC1394_COLOR_CODING_MONO16, MODE_GRAYSCALE, 16, 16 },
+    { DC1394_VIDEO_MODE_800x600_YUV422,    800,  600, DC1394_COLOR_CODING_YUV422, MODE_UYVY,      8, 16 },
+    { DC1394_VIDEO_MODE_800x600_RGB8,      800,  600, DC1394_COLOR_CODING_RGB8,   MODE_RGB,       8, 24 },
+    { DC1394_VIDEO_MODE_800x600_MONO8,     800,  600, DC1394_COLOR_CODING_MONO8,  MODE_GRAYSCALE, 8,  8 },
+    { DC1394_VIDEO_MODE_1024x768_YUV422,  1024,  768, DC1394_COLOR_CODING_YUV422, MODE_UYVY,      8, 16 },
+    { DC1394_VIDEO_MODE_1024x768_RGB8,    1024,  768, DC1394_COLOR_CODING_RGB8,   MODE_RGB,       8, 24 },
+    { DC1394_VIDEO_MODE_1024x768_MONO8,   1024,  768, DC1394_COLOR_CODING_MONO8,  MODE_GRAYSCALE, 8,  8 },
+    { DC1394_VIDEO_MODE_800x600_MONO16,    800,  600, DC1394_COLOR_CODING_MONO16, MODE_GRAYSCALE, 16, 16 },
+    { DC1394_VIDEO_MODE_1024x768_MONO16,  1024,  768, DC1394_COLOR_CODING_MONO16, MODE_GRAYSCALE, 16, 16 },
+    { DC1394_VIDEO_MODE_1280x960_YUV422,  1280,  960, DC1394_COLOR_CODING_YUV422, MODE_UYVY,      8, 16 },
+    { DC1394_VIDEO_MODE_1280x960_RGB8,    1280,  960, DC1394_COLOR_CODING_RGB8,   MODE_RGB,       8, 24 },
+    { DC1394_VIDEO_MODE_1280x960_MONO8,   1280,  960, DC1394_COLOR_CODING_MONO8,  MODE_GRAYSCALE, 8,  8 },
+    { DC1394_VIDEO_MODE_1600x1200_YUV422, 1600, 1200, DC1394_COLOR_CODING_YUV422, MODE_UYVY,      8, 16 },
+    { DC1394_VIDEO_MODE_1600x1200_RGB8,   1600, 1200, DC1394_COLOR_CODING_RGB8,   MODE_RGB,       8, 24 },
+    { DC1394_VIDEO_MODE_1600x1200_MONO8,  1600, 1200, DC1394_COLOR_CODING_MONO8,  MODE_GRAYSCALE, 8,  8 },
+    { DC1394_VIDEO_MODE_1280x960_MONO16,  1280,  960, DC1394_COLOR_CODING_MONO16, MODE_GRAYSCALE, 16, 16 },
+    { DC1394_VIDEO_MODE_1600x1200_MONO16, 1600, 1200, DC1394_COLOR_CODING_MONO16, MODE_GRAYSCALE, 16, 16 },
+};
+
+static const uint32_t VIDEO_MODE_COUNT = sizeof(VIDEO_MODES) / sizeof(VIDEO_MODES[0]);
+
+uint32_t VideoModeTable::size()
+{
+    return VIDEO_MODE_COUNT;
+}
+
+const VideoModeEntry &VideoModeTable::entry(uint32_t index)
+{
+    return VIDEO_MODES[index];
+}
+
+const VideoModeEntry *VideoModeTable::lookup(dc1394video_mode_t mode)
+{
+    // the table is in the order of the enum
+    uint32_t index = mode - DC1394_VIDEO_MODE_MIN;
+    if (mode < DC1394_VIDEO_MODE_MIN || index >= VIDEO_MODE_COUNT ||
+        VIDEO_MODES[index].mode != mode)
+        return NULL;
+    return &VIDEO_MODES[index];
+}
+
+static bool isSupported(dc1394video_mode_t mode, const dc1394video_modes_t &supported)
+{
+    for (uint32_t i = 0; i < supported.num; i++)
+    {
+        if (supported.modes[i] == mode)
+            return true;
+    }
+    return false;
+}
+
+const VideoModeEntry *VideoModeTable::findBestMode(uint32_t width, uint32_t height,
+                                                   frame_mode_t frame_mode, uint8_t data_depth,
+                                                   const dc1394video_modes_t &supported)
+{
+    const VideoModeEntry *best_fit = NULL;
+    const VideoModeEntry *largest = NULL;
+    for (uint32_t i = 0; i < VIDEO_MODE_COUNT; i++)
+    {
+        const VideoModeEntry &candidate = VIDEO_MODES[i];
+        if (candidate.frame_mode != frame_mode || candidate.data_depth != data_depth)
+            continue;
+        if (!isSupported(candidate.mode, supported))
+            continue;
+
+        uint32_t area = candidate.width * candidate.height;
+        if (!largest || area > largest->width * largest->height)
+            largest = &candidate;
+        if (candidate.width >= width && candidate.height >= height &&
+            (!best_fit || area < best_fit->width * best_fit->height))
+            best_fit = &candidate;
+    }
+    return best_fit ? best_fit : largest;
+}
+
+}
@@ -0,0 +1,62 @@
+/*
+ * File:   VideoModeTable.h
+ *
+ * Table of the fixed (non Format7) IIDC video modes.
+ */
+
+#ifndef _VIDEOMODETABLE_H
+#define	_VIDEOMODETABLE_H
+
+#include <stdint.h>
+#include <dc1394/types.h>
+#include "base/samples/Frame.hpp"
+
+namespace camera
+{
+
+/**
+ * One fixed video mode. frame_mode is MODE_UNDEFINED for codings which
+ * have no counterpart in base::samples::frame (YUV411, YUV444).
+ */
+struct VideoModeEntry
+{
+    dc1394video_mode_t mode;
+    uint32_t width;
+    uint32_t height;
+    dc1394color_coding_t coding;
+    base::samples::frame::frame_mode_t frame_mode;
+    // bits per channel
+    uint8_t data_depth;
+    // bits per pixel on the bus
+    uint8_t bits_per_pixel;
+};
+
+/**
+ * Selection of a fixed video mode for a requested frame size, frame mode
+ * and depth.
+ */
+class VideoModeTable
+{
+public:
+    /** Number of entries, one per fixed video mode */
+    static uint32_t size();
+    static const VideoModeEntry &entry(uint32_t index);
+
+    /** @return the entry of the given mode or NULL for Format7 modes */
+    static const VideoModeEntry *lookup(dc1394video_mode_t mode);
+
+    /**
+     * Best fitting mode among the supported ones: the smallest mode which
+     * holds width x height, or the largest one if none does.
+     * @param supported modes the camera supports
+     * @return NULL if no supported mode has the frame mode and depth
+     */
+    static const VideoModeEntry *findBestMode(uint32_t width, uint32_t height,
+                                              base::samples::frame::frame_mode_t frame_mode,
+                                              uint8_t data_depth,
+                                              const dc1394video_modes_t &supported);
+};
+
+}
+
+#endif	/* _VIDEOMODETABLE_H */
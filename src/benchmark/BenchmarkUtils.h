@@ -0,0 +1,72 @@
+/*
+ * File:   BenchmarkUtils.h
+ *
+ * Test frames and fault counters shared by the benchmarks.
+ */
+
+#ifndef _BENCHMARKUTILS_H
+#define	_BENCHMARKUTILS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include "base/samples/Frame.hpp"
+
+namespace benchmark_utils
+{
+
+/** Fills the frame with reproducible noise of the given bit depth */
+inline void fillNoise(base::samples::frame::Frame &frame, uint32_t bits, unsigned seed = 1)
+{
+    srand(seed);
+    uint8_t *data = frame.getImagePtr();
+    const uint32_t count = frame.getPixelCount() * frame.getChannelCount();
+    if (frame.getDataDepth() > 8)
+    {
+        uint16_t *words = reinterpret_cast<uint16_t *>(data);
+        for (uint32_t i = 0; i < count; i++)
+            words[i] = rand() & ((1u << bits) - 1);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count; i++)
+            data[i] = rand() & ((1u << bits) - 1);
+    }
+}
+
+/**
+ * Smooth image with noise, compresses like a real scene unlike pure
+ * noise.
+ */
+inline void fillScene(base::samples::frame::Frame &frame, uint32_t bits, unsigned seed = 1)
+{
+    srand(seed);
+    const uint32_t width = frame.getWidth() * frame.getChannelCount();
+    const uint32_t max = (1u << bits) - 1;
+    for (uint32_t y = 0; y < frame.getHeight(); y++)
+    {
+        uint8_t *row = frame.getImagePtr() + y * frame.getRowSize();
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint32_t value = (x * max / width + y * max / frame.getHeight()) / 2 + (rand() & 7);
+            if (value > max)
+                value = max;
+            if (frame.getDataDepth() > 8)
+                reinterpret_cast<uint16_t *>(row)[x] = value;
+            else
+                row[x] = value;
+        }
+    }
+}
+
+/** Minor and major page faults of the calling thread */
+inline uint64_t pageFaults()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+}
+
+#endif	/* _BENCHMARKUTILS_H */
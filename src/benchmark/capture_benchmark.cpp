@@ -0,0 +1,184 @@
+/*
+ * File:   capture_benchmark.cpp
+ *
+ * Benchmarks of the copy paths of retrieveFrame and of the capture
+ * threads, on a simulated camera.
+ */
+
+#include <benchmark/benchmark.h>
+#include <vector>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "CaptureManager.h"
+#include "CaptureStatistics.h"
+#include "CamFireWire.h"
+#include "test/FakeDC1394.h"
+#include "BenchmarkUtils.h"
+
+using namespace base::samples::frame;
+using namespace camera;
+
+static void resolutions(benchmark::internal::Benchmark *b)
+{
+    b->Args({ 640, 480, 8 })->Args({ 1600, 1200, 8 })->Args({ 1600, 1200, 16 })->Args({ 1920, 1080, 16 });
+}
+
+// copy out of the DMA buffer into a frame which is initialized every
+// time, like retrieveFrame() outside of the real-time mode
+static void BM_SetImageWithInit(benchmark::State &state)
+{
+    const int width = state.range(0), height = state.range(1), depth = state.range(2);
+    std::vector<uint8_t> dma(width * height * depth / 8, 0x5a);
+    Frame frame;
+    uint64_t faults = benchmark_utils::pageFaults();
+    for (auto _ : state)
+    {
+        frame.init(width, height, depth, MODE_BAYER_RGGB);
+        frame.setImage((const char *)&dma[0], dma.size());
+        benchmark::DoNotOptimize(frame.getImagePtr());
+    }
+    state.counters["faults_per_frame"] = benchmark::Counter(
+            benchmark_utils::pageFaults() - faults, benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed(int64_t(state.iterations()) * dma.size());
+}
+BENCHMARK(BM_SetImageWithInit)->Apply(resolutions)->Unit(benchmark::kMicrosecond);
+
+// the real-time path, the frame keeps its geometry and buffer
+static void BM_SetImageReused(benchmark::State &state)
+{
+    const int width = state.range(0), height = state.range(1), depth = state.range(2);
+    std::vector<uint8_t> dma(width * height * depth / 8, 0x5a);
+    Frame frame(width, height, depth, MODE_BAYER_RGGB);
+    uint64_t faults = benchmark_utils::pageFaults();
+    for (auto _ : state)
+    {
+        frame.setImage((const char *)&dma[0], dma.size());
+        benchmark::DoNotOptimize(frame.getImagePtr());
+    }
+    state.counters["faults_per_frame"] = benchmark::Counter(
+            benchmark_utils::pageFaults() - faults, benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed(int64_t(state.iterations()) * dma.size());
+}
+BENCHMARK(BM_SetImageReused)->Apply(resolutions)->Unit(benchmark::kMicrosecond);
+
+enum DrainMode { DrainClear, DrainOldest, DrainLatest };
+
+static const uint64_t DRAIN_GUID = 0x00b09d0100d0d0d0ULL;
+
+// empties a ring of 16 queued 1600x1200 frames of a simulated camera with
+// clearBuffer() (DrainClear) or repeated retrieveFrame() with both retrieve
+// policies, so the real dequeue and skipToLatestFrame() code is measured
+static void BM_RingDrain(benchmark::State &state)
+{
+    const DrainMode mode = (DrainMode)state.range(0);
+    const uint32_t ring_size = 16;
+    fake_dc1394::reset(DRAIN_GUID, 1600, 1200);
+    fake_dc1394::FakeCamera &fake = fake_dc1394::camera();
+
+    CamFireWire camera;
+    CamInfo info;
+    info.unique_id = DRAIN_GUID;
+    if (!camera.setDevice(fake_dc1394::device()) || !camera.open(info, Master) ||
+        !camera.setFrameSettings(frame_size_t(1600, 1200), MODE_GRAYSCALE, 1, false) ||
+        !camera.grab(Continuously, ring_size))
+    {
+        state.SkipWithError("simulated camera failed");
+        return;
+    }
+    camera.setRetrievePolicy(mode == DrainLatest ? RetrieveLatest : RetrieveOldest);
+
+    Frame frame;
+    uint64_t delivered = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        fake.queued = ring_size;
+        state.ResumeTiming();
+
+        if (mode == DrainClear)
+            camera.clearBuffer();
+        else
+        {
+            while (fake.queued > 0 && camera.retrieveFrame(frame, 0))
+                delivered++;
+        }
+        benchmark::DoNotOptimize(frame.getImagePtr());
+    }
+    state.counters["frames_delivered"] = benchmark::Counter(delivered, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_RingDrain)->Arg(DrainClear)->Arg(DrainOldest)->Arg(DrainLatest)->Unit(benchmark::kMicrosecond);
+
+/**
+ * Capture source which always has a frame: an eventfd semaphore with a
+ * huge count, read once per frame like the capture descriptor.
+ */
+class SimulatedSource : public CaptureSource
+{
+public:
+    SimulatedSource(uint32_t bytes)
+        : image(bytes, 0x5a)
+    {
+        fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK);
+        uint64_t count = 1ULL << 40;
+        if (write(fd, &count, sizeof(count)) != sizeof(count))
+            close(fd);
+    }
+
+    virtual ~SimulatedSource() { close(fd); }
+
+    virtual int getFileDescriptor() const { return fd; }
+
+    virtual bool retrieve(Frame &frame)
+    {
+        uint64_t value;
+        if (read(fd, &value, sizeof(value)) != sizeof(value))
+            return false;
+        if (frame.getNumberOfBytes() != image.size())
+            frame.init(640, 480, 8, MODE_BAYER_RGGB);
+        frame.setImage((const char *)&image[0], image.size());
+        return true;
+    }
+
+private:
+    int fd;
+    std::vector<uint8_t> image;
+};
+
+// throughput of one capture thread per simulated bus with two VGA
+// cameras each, should scale with the number of buses up to the cores
+static void BM_CaptureManagerScaling(benchmark::State &state)
+{
+    const uint32_t buses = state.range(0);
+    const uint32_t cameras_per_bus = 2;
+    std::vector<SimulatedSource *> sources;
+    CaptureManager manager;
+    for (uint32_t bus = 0; bus < buses; bus++)
+    {
+        for (uint32_t i = 0; i < cameras_per_bus; i++)
+        {
+            sources.push_back(new SimulatedSource(640 * 480));
+            manager.addSource(bus, sources.back(), NULL);
+        }
+    }
+    manager.setThreadSettingsPerBus(0, 0);
+
+    uint64_t frames = 0;
+    double seconds = 0;
+    for (auto _ : state)
+    {
+        uint64_t start = CaptureStatistics::now();
+        manager.start();
+        usleep(200000);
+        manager.stop();
+        seconds += (CaptureStatistics::now() - start) / 1e6;
+        for (uint32_t bus = 0; bus < buses; bus++)
+            frames += manager.getFrameCount(bus);
+    }
+    state.counters["frames_per_second"] = frames / seconds;
+    state.counters["frames_per_second_per_bus"] = frames / seconds / buses;
+
+    for (size_t i = 0; i < sources.size(); i++)
+        delete sources[i];
+}
+BENCHMARK(BM_CaptureManagerScaling)->DenseRange(1, 4)->Iterations(3)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,136 @@
+/*
+ * File:   filter_benchmark.cpp
+ *
+ * Benchmarks of the filters in src/filter.
+ */
+
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "filter/frame2rggb.h"
+#include "filter/hdr_merge.h"
+#include "filter/bayer_codec.h"
+#include "BenchmarkUtils.h"
+
+using namespace base::samples::frame;
+
+// common sensor resolutions (VGA, SXGA-, UXGA, 1080p) at 8 and 16 bit
+static void resolutionsAndDepths(benchmark::internal::Benchmark *b)
+{
+    const int sizes[][2] = { { 640, 480 }, { 1280, 960 }, { 1600, 1200 }, { 1920, 1080 } };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        b->Args({ sizes[i][0], sizes[i][1], 8 });
+        b->Args({ sizes[i][0], sizes[i][1], 16 });
+    }
+}
+
+static void BM_Frame2RGGB(benchmark::State &state)
+{
+    Frame in(state.range(0), state.range(1), state.range(2), MODE_BAYER_RGGB);
+    benchmark_utils::fillNoise(in, state.range(2) == 8 ? 8 : 12);
+    Frame out;
+    for (auto _ : state)
+    {
+        filter::Frame2RGGB::process(in, out);
+        benchmark::DoNotOptimize(out.getImagePtr());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * in.getNumberOfBytes());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Frame2RGGB)->Apply(resolutionsAndDepths)->Unit(benchmark::kMicrosecond);
+
+// bracket of three exposures, 1600x1200
+static void BM_HDRMerge(benchmark::State &state)
+{
+    const int depth = state.range(0);
+    std::vector<Frame> bracket(3);
+    std::vector<double> times;
+    for (size_t k = 0; k < bracket.size(); k++)
+    {
+        bracket[k].init(1600, 1200, depth, MODE_GRAYSCALE);
+        benchmark_utils::fillNoise(bracket[k], depth == 8 ? 8 : 12, k + 1);
+        times.push_back(100 << (2 * k));
+    }
+    Frame out;
+    for (auto _ : state)
+    {
+        filter::HDRMerge::merge(bracket, times, out);
+        benchmark::DoNotOptimize(out.getImagePtr());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(int64_t(state.iterations()) * bracket.size() * bracket[0].getNumberOfBytes());
+}
+BENCHMARK(BM_HDRMerge)->Arg(8)->Arg(16)->Unit(benchmark::kMicrosecond);
+
+// the portable path, for comparison with the SSE2 one
+static void BM_HDRMergeScalar(benchmark::State &state)
+{
+    const int depth = state.range(0);
+    std::vector<Frame> bracket(3);
+    std::vector<const uint8_t *> inputs;
+    std::vector<float> scales;
+    for (size_t k = 0; k < bracket.size(); k++)
+    {
+        bracket[k].init(1600, 1200, depth, MODE_GRAYSCALE);
+        benchmark_utils::fillNoise(bracket[k], depth == 8 ? 8 : 12, k + 1);
+        inputs.push_back(bracket[k].getImageConstPtr());
+        scales.push_back(1.0f / (1 << (2 * k)));
+    }
+    std::vector<uint16_t> out(1600 * 1200);
+    const float max_value = (1u << depth) - 1;
+    for (auto _ : state)
+    {
+        filter::HDRMerge::mergeScalar(inputs, scales, 0, depth > 8, max_value, 0, out.size(), &out[0]);
+        benchmark::DoNotOptimize(&out[0]);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HDRMergeScalar)->Arg(8)->Arg(16)->Unit(benchmark::kMicrosecond);
+
+static void BM_Tonemap(benchmark::State &state)
+{
+    Frame in(1600, 1200, 16, MODE_GRAYSCALE);
+    benchmark_utils::fillScene(in, 16);
+    Frame out;
+    for (auto _ : state)
+    {
+        filter::HDRMerge::tonemap(in, out);
+        benchmark::DoNotOptimize(out.getImagePtr());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Tonemap)->Unit(benchmark::kMicrosecond);
+
+// 1600x1200 scene at 8 bit, and at 12 significant bits in 16 bit words
+// like RAW16, on one thread and on four
+static void bayerCodecArgs(benchmark::internal::Benchmark *b)
+{
+    b->Args({ 8, 8, 1 })->Args({ 16, 12, 1 })->Args({ 16, 12, 4 });
+}
+
+static void BM_BayerEncode(benchmark::State &state)
+{
+    Frame frame(1600, 1200, state.range(0), MODE_BAYER_RGGB);
+    benchmark_utils::fillScene(frame, state.range(1));
+    filter::BayerCodec codec(state.range(2));
+    std::vector<uint8_t> data;
+    for (auto _ : state)
+        codec.encode(frame, data);
+    state.counters["ratio"] = (double)frame.getNumberOfBytes() / data.size();
+    state.SetBytesProcessed(int64_t(state.iterations()) * frame.getNumberOfBytes());
+}
+BENCHMARK(BM_BayerEncode)->Apply(bayerCodecArgs)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+static void BM_BayerDecode(benchmark::State &state)
+{
+    Frame frame(1600, 1200, state.range(0), MODE_BAYER_RGGB);
+    benchmark_utils::fillScene(frame, state.range(1));
+    filter::BayerCodec codec(state.range(2));
+    std::vector<uint8_t> data;
+    codec.encode(frame, data);
+    Frame decoded;
+    for (auto _ : state)
+        codec.decode(&data[0], data.size(), decoded);
+    state.SetBytesProcessed(int64_t(state.iterations()) * frame.getNumberOfBytes());
+}
+BENCHMARK(BM_BayerDecode)->Apply(bayerCodecArgs)->UseRealTime()->Unit(benchmark::kMicrosecond);
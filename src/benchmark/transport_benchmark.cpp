@@ -0,0 +1,134 @@
+/*
+ * File:   transport_benchmark.cpp
+ *
+ * Benchmarks of the frame fan-out and the shared memory transport.
+ */
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <vector>
+#include <sstream>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "FramePublisher.h"
+#include "ShmFrameRing.h"
+#include "CamFireWire.h"
+#include "BenchmarkUtils.h"
+
+using namespace base::samples::frame;
+using namespace camera;
+
+// publishing a 1600x1200 frame to N subscribers, which each hold on to
+// the newest frame only
+static void BM_FramePublisherFanout(benchmark::State &state)
+{
+    CamFireWire camera;
+    FramePublisher publisher(camera, 32);
+    std::vector<FrameSubscription *> subscriptions;
+    for (int i = 0; i < state.range(0); i++)
+        subscriptions.push_back(publisher.subscribe(SubscribeLatestOnly));
+
+    Frame frame(1600, 1200, 8, MODE_BAYER_RGGB);
+    for (auto _ : state)
+        publisher.publish(frame);
+    state.counters["pool_size"] = publisher.getPoolSize();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FramePublisherFanout)->Arg(1)->Arg(3)->Arg(8)->Unit(benchmark::kMicrosecond);
+
+/**
+ * Latency from ShmFrameWriter::write() until a reader in a child process
+ * has acquired the frame. The child measures the one-way latency against
+ * the timestamp in the slot (CLOCK_MONOTONIC is shared by both
+ * processes) and acknowledges every frame through a pipe, so the writer
+ * never overruns it.
+ */
+static void BM_ShmCrossProcessLatency(benchmark::State &state)
+{
+    const int width = state.range(0), height = state.range(1), depth = state.range(2);
+    std::ostringstream name;
+    name << "/camera_firewire_benchmark_" << getpid();
+
+    ShmFrameWriter writer;
+    if (!writer.create(name.str(), 4, width * height * depth / 8))
+    {
+        state.SkipWithError("cannot create the shared memory ring");
+        return;
+    }
+
+    int ack[2], result[2];
+    if (pipe(ack) != 0 || pipe(result) != 0)
+    {
+        state.SkipWithError("cannot create pipes");
+        return;
+    }
+
+    pid_t child = fork();
+    if (child == 0)
+    {
+        ShmFrameReader reader;
+        std::vector<uint32_t> latencies;
+        if (reader.open(name.str()))
+        {
+            ShmFrameView view;
+            while (reader.wait(1000) && reader.acquire(view))
+            {
+                uint64_t now = CaptureStatistics::now();
+                // a frame without pixels ends the measurement
+                if (view.width == 0)
+                    break;
+                benchmark::DoNotOptimize(view.data[view.image_bytes - 1]);
+                latencies.push_back(now - view.time.toMicroseconds());
+                char byte = 0;
+                if (write(ack[1], &byte, 1) != 1)
+                    break;
+            }
+        }
+        std::sort(latencies.begin(), latencies.end());
+        uint32_t summary[2] = { 0, 0 };
+        if (!latencies.empty())
+        {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < latencies.size(); i++)
+                sum += latencies[i];
+            summary[0] = sum / latencies.size();
+            summary[1] = latencies[latencies.size() * 99 / 100];
+        }
+        if (write(result[1], summary, sizeof(summary)) != sizeof(summary))
+            _exit(1);
+        _exit(0);
+    }
+
+    // the reader starts at the next frame, so it has to be mapped first
+    usleep(100000);
+    Frame frame(width, height, depth, MODE_BAYER_RGGB);
+    benchmark_utils::fillNoise(frame, depth);
+    for (auto _ : state)
+    {
+        frame.time = base::Time::fromMicroseconds(CaptureStatistics::now());
+        writer.write(frame);
+        char byte;
+        if (read(ack[0], &byte, 1) != 1)
+        {
+            state.SkipWithError("reader terminated");
+            break;
+        }
+    }
+
+    Frame end(0, 0, 8, MODE_GRAYSCALE);
+    writer.write(end);
+    uint32_t summary[2] = { 0, 0 };
+    if (read(result[0], summary, sizeof(summary)) != sizeof(summary))
+        state.SkipWithError("no result from the reader");
+    waitpid(child, NULL, 0);
+    close(ack[0]);
+    close(ack[1]);
+    close(result[0]);
+    close(result[1]);
+
+    state.counters["latency_mean_us"] = summary[0];
+    state.counters["latency_p99_us"] = summary[1];
+    state.SetBytesProcessed(int64_t(state.iterations()) * frame.getNumberOfBytes());
+}
+BENCHMARK(BM_ShmCrossProcessLatency)->Args({ 640, 480, 8 })->Args({ 1600, 1200, 16 })
+    ->UseRealTime()->Unit(benchmark::kMicrosecond);
@@ -1,6 +1,8 @@
 #ifndef CAM_FW_TYPES_H
 #define CAM_FW_TYPES_H
 
+#include <stdint.h>
+
 namespace camera {
 
  struct CalibrationData
@@ -14,7 +16,90 @@ namespace camera {
         float k3;
       };
 
-       
+ /**
+  * Defines which of the queued frames retrieveFrame() delivers.
+  */
+ enum RetrievePolicy
+      {
+        // deliver the frames in the order they were captured
+        RetrieveOldest,
+        // re-enqueue all stale frames and deliver the newest one
+        RetrieveLatest
+      };
+
+ /**
+  * Defines how the DMA ring depth passed to grab() is adapted, see
+  * RingDepthAdvisor.
+  */
+ enum RingDepthMode
+      {
+        // keep the depth passed to grab()
+        RingDepthFixed,
+        // log the recommended depth, but keep the ring
+        RingDepthRecommend,
+        // set up the ring again with the recommended depth when it is empty
+        RingDepthAdaptive
+      };
+
+ /**
+  * Format7 image window in pixels of the sensor.
+  */
+ struct RegionOfInterest
+      {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+
+        RegionOfInterest()
+            : x(0), y(0), width(0), height(0) {}
+        RegionOfInterest(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+            : x(x), y(y), width(width), height(height) {}
+      };
+
+ /**
+  * Capabilities of one Format7 mode. Modes with a smaller maximum image
+  * size than Format7_0 bin or subsample the sensor (depending on the
+  * camera model) by the given factors.
+  */
+ struct Format7ModeInfo
+      {
+        // 0..7 for Format7_0..Format7_7
+        int mode_index;
+        uint32_t max_width;
+        uint32_t max_height;
+        // reduction relative to Format7_0, 1 for full resolution
+        uint32_t horizontal_factor;
+        uint32_t vertical_factor;
+        bool supports_mono8;
+        bool supports_mono16;
+        bool supports_raw8;
+        bool supports_raw16;
+      };
+
+ /**
+  * Layout of the frame information (frame counter, trigger timestamp)
+  * which the camera embeds into the first quadlets of the image. The
+  * enable register and its value are model specific, see the camera
+  * manual.
+  */
+ struct EmbeddedInfoLayout
+      {
+        // register which switches the embedding on, 0 if the camera is
+        // already configured
+        uint64_t enable_register;
+        uint32_t enable_value;
+        // true if enable_register is an offset into the advanced feature CSRs
+        bool advanced_register;
+        // quadlet index of the frame counter, -1 if not embedded
+        int counter_quadlet;
+        // quadlet index of the cycle time stamp, -1 if not embedded
+        int timestamp_quadlet;
+
+        EmbeddedInfoLayout()
+            : enable_register(0), enable_value(0), advanced_register(false),
+              counter_quadlet(0), timestamp_quadlet(-1) {}
+      };
 
 }
 
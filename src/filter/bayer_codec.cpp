@@ -0,0 +1,570 @@
+#include "bayer_codec.h"
+
+#include <iostream>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <algorithm>
+
+using namespace base::samples::frame;
+namespace filter
+{
+    // the stream starts with this header and the size of every band
+    struct BayerStreamHeader
+    {
+        enum { MAGIC = 0x31524142 };
+
+        uint32_t magic;
+        uint16_t width;
+        uint16_t height;
+        uint16_t frame_mode;
+        uint8_t data_depth;
+        uint8_t reserved;
+        uint32_t band_count;
+    };
+
+    static const uint32_t BAND_ROWS = 64;
+    static const uint32_t BLOCK_SIZE = 32;
+    static const uint32_t K_BITS = 5;
+    // residuals with a longer unary part are stored verbatim, the zigzag
+    // coded residual of a 16 bit sample has up to 17 bits
+    static const uint32_t ESCAPE = 20;
+    static const uint32_t RAW_BITS = 18;
+
+    class BitWriter
+    {
+        public:
+            explicit BitWriter(std::vector<uint8_t> &buffer)
+                : buffer(buffer), pos(0), acc(0), bits(0) {}
+
+            // makes room for the given number of bytes
+            void reserve(size_t bytes)
+            {
+                if (pos + bytes + 8 > buffer.size())
+                    buffer.resize((pos + bytes + 8) * 2);
+            }
+
+            // n <= 32
+            void put(uint32_t value, uint32_t n)
+            {
+                acc = (acc << n) | value;
+                bits += n;
+                if (bits >= 32)
+                {
+                    bits -= 32;
+                    uint32_t word = acc >> bits;
+                    buffer[pos] = word >> 24;
+                    buffer[pos + 1] = word >> 16;
+                    buffer[pos + 2] = word >> 8;
+                    buffer[pos + 3] = word;
+                    pos += 4;
+                }
+            }
+
+            void flush()
+            {
+                while (bits >= 8)
+                {
+                    bits -= 8;
+                    buffer[pos++] = acc >> bits;
+                }
+                if (bits)
+                    buffer[pos++] = acc << (8 - bits);
+                bits = 0;
+                buffer.resize(pos);
+            }
+
+        private:
+            std::vector<uint8_t> &buffer;
+            size_t pos;
+            uint64_t acc;
+            uint32_t bits;
+    };
+
+    class BitReader
+    {
+        public:
+            BitReader(const uint8_t *begin, const uint8_t *end)
+                : ptr(begin), end(end), acc(0), bits(0), overrun(0) {}
+
+            // afterwards at least 57 bits are available
+            void refill()
+            {
+                while (bits <= 56)
+                {
+                    uint64_t byte = 0;
+                    if (ptr < end)
+                        byte = *ptr++;
+                    else
+                        overrun++;
+                    acc |= byte << (56 - bits);
+                    bits += 8;
+                }
+            }
+
+            // 0 < n <= 32
+            uint32_t get(uint32_t n)
+            {
+                uint32_t value = acc >> (64 - n);
+                acc <<= n;
+                bits -= n;
+                return value;
+            }
+
+            uint32_t leadingZeros() const
+            {
+                return acc ? __builtin_clzll(acc) : 64;
+            }
+
+            void skip(uint32_t n)
+            {
+                acc <<= n;
+                bits -= n;
+            }
+
+            // true if more bits were consumed than the stream has
+            bool isOverrun() const
+            {
+                return overrun * 8 > bits;
+            }
+
+        private:
+            const uint8_t *ptr;
+            const uint8_t *end;
+            uint64_t acc;
+            uint32_t bits;
+            uint32_t overrun;
+    };
+
+    // LOCO-I median edge detector
+    static inline int32_t predict(int32_t a, int32_t b, int32_t c)
+    {
+        int32_t lo = a < b ? a : b;
+        int32_t hi = a < b ? b : a;
+        if (c >= hi)
+            return lo;
+        if (c <= lo)
+            return hi;
+        return a + b - c;
+    }
+
+    static inline uint32_t riceParameter(uint32_t sum, uint32_t count)
+    {
+        uint32_t k = 0;
+        while ((count << k) < sum && k < RAW_BITS)
+            k++;
+        return k;
+    }
+
+    // codes the samples of one colour in a row, above is the previous row
+    // of the same colour or NULL at the top of a band
+    template<typename T>
+    static void encodeRow(const T *row, const T *above, uint32_t count, BitWriter &writer)
+    {
+        uint32_t residuals[BLOCK_SIZE];
+        writer.reserve(count * (ESCAPE + RAW_BITS) / 8 + count / BLOCK_SIZE + 8);
+        for (uint32_t begin = 0; begin < count; begin += BLOCK_SIZE)
+        {
+            const uint32_t end = begin + BLOCK_SIZE < count ? begin + BLOCK_SIZE : count;
+            uint32_t sum = 0;
+            for (uint32_t i = begin; i < end; i++)
+            {
+                int32_t a, b, c;
+                if (above)
+                {
+                    b = above[2 * i];
+                    a = i ? row[2 * i - 2] : b;
+                    c = i ? above[2 * i - 2] : b;
+                }
+                else
+                    a = b = c = i ? row[2 * i - 2] : 0;
+                int32_t e = (int32_t)row[2 * i] - predict(a, b, c);
+                residuals[i - begin] = ((uint32_t)e << 1) ^ (uint32_t)(e >> 31);
+                sum += residuals[i - begin];
+            }
+
+            const uint32_t k = riceParameter(sum, end - begin);
+            writer.put(k, K_BITS);
+            for (uint32_t i = 0; i < end - begin; i++)
+            {
+                uint32_t q = residuals[i] >> k;
+                if (q < ESCAPE)
+                {
+                    writer.put(1, q + 1);
+                    if (k)
+                        writer.put(residuals[i] & ((1u << k) - 1), k);
+                }
+                else
+                {
+                    writer.put(0, ESCAPE);
+                    writer.put(residuals[i], RAW_BITS);
+                }
+            }
+        }
+    }
+
+    template<typename T>
+    static void decodeRow(T *row, const T *above, uint32_t count, BitReader &reader)
+    {
+        for (uint32_t begin = 0; begin < count; begin += BLOCK_SIZE)
+        {
+            const uint32_t end = begin + BLOCK_SIZE < count ? begin + BLOCK_SIZE : count;
+            reader.refill();
+            const uint32_t k = reader.get(K_BITS);
+            for (uint32_t i = begin; i < end; i++)
+            {
+                reader.refill();
+                uint32_t residual;
+                uint32_t q = reader.leadingZeros();
+                if (q < ESCAPE)
+                {
+                    reader.skip(q + 1);
+                    residual = q << k;
+                    if (k)
+                        residual |= reader.get(k);
+                }
+                else
+                {
+                    reader.skip(ESCAPE);
+                    residual = reader.get(RAW_BITS);
+                }
+
+                int32_t a, b, c;
+                if (above)
+                {
+                    b = above[2 * i];
+                    a = i ? row[2 * i - 2] : b;
+                    c = i ? above[2 * i - 2] : b;
+                }
+                else
+                    a = b = c = i ? row[2 * i - 2] : 0;
+                int32_t e = (int32_t)(residual >> 1) ^ -(int32_t)(residual & 1);
+                row[2 * i] = predict(a, b, c) + e;
+            }
+        }
+    }
+
+    /**
+     * State shared by the threads working on one frame. The bands are
+     * handed out through an atomic counter.
+     */
+    struct BandJob
+    {
+        uint8_t *image;
+        uint32_t width;
+        uint32_t height;
+        uint32_t row_size;
+        bool wide;
+        bool encode;
+        uint32_t band_count;
+        int next_band;
+        int failed;
+        // encode: one stream per band, decode: the stream of each band
+        std::vector<std::vector<uint8_t> > streams;
+        std::vector<const uint8_t *> band_data;
+        std::vector<uint32_t> band_size;
+    };
+
+    template<typename T>
+    static bool processBand(BandJob &job, uint32_t band)
+    {
+        const uint32_t first = band * BAND_ROWS;
+        const uint32_t last = first + BAND_ROWS < job.height ? first + BAND_ROWS : job.height;
+        const uint32_t count = job.width / 2;
+        if (job.encode)
+        {
+            // room for the band uncompressed, more is rarely needed
+            job.streams[band].resize((last - first) * job.width * sizeof(T) + 64);
+            BitWriter writer(job.streams[band]);
+            for (uint32_t y = first; y < last; y++)
+            {
+                const T *row = reinterpret_cast<const T *>(job.image + y * job.row_size);
+                const T *above = y >= first + 2 ? reinterpret_cast<const T *>(job.image + (y - 2) * job.row_size) : NULL;
+                encodeRow(row, above, count, writer);
+                encodeRow(row + 1, above ? above + 1 : NULL, count, writer);
+            }
+            writer.flush();
+            return true;
+        }
+
+        BitReader reader(job.band_data[band], job.band_data[band] + job.band_size[band]);
+        for (uint32_t y = first; y < last; y++)
+        {
+            T *row = reinterpret_cast<T *>(job.image + y * job.row_size);
+            const T *above = y >= first + 2 ? reinterpret_cast<const T *>(job.image + (y - 2) * job.row_size) : NULL;
+            decodeRow(row, above, count, reader);
+            decodeRow(row + 1, above ? above + 1 : NULL, count, reader);
+        }
+        return !reader.isOverrun();
+    }
+
+    static void runBands(BandJob &job)
+    {
+        while (true)
+        {
+            int band = __sync_fetch_and_add(&job.next_band, 1);
+            if (band >= (int)job.band_count)
+                break;
+            bool ok = job.wide ? processBand<uint16_t>(job, band) : processBand<uint8_t>(job, band);
+            if (!ok)
+                __sync_fetch_and_add(&job.failed, 1);
+        }
+    }
+
+    /**
+     * Helper threads of a codec, which sleep between the frames. The job
+     * is reused, so its band buffers keep their capacity.
+     */
+    struct BayerCodec::Workers
+    {
+        BandJob job;
+        std::vector<pthread_t> threads;
+        pthread_mutex_t mutex;
+        pthread_cond_t start;
+        pthread_cond_t done;
+        // incremented for every frame the helpers have to work on
+        uint32_t generation;
+        uint32_t busy;
+        // helpers which have taken the current generation as their start
+        uint32_t ready;
+        bool quit;
+
+        Workers() : generation(0), busy(0), ready(0), quit(false)
+        {
+            pthread_mutex_init(&mutex, NULL);
+            pthread_cond_init(&start, NULL);
+            pthread_cond_init(&done, NULL);
+        }
+
+        ~Workers()
+        {
+            stop();
+            pthread_cond_destroy(&done);
+            pthread_cond_destroy(&start);
+            pthread_mutex_destroy(&mutex);
+        }
+
+        void resize(unsigned helpers)
+        {
+            for (unsigned i = threads.size(); i < helpers; i++)
+            {
+                pthread_t thread;
+                if (pthread_create(&thread, NULL, threadFunc, this) != 0)
+                    break;
+                threads.push_back(thread);
+            }
+            // a helper starting late would miss the next generation
+            pthread_mutex_lock(&mutex);
+            while (ready < threads.size())
+                pthread_cond_wait(&done, &mutex);
+            pthread_mutex_unlock(&mutex);
+        }
+
+        void stop()
+        {
+            pthread_mutex_lock(&mutex);
+            quit = true;
+            pthread_cond_broadcast(&start);
+            pthread_mutex_unlock(&mutex);
+            for (size_t i = 0; i < threads.size(); i++)
+                pthread_join(threads[i], NULL);
+            threads.clear();
+            ready = 0;
+            quit = false;
+        }
+
+        // works through the bands on the calling thread and the helpers
+        bool run()
+        {
+            job.next_band = 0;
+            job.failed = 0;
+            pthread_mutex_lock(&mutex);
+            generation++;
+            busy = threads.size();
+            pthread_cond_broadcast(&start);
+            pthread_mutex_unlock(&mutex);
+
+            runBands(job);
+
+            // the job must not change before every helper has left it
+            pthread_mutex_lock(&mutex);
+            while (busy > 0)
+                pthread_cond_wait(&done, &mutex);
+            pthread_mutex_unlock(&mutex);
+            return job.failed == 0;
+        }
+
+        static void *threadFunc(void *arg)
+        {
+            Workers &workers = *static_cast<Workers *>(arg);
+            pthread_mutex_lock(&workers.mutex);
+            uint32_t seen = workers.generation;
+            workers.ready++;
+            pthread_cond_broadcast(&workers.done);
+            while (true)
+            {
+                while (!workers.quit && workers.generation == seen)
+                    pthread_cond_wait(&workers.start, &workers.mutex);
+                if (workers.quit)
+                    break;
+                seen = workers.generation;
+                pthread_mutex_unlock(&workers.mutex);
+
+                runBands(workers.job);
+
+                pthread_mutex_lock(&workers.mutex);
+                if (--workers.busy == 0)
+                    pthread_cond_signal(&workers.done);
+            }
+            pthread_mutex_unlock(&workers.mutex);
+            return NULL;
+        }
+    };
+
+    BayerCodec::BayerCodec(unsigned count)
+        : workers(new Workers), threads(0)
+    {
+        setThreads(count);
+    }
+
+    BayerCodec::~BayerCodec()
+    {
+        delete workers;
+    }
+
+    void BayerCodec::setThreads(unsigned count)
+    {
+        if (count == 0)
+        {
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            count = cores > 0 ? cores : 1;
+        }
+        if (count != threads)
+            workers->stop();
+        threads = count;
+    }
+
+    unsigned BayerCodec::getThreads() const
+    {
+        return threads;
+    }
+
+    bool BayerCodec::isSupported(const Frame &frame)
+    {
+        const uint32_t depth = frame.getDataDepth();
+        return frame.getChannelCount() == 1 && !frame.isCompressed() && (depth == 8 || depth == 16) &&
+            frame.getWidth() % 2 == 0 && frame.getHeight() % 2 == 0 && frame.getWidth() > 0 && frame.getHeight() > 0;
+    }
+
+    bool BayerCodec::encode(const Frame &in, std::vector<uint8_t> &data)
+    {
+        if (!isSupported(in))
+        {
+            std::cerr << "BayerCodec: " << __FUNCTION__
+                << ": only single channel 8 and 16 bit frames of even size are supported" << std::endl;
+            return false;
+        }
+
+        BandJob &job = workers->job;
+        job.image = const_cast<uint8_t *>(in.getImageConstPtr());
+        job.width = in.getWidth();
+        job.height = in.getHeight();
+        job.row_size = in.getRowSize();
+        job.wide = in.getDataDepth() == 16;
+        job.encode = true;
+        job.band_count = (job.height + BAND_ROWS - 1) / BAND_ROWS;
+        job.streams.resize(job.band_count);
+        workers->resize(std::min(threads, job.band_count) - 1);
+        workers->run();
+
+        BayerStreamHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = BayerStreamHeader::MAGIC;
+        header.width = job.width;
+        header.height = job.height;
+        header.frame_mode = in.getFrameMode();
+        header.data_depth = in.getDataDepth();
+        header.band_count = job.band_count;
+
+        size_t size = sizeof(header) + job.band_count * sizeof(uint32_t);
+        for (uint32_t i = 0; i < job.band_count; i++)
+            size += job.streams[i].size();
+        data.resize(size);
+
+        uint8_t *ptr = &data[0];
+        memcpy(ptr, &header, sizeof(header));
+        ptr += sizeof(header);
+        for (uint32_t i = 0; i < job.band_count; i++)
+        {
+            uint32_t band_size = job.streams[i].size();
+            memcpy(ptr, &band_size, sizeof(band_size));
+            ptr += sizeof(band_size);
+        }
+        for (uint32_t i = 0; i < job.band_count; i++)
+        {
+            if (job.streams[i].empty())
+                continue;
+            memcpy(ptr, &job.streams[i][0], job.streams[i].size());
+            ptr += job.streams[i].size();
+        }
+        return true;
+    }
+
+    bool BayerCodec::decode(const uint8_t *data, size_t size, Frame &out)
+    {
+        BayerStreamHeader header;
+        if (size < sizeof(header))
+        {
+            std::cerr << "BayerCodec: " << __FUNCTION__ << ": truncated stream" << std::endl;
+            return false;
+        }
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != BayerStreamHeader::MAGIC || (header.data_depth != 8 && header.data_depth != 16) ||
+            header.width % 2 || header.height % 2 ||
+            header.band_count != (header.height + BAND_ROWS - 1u) / BAND_ROWS)
+        {
+            std::cerr << "BayerCodec: " << __FUNCTION__ << ": invalid stream header" << std::endl;
+            return false;
+        }
+
+        BandJob &job = workers->job;
+        job.width = header.width;
+        job.height = header.height;
+        job.wide = header.data_depth == 16;
+        job.encode = false;
+        job.band_count = header.band_count;
+        job.band_data.resize(job.band_count);
+        job.band_size.resize(job.band_count);
+
+        size_t offset = sizeof(header) + job.band_count * sizeof(uint32_t);
+        if (offset > size)
+        {
+            std::cerr << "BayerCodec: " << __FUNCTION__ << ": truncated stream" << std::endl;
+            return false;
+        }
+        for (uint32_t i = 0; i < job.band_count; i++)
+        {
+            memcpy(&job.band_size[i], data + sizeof(header) + i * sizeof(uint32_t), sizeof(uint32_t));
+            job.band_data[i] = data + offset;
+            offset += job.band_size[i];
+            if (offset > size)
+            {
+                std::cerr << "BayerCodec: " << __FUNCTION__ << ": truncated stream" << std::endl;
+                return false;
+            }
+        }
+
+        out.init(header.width, header.height, header.data_depth, (frame_mode_t)header.frame_mode);
+        job.image = out.getImagePtr();
+        job.row_size = out.getRowSize();
+        workers->resize(std::min(threads, job.band_count) - 1);
+        if (!workers->run())
+        {
+            std::cerr << "BayerCodec: " << __FUNCTION__ << ": corrupt stream" << std::endl;
+            return false;
+        }
+        out.setStatus(STATUS_VALID);
+        return true;
+    }
+
+}
@@ -0,0 +1,67 @@
+#ifndef FILTER_BAYER_CODEC
+#define FILTER_BAYER_CODEC 1
+
+#include <vector>
+#include <stdint.h>
+#include "base/samples/Frame.hpp"
+
+namespace filter
+{
+
+    /**
+     * Lossless codec for single channel 8 and 16 bit frames, mainly
+     * Bayer mosaics.
+     *
+     * Each of the four positions of the 2x2 pattern is predicted from its
+     * neighbours of the same colour (the MED predictor of LOCO-I) and the
+     * residuals are Rice coded with a parameter chosen per block of 32
+     * samples. The frame is cut into bands of 64 rows which are coded
+     * independently, so encoding and decoding run on several threads. A
+     * RAW16 frame with 12 significant bits typically shrinks to less
+     * than half.
+     *
+     * The worker threads are started with the first frame which needs
+     * them and are kept until the codec is destroyed, so a codec should
+     * live as long as the stream it codes. A codec codes one frame at a
+     * time.
+     */
+    class BayerCodec
+    {
+        public:
+            /**
+             * @param threads threads coding the bands of a frame including
+             *        the calling one, 0 uses all cores
+             */
+            explicit BayerCodec(unsigned threads = 0);
+            ~BayerCodec();
+
+            /** Changes the number of threads, running workers are stopped */
+            void setThreads(unsigned threads);
+            unsigned getThreads() const;
+
+            /**
+             * Encodes the frame into data.
+             * @return false if the frame is not single channel 8 or 16 bit
+             *         with an even width and height
+             */
+            bool encode(const base::samples::frame::Frame &in, std::vector<uint8_t> &data);
+
+            /** Decodes data written by encode() into out */
+            bool decode(const uint8_t *data, size_t size, base::samples::frame::Frame &out);
+
+            /** True if encode() accepts frames of this format */
+            static bool isSupported(const base::samples::frame::Frame &frame);
+
+        private:
+            // not copyable, the workers belong to one codec
+            BayerCodec(const BayerCodec &);
+            BayerCodec &operator=(const BayerCodec &);
+
+            struct Workers;
+            Workers *workers;
+            unsigned threads;
+    };
+
+}
+
+#endif /* FILTER_BAYER_CODEC */
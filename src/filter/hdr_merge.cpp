@@ -0,0 +1,306 @@
+#include "hdr_merge.h"
+
+#include <iostream>
+#include <string.h>
+#include <algorithm>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace base::samples::frame;
+namespace filter
+{
+    // reset level of a kneepoint, 0 if the kneepoint is off
+    static uint32_t kneeVoltage(uint32_t voltage1, uint32_t voltage2)
+    {
+        return voltage1 ? voltage1 : voltage2;
+    }
+
+    MultiSlopeCurve MultiSlopeCurve::fromHDRValue(int hdr_value, double exposure_time)
+    {
+        MultiSlopeCurve curve;
+        const uint32_t value = (uint32_t)hdr_value;
+        const uint32_t knees[2] = { kneeVoltage(value & 0xFFUL, (value >> 8) & 0xFFUL),
+                                    kneeVoltage((value >> 16) & 0xFFUL, (value >> 24) & 0xFFUL) };
+        // setAttrib() only enables the second kneepoint with the first one
+        if (knees[0] == 0 || exposure_time <= KNEEPOINT_TIME)
+            return curve;
+
+        const double slope = KNEEPOINT_TIME / exposure_time;
+        for (int k = 0; k < 2 && knees[k]; k++)
+        {
+            // the pixels clamped at the knee rise again during the
+            // kneepoint time, so the knee shows up slightly above the voltage
+            double level = knees[k] / 255.0 * exposure_time / (exposure_time - KNEEPOINT_TIME);
+            if (level >= 1 || (k > 0 && level <= curve.knee_level[0]))
+                break;
+            curve.knee_level[k] = level;
+            curve.slope[k] = slope;
+            curve.knee_count = k + 1;
+        }
+        return curve;
+    }
+
+    static inline float loadValue(const uint8_t *input, bool input16, uint32_t index)
+    {
+        if (input16)
+            return reinterpret_cast<const uint16_t *>(input)[index];
+        return input[index];
+    }
+
+    void HDRMerge::mergeScalar(const std::vector<const uint8_t *> &inputs,
+                               const std::vector<float> &scales,
+                               int shortest, bool input16, float max_value,
+                               uint32_t begin, uint32_t end, uint16_t *out)
+    {
+        const float out_scale = 65535.0f / max_value;
+        for (uint32_t i = begin; i < end; i++)
+        {
+            // the shortest exposure always has a small weight, so
+            // pixels saturated in all frames end up at full scale
+            float numerator = 0, denominator = 0;
+            for (size_t k = 0; k < inputs.size(); k++)
+            {
+                float z = loadValue(inputs[k], input16, i);
+                float weight = std::min(z, max_value - z);
+                if ((int)k == shortest)
+                    weight += 1;
+                numerator += weight * z * scales[k];
+                denominator += weight;
+            }
+            // lrintf() rounds to nearest even like _mm_cvtps_epi32, so
+            // both paths give the same output
+            float value = numerator / denominator * out_scale;
+            out[i] = value >= 65535.0f ? 65535 : (uint16_t)lrintf(value);
+        }
+    }
+
+#ifdef __SSE2__
+    static inline __m128 load4(const uint8_t *input, bool input16, uint32_t index)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i words;
+        if (input16)
+            words = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(input + 2 * index));
+        else
+        {
+            int32_t bytes;
+            memcpy(&bytes, input + index, sizeof(bytes));
+            words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+        }
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+    }
+
+    static inline void store4(uint16_t *out, __m128 value)
+    {
+        // SSE2 has no unsigned 32 to 16 bit pack, so the values are moved
+        // into the signed range and back
+        value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(65535.0f));
+        __m128i ints = _mm_sub_epi32(_mm_cvtps_epi32(value), _mm_set1_epi32(32768));
+        __m128i words = _mm_xor_si128(_mm_packs_epi32(ints, ints), _mm_set1_epi16((short)0x8000));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out), words);
+    }
+#endif
+
+    bool HDRMerge::merge(const std::vector<Frame> &bracket,
+                         const std::vector<double> &exposure_times,
+                         Frame &out)
+    {
+        if (bracket.empty())
+        {
+            std::cerr << "HDRMerge: " << __FUNCTION__ << ": empty bracket" << std::endl;
+            return false;
+        }
+
+        const Frame &first = bracket[0];
+        if (first.getDataDepth() > 16 || first.isCompressed())
+        {
+            std::cerr << "HDRMerge: " << __FUNCTION__ << ": only 8 and 16 bit frames are supported"
+                << std::endl;
+            return false;
+        }
+
+        // the raw shutter register is not linear in time on most cameras,
+        // so only absolute exposure times are used
+        std::vector<double> times(exposure_times);
+        if (times.empty())
+        {
+            for (size_t k = 0; k < bracket.size(); k++)
+            {
+                if (!bracket[k].hasAttribute("ExposureTime"))
+                {
+                    std::cerr << "HDRMerge: " << __FUNCTION__ << ": frame " << k
+                        << " has no absolute exposure time, pass the exposure times" << std::endl;
+                    return false;
+                }
+                times.push_back(bracket[k].getAttribute<double>("ExposureTime"));
+            }
+        }
+        if (times.size() != bracket.size())
+        {
+            std::cerr << "HDRMerge: " << __FUNCTION__ << ": " << times.size()
+                << " exposure times for " << bracket.size() << " frames" << std::endl;
+            return false;
+        }
+
+        int shortest = 0;
+        for (size_t k = 0; k < bracket.size(); k++)
+        {
+            if (bracket[k].getSize() == first.getSize() && bracket[k].getFrameMode() == first.getFrameMode() &&
+                bracket[k].getDataDepth() == first.getDataDepth() && times[k] > 0)
+            {
+                if (times[k] < times[shortest])
+                    shortest = k;
+                continue;
+            }
+            std::cerr << "HDRMerge: " << __FUNCTION__ << ": frame " << k
+                << " does not match the bracket" << std::endl;
+            return false;
+        }
+
+        // radiance in units of the shortest exposure
+        std::vector<float> scales(bracket.size());
+        std::vector<const uint8_t *> inputs(bracket.size());
+        for (size_t k = 0; k < bracket.size(); k++)
+        {
+            scales[k] = times[shortest] / times[k];
+            inputs[k] = bracket[k].getImageConstPtr();
+        }
+
+        out.init(first.getWidth(), first.getHeight(), 16, first.getFrameMode());
+        uint16_t *outptr = reinterpret_cast<uint16_t *>(out.getImagePtr());
+        const bool input16 = first.getDataDepth() > 8;
+        const float max_value = (1u << first.getDataDepth()) - 1;
+        const uint32_t count = first.getPixelCount() * first.getChannelCount();
+
+        uint32_t done = 0;
+#ifdef __SSE2__
+        const __m128 max4 = _mm_set1_ps(max_value);
+        const __m128 out_scale = _mm_set1_ps(65535.0f / max_value);
+        const __m128 one = _mm_set1_ps(1.0f);
+        for (; done + 4 <= count; done += 4)
+        {
+            __m128 numerator = _mm_setzero_ps();
+            __m128 denominator = _mm_setzero_ps();
+            for (size_t k = 0; k < inputs.size(); k++)
+            {
+                __m128 z = load4(inputs[k], input16, done);
+                __m128 weight = _mm_min_ps(z, _mm_sub_ps(max4, z));
+                if ((int)k == shortest)
+                    weight = _mm_add_ps(weight, one);
+                numerator = _mm_add_ps(numerator, _mm_mul_ps(_mm_mul_ps(weight, z), _mm_set1_ps(scales[k])));
+                denominator = _mm_add_ps(denominator, weight);
+            }
+            store4(outptr + done, _mm_mul_ps(_mm_div_ps(numerator, denominator), out_scale));
+        }
+#endif
+        mergeScalar(inputs, scales, shortest, input16, max_value, done, count, outptr);
+
+        out.time = bracket[shortest].time;
+        out.setHDR(true);
+        out.setStatus(STATUS_VALID);
+        return true;
+    }
+
+    bool HDRMerge::linearize(const Frame &in, const MultiSlopeCurve &curve, Frame &out)
+    {
+        if (in.getDataDepth() > 16 || in.isCompressed())
+        {
+            std::cerr << "HDRMerge: " << __FUNCTION__ << ": only 8 and 16 bit frames are supported"
+                << std::endl;
+            return false;
+        }
+
+        // inverse of the response, relative to the full scale
+        const uint32_t max_value = (1u << in.getDataDepth()) - 1;
+        double k1 = curve.knee_count > 0 ? curve.knee_level[0] : 1;
+        double k2 = curve.knee_count > 1 ? curve.knee_level[1] : 1;
+        double s1 = curve.knee_count > 0 && curve.slope[0] > 0 ? curve.slope[0] : 1;
+        double s2 = curve.knee_count > 1 && curve.slope[1] > 0 ? curve.slope[1] : 1;
+        double linear_max = k1 + (k2 - k1) / s1 + (1 - k2) / s2;
+
+        std::vector<uint16_t> lut(max_value + 1);
+        for (uint32_t c = 0; c <= max_value; c++)
+        {
+            double y = (double)c / max_value;
+            double x;
+            if (y <= k1)
+                x = y;
+            else if (y <= k2)
+                x = k1 + (y - k1) / s1;
+            else
+                x = k1 + (k2 - k1) / s1 + (y - k2) / s2;
+            lut[c] = (uint16_t)(x / linear_max * 65535 + 0.5);
+        }
+
+        out.init(in.getWidth(), in.getHeight(), 16, in.getFrameMode());
+        uint16_t *outptr = reinterpret_cast<uint16_t *>(out.getImagePtr());
+        const uint32_t count = in.getPixelCount() * in.getChannelCount();
+        if (in.getDataDepth() > 8)
+        {
+            const uint16_t *inptr = reinterpret_cast<const uint16_t *>(in.getImageConstPtr());
+            for (uint32_t i = 0; i < count; i++)
+                outptr[i] = lut[inptr[i] & max_value];
+        }
+        else
+        {
+            const uint8_t *inptr = in.getImageConstPtr();
+            for (uint32_t i = 0; i < count; i++)
+                outptr[i] = lut[inptr[i]];
+        }
+
+        out.time = in.time;
+        out.setHDR(true);
+        out.setStatus(STATUS_VALID);
+        return true;
+    }
+
+    bool HDRMerge::tonemap(const Frame &in, Frame &out, double key)
+    {
+        if (in.getDataDepth() != 16)
+        {
+            std::cerr << "HDRMerge: " << __FUNCTION__ << ": 16 bit frame expected" << std::endl;
+            return false;
+        }
+
+        const uint16_t *inptr = reinterpret_cast<const uint16_t *>(in.getImageConstPtr());
+        const uint32_t count = in.getPixelCount() * in.getChannelCount();
+
+        // log average and maximum of a subsample of the frame
+        const uint32_t step = 7;
+        double log_sum = 0;
+        uint32_t samples = 0;
+        uint16_t max_sample = 1;
+        for (uint32_t i = 0; i < count; i += step)
+        {
+            log_sum += log(1e-4 + inptr[i] / 65535.0);
+            if (inptr[i] > max_sample)
+                max_sample = inptr[i];
+            samples++;
+        }
+        double log_average = samples ? exp(log_sum / samples) : 1;
+
+        // the white point is the brightest sample, so nothing saturates
+        double white = key * (max_sample / 65535.0) / log_average;
+        double white2 = white * white;
+        std::vector<uint8_t> lut(65536);
+        for (uint32_t v = 0; v < 65536; v++)
+        {
+            double l = key * (v / 65535.0) / log_average;
+            double mapped = l * (1 + l / white2) / (1 + l) * 255 + 0.5;
+            lut[v] = mapped >= 255 ? 255 : (uint8_t)mapped;
+        }
+
+        out.init(in.getWidth(), in.getHeight(), 8, in.getFrameMode());
+        uint8_t *outptr = out.getImagePtr();
+        for (uint32_t i = 0; i < count; i++)
+            outptr[i] = lut[inptr[i]];
+
+        out.time = in.time;
+        out.setStatus(STATUS_VALID);
+        return true;
+    }
+
+}
@@ -0,0 +1,95 @@
+#ifndef FILTER_HDR_MERGE
+#define FILTER_HDR_MERGE 1
+
+#include "base/samples/Frame.hpp"
+#include <vector>
+#include <stdint.h>
+
+namespace filter
+{
+
+    /**
+     * Response of a multiple-slope (AVT HDR mode) exposure. Up to the
+     * first knee level the response is linear, above each knee level it
+     * rises with the given slope relative to the linear part.
+     * Levels are fractions of the full scale (0..1).
+     */
+    struct MultiSlopeCurve
+    {
+        int knee_count;
+        double knee_level[2];
+        double slope[2];
+
+        MultiSlopeCurve() : knee_count(0)
+        {
+            knee_level[0] = knee_level[1] = 1;
+            slope[0] = slope[1] = 1;
+        }
+
+        /**
+         * Kneepoint time CamFireWire writes with the HDRValue attribute,
+         * in the time unit of the multiple slope register (us)
+         */
+        static const uint32_t KNEEPOINT_TIME = 1;
+
+        /**
+         * Curve of the settings CamFireWire writes for the HDRValue
+         * attribute. Its bytes are voltage 1 and 2 of kneepoint 1 (bits
+         * 0-7, 8-15) and of kneepoint 2 (bits 16-23, 24-31); a kneepoint is
+         * active if one of its voltages is non-zero. At a kneepoint the
+         * pixels above its voltage (voltage 1, or voltage 2 if voltage 1
+         * is 0, in 1/255 of full scale) are reset to it and integrate for
+         * the remaining KNEEPOINT_TIME, so the slope above the knee is
+         * KNEEPOINT_TIME / exposure_time.
+         * @param exposure_time exposure of the frame in us
+         */
+        static MultiSlopeCurve fromHDRValue(int hdr_value, double exposure_time);
+    };
+
+    /**
+     * High dynamic range filters for bracketed exposures and multiple-slope
+     * frames. The per pixel loops use SSE2 when available.
+     */
+    class HDRMerge
+    {
+        public:
+            /**
+             * Merges frames of an exposure bracket into a 16 bit frame of
+             * scene radiance in units of the shortest exposure.
+             *
+             * Every pixel is the average of the frames weighted by the
+             * distance of the pixel value from black and from saturation.
+             * All frames must have the same size, mode and depth (8 or 16 bit).
+             * @param exposure_times exposure of each frame in any linear
+             *        unit, taken from the "ExposureTime" attributes (s) if
+             *        empty. The raw "ShutterValue" is not used, as the
+             *        shutter register is not linear in time on most cameras.
+             */
+            static bool merge(const std::vector<base::samples::frame::Frame> &bracket,
+                              const std::vector<double> &exposure_times,
+                              base::samples::frame::Frame &out);
+
+            /** Linearizes a multiple-slope frame into a 16 bit frame */
+            static bool linearize(const base::samples::frame::Frame &in,
+                                  const MultiSlopeCurve &curve,
+                                  base::samples::frame::Frame &out);
+
+            /**
+             * Maps a 16 bit HDR frame to 8 bit with a global photographic
+             * (Reinhard) operator.
+             * @param key brightness of the average scene luminance in the result
+             */
+            static bool tonemap(const base::samples::frame::Frame &in,
+                                base::samples::frame::Frame &out,
+                                double key = 0.18);
+
+            /** Scalar merge kernel, also used for the remaining pixels */
+            static void mergeScalar(const std::vector<const uint8_t *> &inputs,
+                                    const std::vector<float> &scales,
+                                    int shortest, bool input16, float max_value,
+                                    uint32_t begin, uint32_t end, uint16_t *out);
+    };
+
+}
+
+#endif /* FILTER_HDR_MERGE */
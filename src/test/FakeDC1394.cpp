@@ -0,0 +1,221 @@
+/*
+ * File:   FakeDC1394.cpp
+ *
+ * Simulated camera behind the libdc1394 calls of CamFireWire.
+ */
+
+#include "FakeDC1394.h"
+#include <string.h>
+
+using namespace fake_dc1394;
+
+namespace fake_dc1394
+{
+
+static FakeCamera fake;
+// only its address is used
+static char context;
+
+FakeCamera &camera()
+{
+    return fake;
+}
+
+void reset(uint64_t guid, uint32_t width, uint32_t height)
+{
+    fake.guid = guid;
+    fake.present = true;
+    fake.generation = 1;
+    fake.mode = DC1394_VIDEO_MODE_640x480_MONO8;
+    fake.capturing = false;
+    fake.ring_size = 0;
+    fake.capture_setups = 0;
+    fake.queued = 0;
+    fake.counter = 0;
+    fake.timestamp = 1000000;
+    fake.handles = 0;
+    fake.image.assign(width * height, 0);
+    memset(&fake.frame, 0, sizeof(fake.frame));
+    fake.frame.image = &fake.image[0];
+    fake.frame.image_bytes = fake.image.size();
+    fake.frame.total_bytes = fake.image.size();
+    fake.frame.size[0] = width;
+    fake.frame.size[1] = height;
+    fake.frame.packets_per_frame = 1;
+}
+
+dc1394_t *device()
+{
+    return reinterpret_cast<dc1394_t *>(&context);
+}
+
+}
+
+static dc1394error_t result()
+{
+    return fake.present ? DC1394_SUCCESS : DC1394_FAILURE;
+}
+
+void dc1394_free(dc1394_t *)
+{
+}
+
+dc1394camera_t *dc1394_camera_new(dc1394_t *, uint64_t guid)
+{
+    if (!fake.present || guid != fake.guid)
+        return NULL;
+    dc1394camera_t *camera = new dc1394camera_t();
+    camera->guid = guid;
+    fake.handles++;
+    return camera;
+}
+
+void dc1394_camera_free(dc1394camera_t *camera)
+{
+    fake.handles--;
+    delete camera;
+}
+
+dc1394error_t dc1394_camera_set_broadcast(dc1394camera_t *, dc1394bool_t)
+{
+    return result();
+}
+
+dc1394error_t dc1394_camera_get_node(dc1394camera_t *, uint32_t *node, uint32_t *generation)
+{
+    *node = 0;
+    *generation = fake.generation;
+    return result();
+}
+
+dc1394error_t dc1394_iso_release_all(dc1394camera_t *)
+{
+    return result();
+}
+
+dc1394error_t dc1394_video_get_supported_modes(dc1394camera_t *, dc1394video_modes_t *modes)
+{
+    modes->num = 2;
+    modes->modes[0] = DC1394_VIDEO_MODE_640x480_MONO8;
+    modes->modes[1] = DC1394_VIDEO_MODE_1600x1200_MONO8;
+    return result();
+}
+
+dc1394error_t dc1394_video_get_mode(dc1394camera_t *, dc1394video_mode_t *mode)
+{
+    *mode = fake.mode;
+    return result();
+}
+
+dc1394error_t dc1394_video_set_mode(dc1394camera_t *, dc1394video_mode_t mode)
+{
+    fake.mode = mode;
+    return result();
+}
+
+dc1394error_t dc1394_video_get_framerate(dc1394camera_t *, dc1394framerate_t *framerate)
+{
+    *framerate = DC1394_FRAMERATE_30;
+    return result();
+}
+
+dc1394error_t dc1394_video_set_framerate(dc1394camera_t *, dc1394framerate_t)
+{
+    return result();
+}
+
+dc1394error_t dc1394_video_get_iso_speed(dc1394camera_t *, dc1394speed_t *speed)
+{
+    *speed = DC1394_ISO_SPEED_400;
+    return result();
+}
+
+dc1394error_t dc1394_video_set_iso_speed(dc1394camera_t *, dc1394speed_t)
+{
+    return result();
+}
+
+dc1394error_t dc1394_video_get_operation_mode(dc1394camera_t *, dc1394operation_mode_t *mode)
+{
+    *mode = DC1394_OPERATION_MODE_LEGACY;
+    return result();
+}
+
+dc1394error_t dc1394_video_set_operation_mode(dc1394camera_t *, dc1394operation_mode_t)
+{
+    return result();
+}
+
+dc1394error_t dc1394_video_set_transmission(dc1394camera_t *, dc1394switch_t)
+{
+    return result();
+}
+
+dc1394error_t dc1394_feature_get_all(dc1394camera_t *, dc1394featureset_t *features)
+{
+    // no feature is available, so none is restored
+    memset(features, 0, sizeof(*features));
+    return result();
+}
+
+dc1394error_t dc1394_feature_get_mode(dc1394camera_t *, dc1394feature_t, dc1394feature_mode_t *mode)
+{
+    *mode = DC1394_FEATURE_MODE_MANUAL;
+    return result();
+}
+
+dc1394error_t dc1394_external_trigger_get_power(dc1394camera_t *, dc1394switch_t *power)
+{
+    *power = DC1394_OFF;
+    return result();
+}
+
+dc1394error_t dc1394_capture_setup(dc1394camera_t *, uint32_t buffers, uint32_t)
+{
+    fake.capture_setups++;
+    if (!fake.present)
+        return DC1394_FAILURE;
+    fake.capturing = true;
+    fake.ring_size = buffers;
+    fake.queued = 0;
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_capture_stop(dc1394camera_t *)
+{
+    fake.capturing = false;
+    fake.queued = 0;
+    return result();
+}
+
+int dc1394_capture_get_fileno(dc1394camera_t *)
+{
+    return -1;
+}
+
+dc1394error_t dc1394_capture_dequeue(dc1394camera_t *, dc1394capture_policy_t, dc1394video_frame_t **frame)
+{
+    *frame = NULL;
+    if (!fake.present || !fake.capturing)
+        return DC1394_FAILURE;
+    if (fake.queued == 0)
+        return DC1394_SUCCESS;
+
+    fake.queued--;
+    unsigned char *image = &fake.image[0];
+    image[0] = fake.counter >> 24;
+    image[1] = fake.counter >> 16;
+    image[2] = fake.counter >> 8;
+    image[3] = fake.counter;
+    fake.counter++;
+    fake.timestamp += 33333;
+    fake.frame.timestamp = fake.timestamp;
+    fake.frame.frames_behind = fake.queued;
+    *frame = &fake.frame;
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_capture_enqueue(dc1394camera_t *, dc1394video_frame_t *)
+{
+    return result();
+}
@@ -0,0 +1,58 @@
+/*
+ * File:   FakeDC1394.h
+ *
+ * Simulated camera behind the libdc1394 calls of CamFireWire.
+ */
+
+#ifndef _FAKEDC1394_H
+#define	_FAKEDC1394_H
+
+#include <vector>
+#include <stdint.h>
+#include <dc1394/dc1394.h>
+
+/**
+ * The test binary defines the libdc1394 functions which CamFireWire
+ * calls to open a camera, capture and recover, so they take precedence
+ * over the library. They act on one simulated camera, which offers the
+ * 640x480 and 1600x1200 MONO8 modes and delivers frames of the size
+ * given to reset() with an embedded frame counter in quadlet 0. The
+ * benchmarks use it as well.
+ */
+namespace fake_dc1394
+{
+
+struct FakeCamera
+{
+    uint64_t guid;
+    // false simulates an unplugged camera, every call on it fails
+    bool present;
+    uint32_t generation;
+    dc1394video_mode_t mode;
+    bool capturing;
+    uint32_t ring_size;
+    // calls of dc1394_capture_setup()
+    uint32_t capture_setups;
+    // frames waiting in the ring
+    uint32_t queued;
+    // embedded counter of the next frame
+    uint32_t counter;
+    uint64_t timestamp;
+    // camera handles which are not freed
+    int handles;
+    std::vector<unsigned char> image;
+    dc1394video_frame_t frame;
+};
+
+/** The simulated camera */
+FakeCamera &camera();
+
+/** Plugs in a camera with the given guid which is not capturing */
+void reset(uint64_t guid, uint32_t width = 640, uint32_t height = 480);
+
+/** Context to pass to CamFireWire::setDevice() */
+dc1394_t *device();
+
+}
+
+#endif	/* _FAKEDC1394_H */
@@ -0,0 +1,259 @@
+/*
+ * File:   test_BayerCodec.cpp
+ *
+ * Round trips of the Bayer codec and of compressed recordings.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "filter/bayer_codec.h"
+#include "FrameRecorder.h"
+
+using namespace camera;
+using namespace base::samples::frame;
+
+// deterministic pseudo random numbers, the tests must not depend on rand()
+static uint32_t nextRandom(uint32_t &state)
+{
+    state = state * 1664525 + 1013904223;
+    return state >> 8;
+}
+
+// a smooth gradient with a little sensor noise, bits significant bits
+static void fillScene(Frame &frame, unsigned bits, uint32_t seed)
+{
+    const uint32_t max = (1 << bits) - 1;
+    for (unsigned y = 0; y < frame.getHeight(); y++)
+    {
+        for (unsigned x = 0; x < frame.getWidth(); x++)
+        {
+            uint32_t value = ((x + 2 * y) << bits) / (frame.getWidth() + 2 * frame.getHeight());
+            value += nextRandom(seed) & 3;
+            if (value > max)
+                value = max;
+            if (frame.getDataDepth() == 8)
+                frame.getImagePtr()[y * frame.getWidth() + x] = value;
+            else
+                ((uint16_t *)frame.getImagePtr())[y * frame.getWidth() + x] = value;
+        }
+    }
+}
+
+static void fillNoise(Frame &frame, uint32_t seed)
+{
+    uint8_t *image = frame.getImagePtr();
+    for (size_t i = 0; i < frame.getNumberOfBytes(); i++)
+        image[i] = nextRandom(seed);
+}
+
+static bool sameImage(const Frame &a, const Frame &b)
+{
+    return a.getWidth() == b.getWidth() && a.getHeight() == b.getHeight() &&
+        a.getDataDepth() == b.getDataDepth() && a.getFrameMode() == b.getFrameMode() &&
+        a.getNumberOfBytes() == b.getNumberOfBytes() &&
+        memcmp(a.getImageConstPtr(), b.getImageConstPtr(), a.getNumberOfBytes()) == 0;
+}
+
+BOOST_AUTO_TEST_SUITE(bayer_codec)
+
+BOOST_AUTO_TEST_CASE(round_trip_8_bit)
+{
+    Frame frame(320, 240, 8, MODE_BAYER_RGGB);
+    fillScene(frame, 8, 1);
+    filter::BayerCodec codec(1);
+    std::vector<uint8_t> data;
+    BOOST_REQUIRE(codec.encode(frame, data));
+    BOOST_CHECK_LT(data.size(), frame.getNumberOfBytes());
+
+    Frame decoded;
+    BOOST_REQUIRE(codec.decode(&data[0], data.size(), decoded));
+    BOOST_CHECK(sameImage(frame, decoded));
+}
+
+BOOST_AUTO_TEST_CASE(round_trip_16_bit)
+{
+    Frame frame(320, 240, 16, MODE_BAYER_GRBG);
+    fillScene(frame, 12, 2);
+    filter::BayerCodec codec(1);
+    std::vector<uint8_t> data;
+    BOOST_REQUIRE(codec.encode(frame, data));
+    BOOST_CHECK_LT(data.size(), frame.getNumberOfBytes() / 2);
+
+    Frame decoded;
+    BOOST_REQUIRE(codec.decode(&data[0], data.size(), decoded));
+    BOOST_CHECK(sameImage(frame, decoded));
+}
+
+BOOST_AUTO_TEST_CASE(odd_band_height_on_several_threads)
+{
+    // 3 full bands and a last one of 38 rows, coded by 4 threads
+    filter::BayerCodec codec(4);
+    for (unsigned depth = 8; depth <= 16; depth += 8)
+    {
+        Frame frame(130, 230, depth, MODE_BAYER_BGGR);
+        fillScene(frame, depth == 8 ? 8 : 10, depth);
+        std::vector<uint8_t> data;
+        BOOST_REQUIRE(codec.encode(frame, data));
+        Frame decoded;
+        BOOST_REQUIRE(codec.decode(&data[0], data.size(), decoded));
+        BOOST_CHECK(sameImage(frame, decoded));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(workers_are_reused_across_frames)
+{
+    filter::BayerCodec codec(3);
+    std::vector<uint8_t> data;
+    Frame decoded;
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        // changing geometries make the pool adapt the number of bands
+        Frame frame(64 + 16 * (i % 4), 66 + 64 * (i % 3), 16, MODE_BAYER_RGGB);
+        fillScene(frame, 12, i);
+        BOOST_REQUIRE(codec.encode(frame, data));
+        BOOST_REQUIRE(codec.decode(&data[0], data.size(), decoded));
+        BOOST_CHECK(sameImage(frame, decoded));
+    }
+    codec.setThreads(2);
+    BOOST_CHECK_EQUAL(codec.getThreads(), 2U);
+    Frame frame(200, 200, 8, MODE_BAYER_RGGB);
+    fillScene(frame, 8, 99);
+    BOOST_REQUIRE(codec.encode(frame, data));
+    BOOST_REQUIRE(codec.decode(&data[0], data.size(), decoded));
+    BOOST_CHECK(sameImage(frame, decoded));
+}
+
+BOOST_AUTO_TEST_CASE(noise_round_trips)
+{
+    Frame frame(160, 120, 16, MODE_BAYER_RGGB);
+    fillNoise(frame, 3);
+    filter::BayerCodec codec(2);
+    std::vector<uint8_t> data;
+    BOOST_REQUIRE(codec.encode(frame, data));
+    Frame decoded;
+    BOOST_REQUIRE(codec.decode(&data[0], data.size(), decoded));
+    BOOST_CHECK(sameImage(frame, decoded));
+}
+
+BOOST_AUTO_TEST_CASE(truncated_stream_is_rejected)
+{
+    Frame frame(160, 130, 16, MODE_BAYER_RGGB);
+    fillScene(frame, 12, 4);
+    filter::BayerCodec codec(2);
+    std::vector<uint8_t> data;
+    BOOST_REQUIRE(codec.encode(frame, data));
+
+    Frame decoded;
+    const size_t sizes[] = { 0, 4, data.size() / 2, data.size() - 1 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        std::vector<uint8_t> truncated(data.begin(), data.begin() + sizes[i]);
+        truncated.push_back(0);
+        BOOST_CHECK(!codec.decode(&truncated[0], sizes[i], decoded));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(unsupported_frames_are_refused)
+{
+    filter::BayerCodec codec(1);
+    std::vector<uint8_t> data;
+    Frame rgb(64, 64, 8, MODE_RGB);
+    BOOST_CHECK(!filter::BayerCodec::isSupported(rgb));
+    BOOST_CHECK(!codec.encode(rgb, data));
+    Frame odd(63, 64, 8, MODE_BAYER_RGGB);
+    BOOST_CHECK(!codec.encode(odd, data));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// a recording in a temporary file which is removed again
+struct RecordingFixture
+{
+    std::string path;
+    FrameRecorder recorder;
+
+    RecordingFixture()
+    {
+        char name[] = "/tmp/camera_firewire_test_XXXXXX";
+        int fd = mkstemp(name);
+        BOOST_REQUIRE(fd >= 0);
+        ::close(fd);
+        path = name;
+        BOOST_REQUIRE(recorder.open(path));
+        recorder.setCodec(RecordHeader::CodecBayerRice, 2);
+    }
+
+    ~RecordingFixture()
+    {
+        recorder.close();
+        unlink(path.c_str());
+    }
+
+    // bytes the last write added to the recording
+    uint64_t write(const Frame &frame)
+    {
+        const uint64_t before = recorder.getBytesWritten();
+        BOOST_REQUIRE(recorder.write(frame));
+        return recorder.getBytesWritten() - before;
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(frame_recorder)
+
+BOOST_FIXTURE_TEST_CASE(compressed_recording_round_trips, RecordingFixture)
+{
+    Frame frames[4];
+    frames[0].init(320, 240, 8, MODE_BAYER_RGGB);
+    fillScene(frames[0], 8, 5);
+    frames[1].init(320, 240, 16, MODE_BAYER_RGGB);
+    fillScene(frames[1], 12, 6);
+    frames[2].init(130, 230, 16, MODE_BAYER_GBRG);
+    fillScene(frames[2], 12, 7);
+    // noise does not get smaller and is stored raw
+    frames[3].init(160, 120, 16, MODE_BAYER_RGGB);
+    fillNoise(frames[3], 8);
+
+    for (int i = 0; i < 4; i++)
+    {
+        frames[i].time = base::Time::fromMicroseconds(1000 * (i + 1));
+        const uint64_t bytes = write(frames[i]);
+        if (i < 3)
+            BOOST_CHECK_LT(bytes, sizeof(RecordHeader) + frames[i].getNumberOfBytes());
+        else
+            BOOST_CHECK_EQUAL(bytes, sizeof(RecordHeader) + frames[i].getNumberOfBytes());
+    }
+    BOOST_CHECK_EQUAL(recorder.getFramesWritten(), 4U);
+    recorder.close();
+
+    FILE *file = FrameRecorder::openRecording(path);
+    BOOST_REQUIRE(file);
+    Frame frame;
+    for (int i = 0; i < 4; i++)
+    {
+        BOOST_REQUIRE(FrameRecorder::read(file, frame));
+        BOOST_CHECK(sameImage(frames[i], frame));
+        BOOST_CHECK_EQUAL(frame.time.toMicroseconds(), 1000 * (i + 1));
+    }
+    BOOST_CHECK(!FrameRecorder::read(file, frame));
+    fclose(file);
+}
+
+BOOST_FIXTURE_TEST_CASE(truncated_recording_is_rejected, RecordingFixture)
+{
+    Frame frame(320, 240, 16, MODE_BAYER_RGGB);
+    fillScene(frame, 12, 9);
+    write(frame);
+    recorder.close();
+    BOOST_REQUIRE_EQUAL(truncate(path.c_str(), recorder.getBytesWritten() - 100), 0);
+
+    FILE *file = FrameRecorder::openRecording(path);
+    BOOST_REQUIRE(file);
+    Frame decoded;
+    BOOST_CHECK(!FrameRecorder::read(file, decoded));
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
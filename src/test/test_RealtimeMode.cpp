@@ -0,0 +1,187 @@
+/*
+ * File:   test_RealtimeMode.cpp
+ *
+ * Counts page faults and allocations of the real-time retrieve path of
+ * a simulated camera.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <sys/resource.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include "CamFireWire.h"
+#include "FakeDC1394.h"
+
+using namespace camera;
+using namespace base::samples::frame;
+
+// operator new of the whole test binary is counted while enabled
+static volatile bool count_allocations = false;
+static volatile unsigned long allocations = 0;
+
+void *operator new(size_t size)
+{
+    if (count_allocations)
+        allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) throw()
+{
+    free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+    free(p);
+}
+
+static long pageFaults()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+// locked memory of the process in kB
+static long lockedMemory()
+{
+    FILE *status = fopen("/proc/self/status", "r");
+    if (!status)
+        return -1;
+    char line[256];
+    long locked = -1;
+    while (fgets(line, sizeof(line), status))
+        if (sscanf(line, "VmLck: %ld", &locked) == 1)
+            break;
+    fclose(status);
+    return locked;
+}
+
+static const uint64_t GUID = 0x00b09d0100c0ffeeULL;
+
+// a capturing simulated camera with embedded frame counters, the whole
+// retrieve path from the dequeue to the requeue is the real one
+struct RealtimeCamera
+{
+    CamFireWire camera;
+    Frame frame;
+
+    RealtimeCamera()
+    {
+        fake_dc1394::reset(GUID);
+        BOOST_REQUIRE(camera.setDevice(fake_dc1394::device()));
+        CamInfo info;
+        info.unique_id = GUID;
+        BOOST_REQUIRE(camera.open(info, Master));
+        BOOST_REQUIRE(camera.setFrameSettings(frame_size_t(640, 480), MODE_GRAYSCALE, 1, false));
+        BOOST_REQUIRE(camera.setEmbeddedFrameInfo(true));
+    }
+
+    ~RealtimeCamera()
+    {
+        camera.setRealtimeMode(false);
+    }
+
+    // false if the memory of the process may not be locked
+    bool setRealtime()
+    {
+        if (!camera.setRealtimeMode(true))
+        {
+            BOOST_TEST_MESSAGE("mlockall is not permitted, skipping the real-time test");
+            return false;
+        }
+        return camera.prepareRealtimeFrame(frame);
+    }
+
+    // the camera delivers one frame, which is retrieved; no Boost check
+    // in here, it allocates
+    bool retrieve()
+    {
+        fake_dc1394::camera().queued = 1;
+        return camera.retrieveFrame(frame, 0);
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(realtime_mode)
+
+BOOST_FIXTURE_TEST_CASE(retrieve_path_neither_faults_nor_allocates, RealtimeCamera)
+{
+    BOOST_REQUIRE(camera.grab(Continuously, 4));
+    if (!setRealtime())
+        return;
+    BOOST_REQUIRE(retrieve());
+
+    bool retrieved = true;
+    const long faults = pageFaults();
+    count_allocations = true;
+    for (int i = 0; i < 98; i++)
+        retrieved = retrieve() && retrieved;
+    count_allocations = false;
+
+    BOOST_CHECK(retrieved);
+    BOOST_CHECK_EQUAL(pageFaults() - faults, 0);
+    BOOST_CHECK_EQUAL(allocations, 0UL);
+    BOOST_CHECK_EQUAL(frame.getStatus(), STATUS_VALID);
+    BOOST_CHECK(!frame.hasAttribute("FrameCounter"));
+    BOOST_CHECK_EQUAL(camera.getLastFrameCounter(), 98U);
+    BOOST_CHECK_EQUAL(camera.getCaptureStats().frames_dropped, 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(adaptive_ring_is_not_resized_in_realtime_mode, RealtimeCamera)
+{
+    fake_dc1394::FakeCamera &fake = fake_dc1394::camera();
+    camera.setRingDepthMode(RingDepthAdaptive);
+    camera.getRingDepthAdvisor().setWindow(10);
+    camera.getRingDepthAdvisor().setShrinkWindows(1);
+    BOOST_REQUIRE(camera.grab(Continuously, 32));
+    if (!setRealtime())
+        return;
+
+    // a consumer which keeps up makes the advisor shrink the ring
+    for (int i = 0; i < 50; i++)
+        BOOST_REQUIRE(retrieve());
+    BOOST_CHECK_LT(camera.getRingDepthAdvisor().getRecommendedDepth(), 32U);
+    BOOST_CHECK_EQUAL(fake.capture_setups, 1U);
+    BOOST_CHECK_EQUAL(fake.ring_size, 32U);
+
+    camera.setRealtimeMode(false);
+    BOOST_REQUIRE(retrieve());
+    BOOST_CHECK_EQUAL(fake.capture_setups, 2U);
+    BOOST_CHECK_EQUAL(fake.ring_size, camera.getRingDepthAdvisor().getRecommendedDepth());
+}
+
+BOOST_FIXTURE_TEST_CASE(normal_mode_attaches_the_embedded_info, RealtimeCamera)
+{
+    BOOST_REQUIRE(camera.grab(Continuously, 4));
+    fake_dc1394::camera().counter = 7;
+    BOOST_REQUIRE(retrieve());
+    BOOST_CHECK_EQUAL(frame.getStatus(), STATUS_VALID);
+    BOOST_CHECK_EQUAL(frame.getAttribute<uint32_t>("FrameCounter"), 7U);
+}
+
+BOOST_AUTO_TEST_CASE(memory_lock_is_shared)
+{
+    if (!lockProcessMemory())
+    {
+        BOOST_TEST_MESSAGE("mlockall is not permitted, skipping the memory lock test");
+        return;
+    }
+    BOOST_REQUIRE(lockProcessMemory());
+    unlockProcessMemory();
+    BOOST_CHECK_GT(lockedMemory(), 0);
+    unlockProcessMemory();
+    BOOST_CHECK_EQUAL(lockedMemory(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
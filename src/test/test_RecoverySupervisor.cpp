@@ -0,0 +1,83 @@
+/*
+ * File:   test_RecoverySupervisor.cpp
+ *
+ * Recovers a simulated camera which is unplugged and plugged in again.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <unistd.h>
+#include "CamFireWire.h"
+#include "RecoverySupervisor.h"
+#include "FakeDC1394.h"
+
+using namespace camera;
+
+static const uint64_t GUID = 0x00b09d0100a1b2c3ULL;
+
+// longer than the first backoffs of the supervisor (50 and 100 ms)
+static const useconds_t BACKOFF_WAIT = 120000;
+
+struct CapturingCamera
+{
+    CamFireWire camera;
+
+    CapturingCamera()
+    {
+        fake_dc1394::reset(GUID);
+        BOOST_REQUIRE(camera.setDevice(fake_dc1394::device()));
+        CamInfo info;
+        info.unique_id = GUID;
+        BOOST_REQUIRE(camera.open(info, Master));
+        BOOST_REQUIRE(camera.grab(Continuously, 4));
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(recovery_supervisor)
+
+BOOST_FIXTURE_TEST_CASE(camera_is_reopened_after_unplugging, CapturingCamera)
+{
+    fake_dc1394::FakeCamera &fake = fake_dc1394::camera();
+    RecoverySupervisor supervisor(camera);
+    supervisor.setMaxAttempts(5);
+
+    // the restart fails on the unplugged camera, its handle is freed and
+    // no new one is found
+    fake.present = false;
+    BOOST_CHECK(!supervisor.recover());
+    BOOST_CHECK(supervisor.isRecovering());
+    BOOST_CHECK(!camera.isOpen());
+    BOOST_CHECK_EQUAL(fake.handles, 0);
+
+    // without a handle the next attempt still looks for the guid
+    usleep(BACKOFF_WAIT);
+    BOOST_CHECK(!supervisor.update(RecoverySupervisor::FrameError));
+    BOOST_CHECK(supervisor.isRecovering());
+
+    fake.present = true;
+    fake.generation++;
+    usleep(BACKOFF_WAIT);
+    BOOST_CHECK(supervisor.update(RecoverySupervisor::FrameError));
+    BOOST_CHECK(!supervisor.isRecovering());
+    BOOST_CHECK(!supervisor.isFailed());
+    BOOST_CHECK(camera.isOpen());
+    BOOST_CHECK_EQUAL(fake.handles, 1);
+
+    // capturing was resumed in the mode of the last grab()
+    BOOST_CHECK(fake.capturing);
+    BOOST_CHECK_EQUAL(fake.ring_size, 4U);
+    BOOST_CHECK_EQUAL(camera.getCaptureStats().recoveries, 1U);
+    BOOST_CHECK_EQUAL(camera.getCaptureStats().recovery_failures, 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(closed_camera_is_not_reopened, CapturingCamera)
+{
+    RecoverySupervisor supervisor(camera);
+    supervisor.setMaxAttempts(1);
+    camera.close();
+    BOOST_CHECK(!supervisor.recover());
+    BOOST_CHECK(supervisor.isFailed());
+    BOOST_CHECK(!camera.isOpen());
+    BOOST_CHECK_EQUAL(fake_dc1394::camera().handles, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,57 @@
+/*
+ * File:   test_RingDepthAdvisor.cpp
+ *
+ * Checks the ring depth recommendations for simulated consumers.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include "RingDepthAdvisor.h"
+
+using namespace camera;
+
+// frame period of the simulated camera in us
+static const uint64_t PERIOD = 10000;
+
+BOOST_AUTO_TEST_SUITE(ring_depth_advisor)
+
+BOOST_AUTO_TEST_CASE(ring_above_the_limit_is_kept_until_measured)
+{
+    RingDepthAdvisor advisor;
+    advisor.setWindow(10);
+    advisor.setShrinkWindows(2);
+    const uint32_t ring = 100;
+
+    uint64_t t = PERIOD;
+    BOOST_CHECK(!advisor.record(t, 0, ring, t));
+    BOOST_CHECK_EQUAL(advisor.getRecommendedDepth(), ring);
+
+    // a consumer which keeps up shrinks the ring after two calm windows
+    bool changed = false;
+    for (int i = 0; i < 30 && !changed; i++)
+    {
+        t += PERIOD;
+        changed = advisor.record(t, 0, ring, t);
+    }
+    BOOST_CHECK(changed);
+    BOOST_CHECK_LE(advisor.getRecommendedDepth(), 64U);
+    BOOST_CHECK_GE(advisor.getRecommendedDepth(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(overrun_never_shrinks_the_ring)
+{
+    RingDepthAdvisor advisor;
+    const uint32_t ring = 100;
+    advisor.record(PERIOD, 0, ring, PERIOD);
+    BOOST_CHECK(!advisor.record(2 * PERIOD, ring - 1, ring, 2 * PERIOD));
+    BOOST_CHECK_EQUAL(advisor.getRecommendedDepth(), ring);
+}
+
+BOOST_AUTO_TEST_CASE(overrun_doubles_the_ring)
+{
+    RingDepthAdvisor advisor;
+    advisor.record(PERIOD, 0, 4, PERIOD);
+    BOOST_CHECK(advisor.record(2 * PERIOD, 3, 4, 2 * PERIOD));
+    BOOST_CHECK_EQUAL(advisor.getRecommendedDepth(), 8U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,97 @@
+/*
+ * File:   test_ShmFrameRing.cpp
+ *
+ * Frames of a simulated camera through the shared memory ring.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "CamFireWire.h"
+#include "ShmFrameRing.h"
+#include "FakeDC1394.h"
+
+using namespace camera;
+using namespace base::samples::frame;
+
+static const uint64_t GUID = 0x00b09d0100d4e5f6ULL;
+
+// a ring of its own per process, tests may run in parallel
+static std::string segmentName()
+{
+    std::ostringstream name;
+    name << "camera_firewire_test_" << getpid();
+    return name.str();
+}
+
+struct ShmRingFixture
+{
+    CamFireWire camera;
+    ShmFrameWriter writer;
+    ShmFrameReader reader;
+
+    ShmRingFixture()
+    {
+        fake_dc1394::reset(GUID);
+        BOOST_REQUIRE(camera.setDevice(fake_dc1394::device()));
+        CamInfo info;
+        info.unique_id = GUID;
+        BOOST_REQUIRE(camera.open(info, Master));
+        BOOST_REQUIRE(camera.setFrameSettings(frame_size_t(640, 480), MODE_GRAYSCALE, 1, false));
+        BOOST_REQUIRE(writer.create(segmentName(), 4, camera));
+        BOOST_REQUIRE(reader.open(segmentName()));
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(shm_frame_ring, ShmRingFixture)
+
+BOOST_AUTO_TEST_CASE(embedded_counter_counts_drops)
+{
+    fake_dc1394::FakeCamera &fake = fake_dc1394::camera();
+    BOOST_REQUIRE(camera.setEmbeddedFrameInfo(true));
+    BOOST_REQUIRE(camera.grab(Continuously, 4));
+
+    fake.queued = 1;
+    BOOST_REQUIRE(writer.retrieve(camera, 0));
+    // the camera lost frames 1 to 3
+    fake.counter += 3;
+    fake.queued = 1;
+    BOOST_REQUIRE(writer.retrieve(camera, 0));
+
+    BOOST_CHECK_EQUAL(camera.getLastFrameCounter(), 4U);
+    BOOST_CHECK_EQUAL(camera.getCaptureStats().frames_dropped, 3U);
+    BOOST_CHECK_EQUAL(writer.getFramesWritten(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(hdr_flag_round_trips)
+{
+    Frame frame(64, 48, 8, MODE_GRAYSCALE);
+    frame.setHDR(true);
+    BOOST_REQUIRE(writer.write(frame));
+    Frame read;
+    BOOST_REQUIRE(reader.read(read));
+    BOOST_CHECK(read.isHDR());
+
+    Frame plain(64, 48, 8, MODE_GRAYSCALE);
+    BOOST_REQUIRE(writer.write(plain));
+    Frame read_plain;
+    BOOST_REQUIRE(reader.read(read_plain));
+    BOOST_CHECK(!read_plain.isHDR());
+}
+
+BOOST_AUTO_TEST_CASE(segment_is_private_by_default)
+{
+    std::string path = "/dev/shm/" + segmentName();
+    struct stat info;
+    BOOST_REQUIRE_EQUAL(stat(path.c_str(), &info), 0);
+    BOOST_CHECK_EQUAL(info.st_mode & 0777, 0600U);
+
+    ShmFrameWriter group_writer;
+    group_writer.setPermissions(0660);
+    BOOST_REQUIRE(group_writer.create(segmentName() + "_group", 2, 1024));
+    BOOST_REQUIRE_EQUAL(stat((path + "_group").c_str(), &info), 0);
+    BOOST_CHECK_EQUAL(info.st_mode & 0777, 0660U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,156 @@
+/*
+ * File:   test_VideoModeTable.cpp
+ *
+ * Checks the fixed video mode table against libdc1394.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <dc1394/dc1394.h>
+#include "VideoModeTable.h"
+
+using namespace camera;
+using namespace base::samples::frame;
+
+static dc1394video_modes_t allModes()
+{
+    dc1394video_modes_t modes;
+    modes.num = VideoModeTable::size();
+    for (uint32_t i = 0; i < modes.num; i++)
+        modes.modes[i] = VideoModeTable::entry(i).mode;
+    return modes;
+}
+
+BOOST_AUTO_TEST_SUITE(video_mode_table)
+
+BOOST_AUTO_TEST_CASE(table_follows_the_enum_order)
+{
+    // one entry per fixed mode, the modes after them are EXIF and Format7
+    BOOST_CHECK_EQUAL(VideoModeTable::size(), (uint32_t)(DC1394_VIDEO_MODE_EXIF - DC1394_VIDEO_MODE_MIN));
+    for (uint32_t i = 0; i < VideoModeTable::size(); i++)
+    {
+        const VideoModeEntry &entry = VideoModeTable::entry(i);
+        BOOST_CHECK_EQUAL(entry.mode, DC1394_VIDEO_MODE_MIN + i);
+        BOOST_CHECK_EQUAL(VideoModeTable::lookup(entry.mode), &entry);
+    }
+    BOOST_CHECK(VideoModeTable::lookup(DC1394_VIDEO_MODE_EXIF) == NULL);
+    BOOST_CHECK(VideoModeTable::lookup(DC1394_VIDEO_MODE_FORMAT7_0) == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(entries_match_their_coding)
+{
+    for (uint32_t i = 0; i < VideoModeTable::size(); i++)
+    {
+        const VideoModeEntry &entry = VideoModeTable::entry(i);
+        uint32_t bits, depth;
+        BOOST_REQUIRE_MESSAGE(dc1394_get_color_coding_bit_size(entry.coding, &bits) == DC1394_SUCCESS &&
+                              dc1394_get_color_coding_data_depth(entry.coding, &depth) == DC1394_SUCCESS,
+                              "unknown coding of mode " << entry.mode);
+        BOOST_CHECK_MESSAGE(entry.bits_per_pixel == bits && entry.data_depth == depth,
+                            "mode " << entry.mode << ": " << (int)entry.bits_per_pixel << "/" << (int)entry.data_depth
+                            << " bits, the coding has " << bits << "/" << depth);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(exact_sizes_select_their_mode)
+{
+    dc1394video_modes_t modes = allModes();
+    for (uint32_t i = 0; i < VideoModeTable::size(); i++)
+    {
+        const VideoModeEntry &entry = VideoModeTable::entry(i);
+        if (entry.frame_mode == MODE_UNDEFINED)
+            continue;
+        const VideoModeEntry *best = VideoModeTable::findBestMode(entry.width, entry.height,
+                                                                  entry.frame_mode, entry.data_depth, modes);
+        BOOST_REQUIRE(best);
+        BOOST_CHECK_EQUAL(best, &entry);
+    }
+}
+
+// the requested sizes of all_size_mode_depth_combinations
+static const uint32_t SIZES[][2] = { { 1, 1 }, { 320, 240 }, { 641, 480 }, { 800, 601 }, { 1024, 768 },
+                                     { 1300, 700 }, { 1600, 1200 }, { 4000, 3000 } };
+static const size_t SIZE_COUNT = sizeof(SIZES) / sizeof(SIZES[0]);
+
+// the mode expected for each of SIZES: the smallest one which fits,
+// else the largest one
+struct ExpectedModes
+{
+    frame_mode_t frame_mode;
+    uint8_t data_depth;
+    dc1394video_mode_t modes[SIZE_COUNT];
+};
+
+static const ExpectedModes EXPECTED_MODES[] =
+{
+    { MODE_GRAYSCALE, 8, { DC1394_VIDEO_MODE_640x480_MONO8, DC1394_VIDEO_MODE_640x480_MONO8,
+                           DC1394_VIDEO_MODE_800x600_MONO8, DC1394_VIDEO_MODE_1024x768_MONO8,
+                           DC1394_VIDEO_MODE_1024x768_MONO8, DC1394_VIDEO_MODE_1600x1200_MONO8,
+                           DC1394_VIDEO_MODE_1600x1200_MONO8, DC1394_VIDEO_MODE_1600x1200_MONO8 } },
+    { MODE_GRAYSCALE, 16, { DC1394_VIDEO_MODE_640x480_MONO16, DC1394_VIDEO_MODE_640x480_MONO16,
+                            DC1394_VIDEO_MODE_800x600_MONO16, DC1394_VIDEO_MODE_1024x768_MONO16,
+                            DC1394_VIDEO_MODE_1024x768_MONO16, DC1394_VIDEO_MODE_1600x1200_MONO16,
+                            DC1394_VIDEO_MODE_1600x1200_MONO16, DC1394_VIDEO_MODE_1600x1200_MONO16 } },
+    { MODE_RGB, 8, { DC1394_VIDEO_MODE_640x480_RGB8, DC1394_VIDEO_MODE_640x480_RGB8,
+                     DC1394_VIDEO_MODE_800x600_RGB8, DC1394_VIDEO_MODE_1024x768_RGB8,
+                     DC1394_VIDEO_MODE_1024x768_RGB8, DC1394_VIDEO_MODE_1600x1200_RGB8,
+                     DC1394_VIDEO_MODE_1600x1200_RGB8, DC1394_VIDEO_MODE_1600x1200_RGB8 } },
+    { MODE_UYVY, 8, { DC1394_VIDEO_MODE_320x240_YUV422, DC1394_VIDEO_MODE_320x240_YUV422,
+                      DC1394_VIDEO_MODE_800x600_YUV422, DC1394_VIDEO_MODE_1024x768_YUV422,
+                      DC1394_VIDEO_MODE_1024x768_YUV422, DC1394_VIDEO_MODE_1600x1200_YUV422,
+                      DC1394_VIDEO_MODE_1600x1200_YUV422, DC1394_VIDEO_MODE_1600x1200_YUV422 } },
+};
+
+BOOST_AUTO_TEST_CASE(all_size_mode_depth_combinations)
+{
+    dc1394video_modes_t modes = allModes();
+    for (size_t m = 0; m < sizeof(EXPECTED_MODES) / sizeof(EXPECTED_MODES[0]); m++)
+    {
+        const ExpectedModes &expected = EXPECTED_MODES[m];
+        for (size_t s = 0; s < SIZE_COUNT; s++)
+        {
+            const VideoModeEntry *best = VideoModeTable::findBestMode(SIZES[s][0], SIZES[s][1],
+                                                                      expected.frame_mode, expected.data_depth, modes);
+            BOOST_CHECK_MESSAGE(best && best->mode == expected.modes[s],
+                                SIZES[s][0] << "x" << SIZES[s][1] << " mode " << expected.frame_mode << " depth "
+                                << (int)expected.data_depth << ": got " << (best ? (int)best->mode : -1)
+                                << ", expected " << expected.modes[s]);
+        }
+    }
+
+    // combinations without any fixed mode
+    const frame_mode_t missing_modes[] = { MODE_RGB, MODE_UYVY, MODE_BAYER_RGGB, MODE_BAYER_RGGB };
+    const uint8_t missing_depths[] = { 16, 16, 8, 16 };
+    for (size_t m = 0; m < sizeof(missing_modes) / sizeof(missing_modes[0]); m++)
+    {
+        for (size_t s = 0; s < SIZE_COUNT; s++)
+            BOOST_CHECK_MESSAGE(!VideoModeTable::findBestMode(SIZES[s][0], SIZES[s][1], missing_modes[m],
+                                                              missing_depths[m], modes),
+                                SIZES[s][0] << "x" << SIZES[s][1] << " mode " << missing_modes[m]
+                                << " depth " << (int)missing_depths[m] << " has no fixed mode");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(only_supported_modes_are_selected)
+{
+    dc1394video_modes_t modes;
+    modes.num = 2;
+    modes.modes[0] = DC1394_VIDEO_MODE_640x480_MONO8;
+    modes.modes[1] = DC1394_VIDEO_MODE_1600x1200_MONO8;
+
+    const VideoModeEntry *best = VideoModeTable::findBestMode(800, 600, MODE_GRAYSCALE, 8, modes);
+    BOOST_REQUIRE(best);
+    BOOST_CHECK_EQUAL(best->mode, DC1394_VIDEO_MODE_1600x1200_MONO8);
+
+    // too large for every supported mode, the largest one is taken
+    best = VideoModeTable::findBestMode(2000, 2000, MODE_GRAYSCALE, 8, modes);
+    BOOST_REQUIRE(best);
+    BOOST_CHECK_EQUAL(best->mode, DC1394_VIDEO_MODE_1600x1200_MONO8);
+
+    BOOST_CHECK(VideoModeTable::findBestMode(640, 480, MODE_GRAYSCALE, 16, modes) == NULL);
+    BOOST_CHECK(VideoModeTable::findBestMode(640, 480, MODE_RGB, 8, modes) == NULL);
+
+    modes.num = 0;
+    BOOST_CHECK(VideoModeTable::findBestMode(640, 480, MODE_GRAYSCALE, 8, modes) == NULL);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
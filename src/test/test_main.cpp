@@ -0,0 +1,8 @@
+/*
+ * File:   test_main.cpp
+ *
+ * Entry point of the unit tests, which run without a camera.
+ */
+
+#define BOOST_TEST_MODULE camera_firewire
+#include <boost/test/unit_test.hpp>